@@ -0,0 +1,49 @@
+#pragma stage : compute
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(set = 0, binding = 0) uniform texture2D textures_2d[];
+layout(set = 0, binding = 2, r32f) uniform image2D pyramid_levels[];
+
+layout(push_constant) uniform PushConstants
+{
+  uvec2 source_size;
+  uvec2 destination_size;
+  uint source_index;
+  uint destination_index;
+  // Level 0 reduces the depth texture itself, the others the level below.
+  uint source_is_depth;
+};
+
+float
+load_source(ivec2 texel)
+{
+  if (source_is_depth != 0u) {
+    return texelFetch(textures_2d[source_index], texel, 0).r;
+  }
+  return imageLoad(pyramid_levels[source_index], texel).r;
+}
+
+void
+main()
+{
+  uvec2 texel = gl_GlobalInvocationID.xy;
+  if (any(greaterThanEqual(texel, destination_size))) {
+    return;
+  }
+
+  // Every source texel this one overlaps, so odd sizes lose nothing at the
+  // right and bottom edges.
+  uvec2 first = texel * source_size / destination_size;
+  uvec2 last = min(
+    ((texel + 1u) * source_size + destination_size - 1u) / destination_size,
+    source_size);
+
+  float depth = 1.0;
+  for (uint y = first.y; y < last.y; ++y) {
+    for (uint x = first.x; x < last.x; ++x) {
+      depth = min(depth, load_source(ivec2(x, y)));
+    }
+  }
+  imageStore(pyramid_levels[destination_index], ivec2(texel), vec4(depth));
+}
@@ -0,0 +1,117 @@
+#ifndef MESH_CULLING_GLSL
+#define MESH_CULLING_GLSL
+
+// Shared by the culling pass and the task shader of opaque_geometry_mesh.
+
+layout(set = 0, binding = 2, r32f) uniform readonly image2D pyramid_levels[];
+
+// Matches max_lods in mesh.hpp.
+const uint max_lods = 8u;
+// Matches GPUSubmesh in mesh.cpp.
+struct Submesh
+{
+  vec4 minimum;
+  vec4 maximum;
+  uint index_offset;
+  uint lod_count;
+  uint lod_offset[max_lods + 1];
+  // Object-space error of each LOD, from meshopt_simplify.
+  float lod_error[max_lods];
+  // The LOD chosen last time the submesh was visible.
+  uint lod;
+  // Whether the last culling pass kept the submesh.
+  uint visible;
+  // The meshlets of each LOD, as indices into the meshlet buffer.
+  uint lod_meshlet_offset[max_lods + 1];
+};
+layout(std430, buffer_reference) buffer SubmeshSSBO
+{
+  Submesh submeshes[];
+};
+layout(std430, buffer_reference) readonly buffer PyramidLevels
+{
+  uint indices[];
+};
+
+float
+load_pyramid(uint index, ivec2 texel)
+{
+  return imageLoad(pyramid_levels[nonuniformEXT(index)], texel).r;
+}
+
+// True when box_depth, the largest depth the box can produce, does not pass
+// the Greater test against anything drawn over the rectangle.
+bool
+is_occluded(PyramidLevels pyramid,
+            uvec2 pyramid_size,
+            uint level_count,
+            vec2 uv_min,
+            vec2 uv_max,
+            float box_depth)
+{
+  // The level where the rectangle is at most one texel across, so the
+  // four texels around its corners cover all of it.
+  vec2 size = (uv_max - uv_min) * vec2(pyramid_size);
+  uint level = uint(ceil(log2(max(max(size.x, size.y), 1.0))));
+  level = min(level, level_count - 1u);
+
+  uvec2 level_size = max(pyramid_size >> level, uvec2(1u));
+  uint index = pyramid.indices[level];
+  ivec2 last = ivec2(level_size) - 1;
+  ivec2 lo = min(ivec2(uv_min * vec2(level_size)), last);
+  ivec2 hi = min(ivec2(uv_max * vec2(level_size)), last);
+
+  float occluder = min(min(load_pyramid(index, lo),
+                           load_pyramid(index, ivec2(hi.x, lo.y))),
+                       min(load_pyramid(index, ivec2(lo.x, hi.y)),
+                           load_pyramid(index, hi)));
+  return box_depth < occluder;
+}
+
+// Whether the object-space box from lo to hi is inside the frustum and, if
+// level_count is not 0, not hidden behind the depth in the pyramid.
+bool
+is_box_visible(mat4 mvp,
+               vec3 lo,
+               vec3 hi,
+               PyramidLevels pyramid,
+               uvec2 pyramid_size,
+               uint level_count)
+{
+  // Corners outside each clip plane: -x, -y, +x, +y, then near. The box is
+  // culled when all eight are outside the same one.
+  uvec4 outside = uvec4(0u);
+  uint in_front_of_near = 0u;
+  vec3 ndc_min = vec3(1.0);
+  vec3 ndc_max = vec3(-1.0);
+  for (uint i = 0u; i < 8u; ++i) {
+    vec3 corner = mix(lo, hi, vec3(uvec3(i, i >> 1u, i >> 2u) & 1u));
+    vec4 clip = mvp * vec4(corner, 1.0);
+    outside +=
+      uvec4(lessThan(clip.xy, -clip.ww), greaterThan(clip.xy, clip.ww));
+    if (clip.z < 0.0) {
+      continue;
+    }
+    ++in_front_of_near;
+    vec3 ndc = clip.xyz / clip.w;
+    ndc_min = min(ndc_min, ndc);
+    ndc_max = max(ndc_max, ndc);
+  }
+
+  if (any(equal(outside, uvec4(8u))) || in_front_of_near == 0u) {
+    return false;
+  }
+
+  // Boxes crossing the near plane have no usable screen rectangle.
+  if (level_count == 0u || in_front_of_near != 8u) {
+    return true;
+  }
+
+  // The viewport is flipped, so +y in NDC is the top row of the image.
+  vec2 uv_min = clamp(vec2(ndc_min.x, -ndc_max.y) * 0.5 + 0.5, 0.0, 1.0);
+  vec2 uv_max = clamp(vec2(ndc_max.x, -ndc_min.y) * 0.5 + 0.5, 0.0, 1.0);
+  return !is_occluded(
+    pyramid, pyramid_size, level_count, uv_min, uv_max, ndc_max.z);
+}
+
+#endif
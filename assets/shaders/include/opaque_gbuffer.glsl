@@ -0,0 +1,43 @@
+#ifndef OPAQUE_GBUFFER_GLSL
+#define OPAQUE_GBUFFER_GLSL
+
+#include <opaque_material.glsl>
+
+layout(location = 0) out vec2 out_uvs;
+layout(location = 1) out vec4 out_normal_roughness;
+layout(location = 2) out uvec4 out_texture_indices;
+
+// Writes the geometry buffer for one fragment of an opaque surface.
+void
+write_gbuffer(PBRMaterial material, vec2 frag_uv, mat3 frag_tbn)
+{
+  out_uvs = vec2(frag_uv);
+
+  vec3 final_normal;
+
+  uint normal_texture = material.normal_texture_index;
+
+  if (normal_texture != 0) {
+    // Sample normal map
+    vec3 normal_map = textureBindlessNormal2D(normal_texture, 0, frag_uv);
+
+    // Transform from tangent space to world space using TBN matrix
+    final_normal = normalize(frag_tbn * normal_map);
+  } else {
+    // Use vertex normal if no normal map
+    final_normal = normalize(frag_tbn[2]); // Z component of TBN is the normal
+  }
+  uint roughness_texture = material.roughness_texture_index;
+  float roughness = material.roughness_factor; // Default roughness
+  if (roughness_texture != 0) {
+    roughness = textureBindless2D(roughness_texture, 1, frag_uv).r;
+  }
+
+  out_normal_roughness = vec4(final_normal, roughness);
+  out_texture_indices = uvec4(material.albedo_texture_index,
+                              normal_texture,
+                              roughness_texture,
+                              material.metallic_texture_index);
+}
+
+#endif
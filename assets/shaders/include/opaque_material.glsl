@@ -0,0 +1,31 @@
+#ifndef OPAQUE_MATERIAL_GLSL
+#define OPAQUE_MATERIAL_GLSL
+
+layout(std430, buffer_reference) readonly buffer MaterialRemapSSBO
+{
+  uint remap[];
+};
+struct PBRMaterial
+{
+  vec4 albedo_factor;
+  vec4 emissive_factor;
+  float metallic_factor;
+  float roughness_factor;
+  float normal_scale;
+  float ao_strength;
+
+  uint albedo_texture_index;
+  uint normal_texture_index;
+  uint roughness_texture_index;
+  uint metallic_texture_index;
+  uint ao_texture_index;
+  uint emissive_texture_index;
+
+  uint flags;
+};
+layout(std430, buffer_reference) readonly buffer MaterialSSBO
+{
+  PBRMaterial materials[];
+};
+
+#endif
@@ -160,9 +160,8 @@ main()
   // Sample and calculate normal
   vec3 final_normal;
   if (material.normal_texture_index != 0) {
-    vec3 normal_map =
-      textureBindless2D(material.normal_texture_index, sampler_index, uvs).xyz;
-    normal_map = normal_map * 2.0 - 1.0;
+    vec3 normal_map = textureBindlessNormal2D(
+      material.normal_texture_index, sampler_index, uvs);
     normal_map.xy *= material.normal_scale;
     final_normal = normalize(tbn_matrix * normal_map);
   } else {
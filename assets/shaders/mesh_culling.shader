@@ -0,0 +1,104 @@
+#pragma stage : compute
+
+#include <mesh_culling.glsl>
+#include <ubo.glsl>
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+struct DrawCommand
+{
+  uint index_count;
+  uint instance_count;
+  uint first_index;
+  int vertex_offset;
+  uint first_instance;
+};
+
+// Both start with the draw count, as IndirectBuffer lays them out.
+layout(std430, buffer_reference) readonly buffer SourceCommands
+{
+  uint count;
+  DrawCommand commands[];
+};
+layout(std430, buffer_reference) buffer CulledCommands
+{
+  uint count;
+  DrawCommand commands[];
+};
+layout(push_constant) uniform PushConstants
+{
+  mat4 model_transform;
+  UBO ubo;
+  SourceCommands source;
+  CulledCommands culled;
+  SubmeshSSBO submesh_ssbo;
+  PyramidLevels pyramid;
+  uvec2 pyramid_size;
+  uint draw_count;
+  // 0 while the pyramid is not ready; then only the frustum culls.
+  uint pyramid_level_count;
+  float viewport_height;
+  // The coarsest LOD whose error stays under this many pixels is drawn.
+  float lod_pixel_error;
+};
+
+// Moving to a coarser LOD needs the error this far below lod_pixel_error,
+// so a submesh near the limit does not flip between two LODs every frame.
+const float lod_hysteresis = 0.25;
+
+uint
+select_lod(Submesh submesh, vec3 centre, float radius)
+{
+  // The submesh's error in world units, seen from its closest point.
+  float scale = max(length(model_transform[0].xyz),
+                    max(length(model_transform[1].xyz),
+                        length(model_transform[2].xyz)));
+  float distance =
+    max(length(centre - ubo.camera_position.xyz) - radius, 0.01);
+  float pixels_per_unit = 0.5 * ubo.proj[1][1] * viewport_height / distance;
+
+  for (uint lod = submesh.lod_count - 1u; lod > 0u; --lod) {
+    float limit = lod > submesh.lod
+                    ? lod_pixel_error * (1.0 - lod_hysteresis)
+                    : lod_pixel_error;
+    if (submesh.lod_error[lod] * scale * pixels_per_unit <= limit) {
+      return lod;
+    }
+  }
+  return 0u;
+}
+
+void
+main()
+{
+  uint draw = gl_GlobalInvocationID.x;
+  if (draw >= draw_count) {
+    return;
+  }
+
+  DrawCommand command = source.commands[draw];
+  Submesh submesh = submesh_ssbo.submeshes[command.first_instance];
+  mat4 mvp = ubo.proj * ubo.view * model_transform;
+  bool visible = is_box_visible(mvp,
+                                submesh.minimum.xyz,
+                                submesh.maximum.xyz,
+                                pyramid,
+                                pyramid_size,
+                                pyramid_level_count);
+  submesh_ssbo.submeshes[command.first_instance].visible = uint(visible);
+
+  if (visible) {
+    vec3 lo = submesh.minimum.xyz;
+    vec3 hi = submesh.maximum.xyz;
+    vec3 centre = (model_transform * vec4(0.5 * (lo + hi), 1.0)).xyz;
+    float radius = 0.5 * length((model_transform * vec4(hi - lo, 0.0)).xyz);
+    uint lod = select_lod(submesh, centre, radius);
+    submesh_ssbo.submeshes[command.first_instance].lod = lod;
+    command.first_index = submesh.index_offset + submesh.lod_offset[lod];
+    command.index_count =
+      submesh.lod_offset[lod + 1u] - submesh.lod_offset[lod];
+
+    uint slot = atomicAdd(culled.count, 1u);
+    culled.commands[slot] = command;
+  }
+}
@@ -0,0 +1,272 @@
+#pragma stage : task
+
+#include <mesh_culling.glsl>
+#include <opaque_material.glsl>
+#include <ubo.glsl>
+
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+// Matches Meshlet in mesh.hpp.
+struct Meshlet
+{
+  vec4 bounding_sphere;
+  vec4 cone_axis_cutoff;
+  vec3 cone_apex;
+  uint mesh_index;
+  uint vertex_offset;
+  uint triangle_offset;
+  uint vertex_count;
+  uint triangle_count;
+};
+layout(std430, buffer_reference) readonly buffer MeshletSSBO
+{
+  Meshlet meshlets[];
+};
+// Up to 32 meshlets of one submesh, starting first meshlets into whichever
+// LOD the culling pass picked.
+struct TaskGroup
+{
+  uint submesh;
+  uint first;
+};
+layout(std430, buffer_reference) readonly buffer TaskGroups
+{
+  TaskGroup groups[];
+};
+// Matches the addresses VkMesh::create_meshlet_pipeline uploads.
+layout(std430, buffer_reference) readonly buffer MeshletGeometry
+{
+  uvec2 vertices;
+  MeshletSSBO meshlet_ssbo;
+  uvec2 meshlet_vertices;
+  uvec2 meshlet_triangles;
+  SubmeshSSBO submesh_ssbo;
+  TaskGroups task_groups;
+};
+
+layout(push_constant) uniform PushConstants
+{
+  mat4 model_transform;
+  UBO ubo;
+  MaterialSSBO material_ssbo;
+  MaterialRemapSSBO remap_ssbo;
+  uint sampler_index;
+  uint material_index;
+  MeshletGeometry geometry;
+  PyramidLevels pyramid;
+  uvec2 pyramid_size;
+  // 0 while the pyramid is not ready; then only the frustum and cones cull.
+  uint pyramid_level_count;
+  // 0 when the culling pass did not run, which draws every submesh at LOD 0.
+  uint is_culled;
+};
+
+struct TaskPayload
+{
+  uint meshlets[32];
+};
+taskPayloadSharedEXT TaskPayload payload;
+
+shared uint visible_count;
+
+bool
+is_visible(Meshlet meshlet, mat4 mvp)
+{
+  // Every triangle faces away from a camera inside the cone.
+  vec3 apex = (model_transform * vec4(meshlet.cone_apex, 1.0)).xyz;
+  vec3 axis =
+    normalize((model_transform * vec4(meshlet.cone_axis_cutoff.xyz, 0.0)).xyz);
+  vec3 view = normalize(apex - ubo.camera_position.xyz);
+  if (dot(view, axis) >= meshlet.cone_axis_cutoff.w) {
+    return false;
+  }
+
+  vec3 centre = meshlet.bounding_sphere.xyz;
+  vec3 extent = vec3(meshlet.bounding_sphere.w);
+  return is_box_visible(mvp,
+                        centre - extent,
+                        centre + extent,
+                        pyramid,
+                        pyramid_size,
+                        pyramid_level_count);
+}
+
+void
+main()
+{
+  if (gl_LocalInvocationIndex == 0u) {
+    visible_count = 0u;
+  }
+  barrier();
+
+  TaskGroup group = geometry.task_groups.groups[gl_WorkGroupID.x];
+  SubmeshSSBO submesh_ssbo = geometry.submesh_ssbo;
+  bool is_drawn = true;
+  uint lod = 0u;
+  if (is_culled != 0u) {
+    is_drawn = submesh_ssbo.submeshes[group.submesh].visible != 0u;
+    lod = submesh_ssbo.submeshes[group.submesh].lod;
+  }
+  uint first = submesh_ssbo.submeshes[group.submesh].lod_meshlet_offset[lod];
+  uint end =
+    submesh_ssbo.submeshes[group.submesh].lod_meshlet_offset[lod + 1u];
+
+  uint index = first + group.first + gl_LocalInvocationIndex;
+  mat4 mvp = ubo.proj * ubo.view * model_transform;
+  if (is_drawn && index < end &&
+      is_visible(geometry.meshlet_ssbo.meshlets[index], mvp)) {
+    payload.meshlets[atomicAdd(visible_count, 1u)] = index;
+  }
+  barrier();
+
+  EmitMeshTasksEXT(visible_count, 1u, 1u);
+}
+
+#pragma stage : mesh
+
+#include <opaque_material.glsl>
+#include <packing.glsl>
+#include <ubo.glsl>
+
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+// Matches max_meshlet_vertices and max_meshlet_triangles in mesh.hpp.
+layout(triangles, max_vertices = 64, max_primitives = 124) out;
+
+struct Meshlet
+{
+  vec4 bounding_sphere;
+  vec4 cone_axis_cutoff;
+  vec3 cone_apex;
+  uint mesh_index;
+  uint vertex_offset;
+  uint triangle_offset;
+  uint vertex_count;
+  uint triangle_count;
+};
+layout(std430, buffer_reference) readonly buffer MeshletSSBO
+{
+  Meshlet meshlets[];
+};
+// The packed vertices of opaque_geometry, six words each: position,
+// normal, uv and tangent.
+layout(std430, buffer_reference) readonly buffer Vertices
+{
+  uint words[];
+};
+layout(std430, buffer_reference) readonly buffer MeshletVertices
+{
+  uint indices[];
+};
+// Three bytes per triangle, every meshlet starting on a whole word.
+layout(std430, buffer_reference) readonly buffer MeshletTriangles
+{
+  uint words[];
+};
+
+// The first addresses of MeshletGeometry in the task stage.
+layout(std430, buffer_reference) readonly buffer MeshletGeometry
+{
+  Vertices vertices;
+  MeshletSSBO meshlet_ssbo;
+  MeshletVertices meshlet_vertices;
+  MeshletTriangles meshlet_triangles;
+};
+
+layout(push_constant) uniform PushConstants
+{
+  mat4 model_transform;
+  UBO ubo;
+  MaterialSSBO material_ssbo;
+  MaterialRemapSSBO remap_ssbo;
+  uint sampler_index;
+  uint material_index;
+  MeshletGeometry geometry;
+};
+
+struct TaskPayload
+{
+  uint meshlets[32];
+};
+taskPayloadSharedEXT TaskPayload payload;
+
+layout(location = 0) out flat uint out_instance_draw_id[];
+layout(location = 1) out vec2 frag_uv[];
+layout(location = 2) out mat3 frag_tbn[];
+
+uint
+load_triangle_index(MeshletTriangles meshlet_triangles, uint offset)
+{
+  return (meshlet_triangles.words[offset >> 2u] >> ((offset & 3u) * 8u)) &
+         0xFFu;
+}
+
+void
+main()
+{
+  Vertices vertices = geometry.vertices;
+  MeshletVertices meshlet_vertices = geometry.meshlet_vertices;
+  MeshletTriangles meshlet_triangles = geometry.meshlet_triangles;
+  Meshlet meshlet =
+    geometry.meshlet_ssbo.meshlets[payload.meshlets[gl_WorkGroupID.x]];
+  SetMeshOutputsEXT(meshlet.vertex_count, meshlet.triangle_count);
+
+  mat4 mvp = ubo.proj * ubo.view * model_transform;
+  mat3 normal_matrix = mat3(transpose(inverse(model_transform)));
+
+  for (uint i = gl_LocalInvocationIndex; i < meshlet.vertex_count; i += 32u) {
+    uint base = meshlet_vertices.indices[meshlet.vertex_offset + i] * 6u;
+    vec3 position = uintBitsToFloat(uvec3(vertices.words[base],
+                                          vertices.words[base + 1u],
+                                          vertices.words[base + 2u]));
+    vec3 normal = unpackSnorm3x10_1x2_manual(vertices.words[base + 3u]).xyz;
+    vec2 texcoord = unpackHalf2x16(vertices.words[base + 4u]);
+    vec4 signed_tangent =
+      unpackSnorm3x10_1x2_manual(vertices.words[base + 5u]);
+
+    vec3 world_normal = normalize(normal_matrix * normal);
+    vec3 world_tangent = normalize(normal_matrix * signed_tangent.xyz);
+    world_tangent = normalize(world_tangent -
+                              dot(world_tangent, world_normal) * world_normal);
+    vec3 world_bitangent =
+      cross(world_normal, world_tangent) * signed_tangent.w;
+
+    gl_MeshVerticesEXT[i].gl_Position = mvp * vec4(position, 1.0);
+    out_instance_draw_id[i] = meshlet.mesh_index;
+    frag_uv[i] = texcoord;
+    frag_tbn[i] = mat3(world_tangent, world_bitangent, world_normal);
+  }
+
+  for (uint i = gl_LocalInvocationIndex; i < meshlet.triangle_count;
+       i += 32u) {
+    uint offset = meshlet.triangle_offset + i * 3u;
+    gl_PrimitiveTriangleIndicesEXT[i] =
+      uvec3(load_triangle_index(meshlet_triangles, offset),
+            load_triangle_index(meshlet_triangles, offset + 1u),
+            load_triangle_index(meshlet_triangles, offset + 2u));
+  }
+}
+
+#pragma stage : fragment
+#include <opaque_gbuffer.glsl>
+#include <ubo.glsl>
+
+layout(location = 0) flat in uint in_draw_id;
+layout(location = 1) in vec2 frag_uv;
+layout(location = 2) in mat3 frag_tbn;
+
+layout(push_constant) uniform PushConstants
+{
+  mat4 model_transform;
+  UBO ubo;
+  MaterialSSBO material_ssbo;
+  MaterialRemapSSBO remap_ssbo;
+  uint sampler_index;
+  uint material_index;
+};
+
+void
+main()
+{
+  uint mat_index = remap_ssbo.remap[in_draw_id];
+  write_gbuffer(material_ssbo.materials[mat_index], frag_uv, frag_tbn);
+}
@@ -0,0 +1,112 @@
+#include "vk-bindless/mip_generator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <random>
+#include <span>
+#include <vector>
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize2.h>
+
+using namespace VkBindless;
+
+namespace {
+
+template<typename Func>
+auto
+time_ms(const std::uint32_t iterations, Func&& func) -> double
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < iterations; ++i) {
+    func();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() /
+         iterations;
+}
+
+/// Byte offset of every level in one allocation, like a KTX texture.
+auto
+level_offsets(std::uint32_t width, std::uint32_t height)
+  -> std::vector<std::size_t>
+{
+  std::vector<std::size_t> offsets{ 0 };
+  while (width > 1 || height > 1) {
+    offsets.push_back(offsets.back() + std::size_t{ width } * height * 4);
+    width = mip_extent(width);
+    height = mip_extent(height);
+  }
+  offsets.push_back(offsets.back() + 4);
+  return offsets;
+}
+
+auto
+run(const std::uint32_t size) -> void
+{
+  std::mt19937 rng{ 1234 };
+  std::vector<std::uint8_t> image(std::size_t{ size } * size * 4);
+  for (auto& byte : image) {
+    byte = static_cast<std::uint8_t>(rng());
+  }
+  const auto offsets = level_offsets(size, size);
+  std::vector<std::uint8_t> chain(offsets.back());
+  std::ranges::copy(image, chain.begin());
+
+  // The previous importer: every level resampled from level 0.
+  const auto from_base_ms = time_ms(3, [&] {
+    auto extent = size;
+    for (auto i = 1U; i + 1 < offsets.size(); ++i) {
+      extent = mip_extent(extent);
+      stbir_resize_uint8_linear(image.data(),
+                                static_cast<int>(size),
+                                static_cast<int>(size),
+                                0,
+                                chain.data() + offsets[i],
+                                static_cast<int>(extent),
+                                static_cast<int>(extent),
+                                0,
+                                STBIR_RGBA);
+    }
+  });
+
+  const auto successive_ms = [&](const MipContent content) {
+    return time_ms(3, [&] {
+      auto extent = size;
+      for (auto i = 1U; i + 1 < offsets.size(); ++i) {
+        const auto next = mip_extent(extent);
+        const auto levels = std::span{ chain };
+        downsample_rgba8(
+          levels.subspan(offsets[i - 1], offsets[i] - offsets[i - 1]),
+          extent,
+          extent,
+          levels.subspan(offsets[i], offsets[i + 1] - offsets[i]),
+          content);
+        extent = next;
+      }
+    });
+  };
+
+  std::cout << std::format("{:>5}^2: stbir from level 0 {:>8.2f} ms, "
+                           "successive linear {:>7.2f} ms, srgb {:>7.2f} ms, "
+                           "normal {:>7.2f} ms\n",
+                           size,
+                           from_base_ms,
+                           successive_ms(MipContent::Linear),
+                           successive_ms(MipContent::Srgb),
+                           successive_ms(MipContent::NormalMap));
+}
+
+} // namespace
+
+auto
+main() -> int
+{
+  for (const auto size : { 2048U, 4096U }) {
+    run(size);
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "vk-bindless/object_pool.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+
+struct BenchTag
+{};
+struct BenchImpl
+{
+  std::uint64_t payload{ 0 };
+
+  auto operator<=>(const BenchImpl&) const = default;
+};
+
+namespace VkBindless {
+auto
+context_destroy(IContext*, Handle<BenchTag>) -> void
+{
+}
+} // namespace VkBindless
+
+using namespace VkBindless;
+
+namespace {
+
+template<typename Func>
+auto
+time_ms(const std::uint32_t iterations, Func&& func) -> double
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < iterations; ++i) {
+    func();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() /
+         iterations;
+}
+
+auto
+run(const std::uint32_t slot_count, const double free_ratio) -> void
+{
+  Pool<BenchTag, BenchImpl> pool;
+  std::vector<Handle<BenchTag>> handles;
+  handles.reserve(slot_count);
+  for (std::uint32_t i = 0; i < slot_count; ++i) {
+    handles.push_back(pool.create(BenchImpl{ i }));
+  }
+
+  std::mt19937 rng{ 1234 };
+  std::ranges::shuffle(handles, rng);
+  const auto free_count = static_cast<std::uint32_t>(slot_count * free_ratio);
+  // The pool keeps its free list private, so the previous algorithm is
+  // reproduced here over the same set of freed indices.
+  std::vector<std::uint32_t> free_list;
+  free_list.reserve(free_count);
+  for (std::uint32_t i = 0; i < free_count; ++i) {
+    free_list.push_back(handles[i].index());
+    (void)pool.destroy(handles[i]);
+  }
+
+  std::uint64_t sink = 0;
+  const auto bitset_ms = time_ms(100, [&] {
+    pool.for_each_valid(
+      [&sink](const BenchImpl& object) { sink += object.payload; });
+  });
+
+  const auto free_list_ms = time_ms(1, [&] {
+    for (std::uint32_t i = 0; i < slot_count; ++i) {
+      if (std::ranges::find(free_list, i) == free_list.end()) {
+        sink += pool.at(i).payload;
+      }
+    }
+  });
+
+  std::cout << std::format("{:>8} slots, {:>5.1f}% free: bitset {:>9.4f} ms, "
+                           "free-list walk {:>10.3f} ms ({})\n",
+                           slot_count,
+                           free_ratio * 100.0,
+                           bitset_ms,
+                           free_list_ms,
+                           sink);
+}
+
+} // namespace
+
+auto
+main() -> int
+{
+  for (const auto ratio : { 0.001, 0.01, 0.1, 0.5 }) {
+    run(100'000, ratio);
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include "vk-bindless/buffer.hpp"
+#include "vk-bindless/graphics_context.hpp"
+#include "vk-bindless/holder.hpp"
+#include "vk-bindless/object_pool.hpp"
+#include "vk-bindless/vulkan_context.hpp"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <numeric>
+#include <span>
+#include <string_view>
+#include <vector>
+
+using namespace VkBindless;
+
+namespace {
+
+constexpr std::uint32_t iterations = 8;
+
+struct UploadPath
+{
+  std::string_view name;
+  StorageType storage;
+};
+
+constexpr std::size_t max_mib = 256;
+
+auto
+report(const UploadPath& path,
+       const std::string_view what,
+       const std::size_t bytes,
+       const double ms,
+       const std::string_view how) -> void
+{
+  const auto gb = static_cast<double>(bytes) / 1e9;
+  std::cout << std::format("{:>12} {:>8} {:>4} MiB: {:>9.3f} ms, {:>7.2f} "
+                           "GB/s ({})\n",
+                           path.name,
+                           what,
+                           bytes / (1024 * 1024),
+                           ms,
+                           gb / (ms / 1000.0),
+                           how);
+}
+
+// Times writes into one buffer, created up front, until the GPU can read
+// them. Deferred frees only run on frame submit, which this never does, so
+// each path allocates once. The first write is timed on its own: only a
+// buffer no frame has seen yet can be written in place (ReBAR), every
+// later re-upload is copied through the staging buffer.
+auto
+run(IContext& context,
+    const UploadPath& path,
+    const std::span<const std::byte> data) -> void
+{
+  auto buffer = VkDataBuffer::create(context,
+                                     {
+                                       .size = max_mib * 1024 * 1024,
+                                       .storage = path.storage,
+                                       .usage = BufferUsageFlags::StorageBuffer,
+                                       .debug_name = "Upload Benchmark",
+                                     });
+  auto* created = *context.get_buffer_pool().get(*buffer);
+  const auto how = [created] {
+    if (!created->is_writable_in_place()) {
+      return "staged copy";
+    }
+    return (created->get_memory_flags() &
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0
+             ? "ReBAR write"
+             : "host write";
+  };
+  const auto upload = [&](const std::span<const std::byte> bytes) {
+    const auto start = std::chrono::steady_clock::now();
+    context.begin_upload_batch();
+    created->write(context, bytes, 0);
+    if (const auto handle = context.end_upload_batch(); !handle.empty()) {
+      context.wait_for(handle);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  };
+
+  const auto* first_how = how();
+  report(path, "initial", data.size(), upload(data), first_how);
+
+  for (const auto mib : { 1U, 16U, 64U, 256U }) {
+    const auto bytes = data.first(static_cast<std::size_t>(mib) * 1024 * 1024);
+    double total_ms = 0.0;
+    for (std::uint32_t i = 0; i < iterations; ++i) {
+      total_ms += upload(bytes);
+    }
+    report(path, "re-upload", bytes.size(), total_ms / iterations, how());
+  }
+}
+
+} // namespace
+
+auto
+main() -> int
+{
+  glfwInit();
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow* window =
+    glfwCreateWindow(64, 64, "Upload Benchmark", nullptr, nullptr);
+
+  auto maybe_context = Context::create([window](VkInstance instance) {
+    VkSurfaceKHR surface{ VK_NULL_HANDLE };
+    glfwCreateWindowSurface(instance, window, nullptr, &surface);
+    return surface;
+  });
+  if (!maybe_context.has_value()) {
+    std::cerr << std::format("Failed to create context: {}\n",
+                             maybe_context.error().message);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 1;
+  }
+
+  {
+    auto& context = *maybe_context.value();
+    constexpr std::array paths{
+      UploadPath{ "host-visible", StorageType::HostVisible },
+      UploadPath{ "device-local", StorageType::DeviceLocal },
+      UploadPath{ "device-only", StorageType::DeviceOnly },
+    };
+    std::vector<std::byte> data(max_mib * 1024 * 1024);
+    std::iota(reinterpret_cast<std::uint8_t*>(data.data()),
+              reinterpret_cast<std::uint8_t*>(data.data() + data.size()),
+              std::uint8_t{ 0 });
+    for (const auto& path : paths) {
+      run(context, path, data);
+    }
+  }
+
+  maybe_context.value().reset();
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}
@@ -3,6 +3,7 @@
 #include "vk-bindless/command_buffer.hpp"
 #include "vk-bindless/common.hpp"
 #include "vk-bindless/container.hpp"
+#include "vk-bindless/depth_pyramid.hpp"
 #include "vk-bindless/event_system.hpp"
 #include "vk-bindless/graphics_context.hpp"
 #include "vk-bindless/imgui_renderer.hpp"
@@ -473,7 +474,7 @@ compute_and_cache_brdf(auto& context)
     {
       .data = {},
       .size = brdf_buffer_size,
-      .storage = StorageType::DeviceLocal,
+      .storage = StorageType::HostVisible,
       .usage = BufferUsageFlags::StorageBuffer | BufferUsageFlags::TransferDst,
       .debug_name = "BRDF LUT Buffer",
     });
@@ -591,7 +592,10 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
   MeshFile::preload_mesh("assets/meshes/bistro_interior.glb");
   auto duck_model_file =
     *MeshFile::create(context, "assets/.mesh_cache/bistro_interior.glb");
-  VkMesh duck_model{ context, duck_model_file };
+  TextureStreamer texture_streamer{ context };
+  VkMesh duck_model{ context, duck_model_file, texture_streamer };
+  const auto duck_transform = glm::scale(glm::mat4{ 1.0F }, glm::vec3{ 0.1F });
+  DepthPyramid depth_pyramid{ context };
 
   // auto duck_model = *Model::create(context, "");
 
@@ -637,8 +641,15 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
     VertexFormat::HalfFloat2,         // uvs
     VertexFormat::Int_2_10_10_10_REV, // tangent+handedness
   });
-  auto opaque_geometry =
-    *VkShader::create(&context, "assets/shaders/opaque_geometry.shader");
+  // The scene shaders are independent, so all of their stages compile at once.
+  const std::array<std::filesystem::path, 4> scene_shader_paths{
+    "assets/shaders/opaque_geometry.shader",
+    "assets/shaders/lighting_gbuffer.shader",
+    "assets/shaders/post.shader",
+    "assets/shaders/grid.shader",
+  };
+  auto scene_shaders = VkShader::create_many(&context, scene_shader_paths);
+  auto opaque_geometry = std::move(*scene_shaders[0]);
   uint32_t uses_ssbo = 1;
   auto geometry_ssbo = VkGraphicsPipeline::create(
     &context,
@@ -711,8 +722,7 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
   context.on_shader_changed("assets/shaders/opaque_geometry.shader",
                             *geometry_pc);
 
-  auto lighting_shader =
-    *VkShader::create(&context, "assets/shaders/lighting_gbuffer.shader");
+  auto lighting_shader = std::move(*scene_shaders[1]);
   auto lighting_pipeline = VkGraphicsPipeline::create(
     &context,
     {
@@ -842,7 +852,7 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
                            static_cast<std::uint32_t>(state.windowed_height));
   // Post pipeline & shader (samples resolved offscreen texture by index via
   // push constants)
-  auto post_shader = *VkShader::create(&context, "assets/shaders/post.shader");
+  auto post_shader = std::move(*scene_shaders[2]);
 
   auto post_pipeline = VkGraphicsPipeline::create(
     &context,
@@ -855,7 +865,7 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
     });
   context.on_shader_changed("assets/shaders/post.shader", *post_pipeline);
 
-  auto grid_shader = *VkShader::create(&context, "assets/shaders/grid.shader");
+  auto grid_shader = std::move(*scene_shaders[3]);
   auto grid_pipeline = VkGraphicsPipeline::create(
     &context,
     {
@@ -872,6 +882,16 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
     });
   context.on_shader_changed("assets/shaders/grid.shader", *grid_pipeline);
 
+  const std::array scene_pipelines{ *geometry_ssbo,
+                                    *geometry_pc,
+                                    *lighting_pipeline,
+                                    *post_pipeline,
+                                    *grid_pipeline };
+  context.prewarm(scene_pipelines, {});
+  // Everything the first frames need is built, so later rebuilds (shader
+  // hot reloads) can happen off the render thread.
+  context.set_async_pipeline_compilation(true);
+
   double last_time = glfwGetTime();
 
   auto ensure_size = [&](int w, int h) {
@@ -928,12 +948,30 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
     };
     main_ubo.upload(context, std::span{ &ubo_data, 1 });
 
+    duck_model.request_textures(duck_model_file,
+                                duck_transform,
+                                camera.get_position(),
+                                projection,
+                                static_cast<float>(new_height));
+    texture_streamer.update();
+
     // Recreate offscreen textures if window size changed
     ensure_size(new_width, new_height);
 
     // Acquire command buffer
     auto& buf = context.acquire_command_buffer();
 
+    // Occlusion is tested against last frame's depth, reduced before the
+    // geometry pass overwrites it.
+    depth_pyramid.build(buf, *g_depth);
+    duck_model.cull(buf,
+                    context,
+                    duck_model_file,
+                    depth_pyramid,
+                    duck_transform,
+                    main_ubo.get_address(context),
+                    static_cast<float>(new_height));
+
     constexpr auto black = std::array{ 0.0F, 0.0F, 0.0F, 0.0F };
 
     // ---------------- PASS 1: OFFSCREEN GEOMETRY (MSAA -> resolve)
@@ -982,6 +1020,7 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
                             gbuffer_fb,
                             {
                               .textures = {},
+                              .buffers = { duck_model.get_culled_commands() },
                             });
 
     buf.cmd_bind_depth_state(gbuffer_depth_state);
@@ -995,7 +1034,7 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
       std::uint32_t sampler_index;
       std::uint32_t material_index;
     } data{
-      .model_transform = glm::scale(glm::mat4{ 1.0F }, glm::vec3{ 0.1F }),
+      .model_transform = duck_transform,
       .ubo = main_ubo.get_address(context),
       .material_ssbo = duck_model.get_material_buffer_handle(context),
       .material_remap_ssbo =
@@ -1074,7 +1113,7 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
             .store_op = StoreOp::Store,
         },
     },
-    .depth = {.load_op = LoadOp::Load, .store_op = StoreOp::DontCare,},
+    .depth = {.load_op = LoadOp::Load, .store_op = StoreOp::Store,},
     .stencil = {},
     .layer_count = 1,
     .view_mask = 0,
@@ -1149,7 +1188,8 @@ run_main(WindowState& state, GLFWwindow* window, VkBindless::IContext& context)
             },
             .depth = {
                 .load_op = LoadOp::Load, 
-                .store_op = StoreOp::DontCare,
+                // Next frame's depth pyramid is built from this.
+                .store_op = StoreOp::Store,
             },
             .stencil = {},
             .layer_count = 1,
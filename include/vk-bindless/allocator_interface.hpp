@@ -20,6 +20,9 @@ struct AllocationInfo
   VkDeviceSize offset{};
   VkDeviceSize size{};
   void* mapped_data = nullptr;
+  // What the allocator actually picked, which may differ from what was
+  // preferred, e.g. device-local memory that is also host-visible (ReBAR).
+  VkMemoryPropertyFlags memory_properties{ 0 };
 };
 
 enum struct MemoryUsage
@@ -35,12 +38,26 @@ enum struct MemoryUsage
   AutoPreferHost
 };
 
+/// How the host touches mapped memory. SequentialWrite allows
+/// write-combined memory, which is fast to fill with memcpy but very slow to
+/// read back.
+enum struct HostAccess
+{
+  Random,
+  SequentialWrite,
+};
+
 constexpr std::uint32_t any_memory_type_bits = 0;
 
 struct AllocationCreateInfo
 {
   MemoryUsage usage = MemoryUsage::Auto;
   bool map_memory = false;
+  HostAccess host_access = HostAccess::Random;
+  // Lets a mapped allocation fall back to memory the host cannot see when
+  // the preferred memory has no host-visible type; mapped_data is then null
+  // and the contents have to be copied in.
+  bool allow_transfer_instead = false;
   std::uint32_t preferred_memory_bits =
     any_memory_type_bits; // If set to 0, the allocator will choose the best
                           // memory type
@@ -34,6 +34,9 @@ MAKE_BIT_FIELD(BufferUsageFlags)
 
 enum class StorageType : std::uint32_t
 {
+  /// Mapped and written in place when the device exposes device-local
+  /// host-visible memory (ReBAR), otherwise filled through the staging
+  /// buffer. Do not read back from it or rely on it being mapped.
   DeviceLocal,
   HostVisible,
   HostCoherent,
@@ -41,6 +44,11 @@ enum class StorageType : std::uint32_t
   DeviceCoherent,
   DeviceCached,
   MemoryLess,
+  /// Host-visible, write-combined copy source for the staging allocator.
+  Staging,
+  /// Never mapped; always filled through the staging buffer, leaving ReBAR
+  /// space to the buffers that are rewritten often.
+  DeviceOnly,
 };
 
 struct BufferDescription
@@ -60,6 +68,7 @@ class VkDataBuffer
   VkDeviceSize size{ 0 };
   VkBufferUsageFlags usage_flags{ 0 };
   VkMemoryPropertyFlags memory_flags{ 0 };
+  bool initialised{ false };
 
 public:
   static auto create(IContext& context, const BufferDescription& desc)
@@ -83,10 +92,29 @@ public:
   {
     return usage_flags;
   }
+  /// The properties of the memory the buffer actually ended up in.
   [[nodiscard]] auto get_memory_flags() const -> VkMemoryPropertyFlags
   {
     return memory_flags;
   }
+  /// Whether an upload has already filled the buffer, in which case frames
+  /// in flight may still be reading it.
+  [[nodiscard]] auto is_initialised() const -> bool { return initialised; }
+  auto set_initialised() -> void { initialised = true; }
+  /// Mapped buffers are written in place until they are initialised. After
+  /// that a write has to be ordered against frames in flight, so it goes
+  /// through the staging buffer, unless the buffer can't be a copy target.
+  [[nodiscard]] auto is_writable_in_place() const -> bool
+  {
+    return is_mapped() &&
+           (!initialised ||
+            (usage_flags & VK_BUFFER_USAGE_TRANSFER_DST_BIT) == 0);
+  }
+
+  /// Writes in place while is_writable_in_place, otherwise copies through
+  /// the staging buffer.
+  auto write(IContext&, std::span<const std::byte> data, std::uint64_t offset)
+    -> void;
 
   auto flush_mapped_memory(IContext&,
                            std::uint64_t offset = 0,
@@ -146,7 +174,7 @@ private:
 public:
   IndirectBuffer(IContext& ctx,
                  std::size_t max_draw_commands,
-                 StorageType = StorageType::DeviceLocal);
+                 StorageType = StorageType::HostVisible);
 
   auto upload() -> void;
   auto as_span() const -> std::span<VkDrawIndexedIndirectCommand>;
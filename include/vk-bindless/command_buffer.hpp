@@ -36,9 +36,6 @@ public:
 
     virtual auto cmd_bind_compute_pipeline(ComputePipelineHandle handle)
         -> void = 0;
-    virtual auto cmd_dispatch_thread_groups(const Dimensions &threadgroup_count,
-                                            const Dependencies &deps = {})
-        -> void = 0;
 */
   virtual auto cmd_begin_rendering(const RenderPass& render_pass,
                                    const Framebuffer& framebuffer,
@@ -66,7 +63,29 @@ public:
                                          std::size_t indirect_buffer_offset,
                                          std::uint32_t draw_count,
                                          std::uint32_t stride) -> void = 0;
-  virtual auto cmd_dispatch_thread_groups(const Dimensions&) -> void = 0;
+  /// Draws up to max_draw_count commands; the GPU reads the actual count
+  /// from count_buffer.
+  virtual auto cmd_draw_indexed_indirect_count(
+    BufferHandle indirect_buffer,
+    std::size_t indirect_buffer_offset,
+    BufferHandle count_buffer,
+    std::size_t count_buffer_offset,
+    std::uint32_t max_draw_count,
+    std::uint32_t stride = 0) -> void = 0;
+  /// Launches task shader workgroups, or mesh shader workgroups when the
+  /// pipeline has no task stage. Needs IContext::supports_mesh_shaders().
+  virtual auto cmd_draw_mesh_tasks(const Dimensions& threadgroup_count)
+    -> void = 0;
+  /// Writes to textures and buffers in deps made by earlier commands are
+  /// visible to the dispatch. Storage textures in deps are moved to
+  /// VK_IMAGE_LAYOUT_GENERAL first.
+  virtual auto cmd_dispatch_thread_groups(const Dimensions& threadgroup_count,
+                                          const Dependencies& deps = {})
+    -> void = 0;
+  virtual auto cmd_fill_buffer(BufferHandle buffer,
+                               std::size_t buffer_offset,
+                               std::size_t size,
+                               std::uint32_t data) -> void = 0;
 
   virtual auto cmd_push_constants(std::span<const std::byte>) -> void = 0;
   template<typename T>
@@ -89,9 +108,6 @@ public:
   /*
 
 
-          virtual auto cmd_fill_buffer(BufferHandle buffer, std::size_t
-         buffer_offset, std::size_t size, std::uint32_t data)
-              -> void = 0;
           virtual auto cmd_update_buffer(BufferHandle buffer, std::size_t
           buffer_offset, std::size_t size, const void *data)
               -> void = 0;
@@ -108,13 +124,7 @@ public:
                                          std::uint32_t draw_count,
                                          std::uint32_t stride = 0) -> void = 0;
 
-       -> void = 0; virtual auto cmd_draw_indexed_indirect_count( BufferHandle
-          indirect_buffer, std::size_t indirect_buffer_offset, BufferHandle
-          count_buffer, std::size_t count_buffer_offset, std::uint32_t
-         max_draw_count, std::uint32_t stride = 0) -> void = 0;
 
-          virtual auto cmd_draw_mesh_tasks(const Dimensions &threadgroup_count)
-              -> void = 0;
           virtual auto cmd_draw_mesh_tasks_indirect(BufferHandle
      indirect_buffer, std::size_t indirect_buffer_offset, std::uint32_t
      draw_count, std::uint32_t stride = 0)
@@ -192,7 +202,17 @@ public:
                                  std::size_t,
                                  std::uint32_t,
                                  std::uint32_t) -> void override;
-  auto cmd_dispatch_thread_groups(const Dimensions&) -> void override;
+  auto cmd_draw_indexed_indirect_count(BufferHandle,
+                                       std::size_t,
+                                       BufferHandle,
+                                       std::size_t,
+                                       std::uint32_t,
+                                       std::uint32_t = 0) -> void override;
+  auto cmd_draw_mesh_tasks(const Dimensions&) -> void override;
+  auto cmd_dispatch_thread_groups(const Dimensions&, const Dependencies& = {})
+    -> void override;
+  auto cmd_fill_buffer(BufferHandle, std::size_t, std::size_t, std::uint32_t)
+    -> void override;
   auto cmd_push_constants(std::span<const std::byte>) -> void override;
   auto cmd_bind_index_buffer(BufferHandle index_buffer,
                              IndexFormat index_format,
@@ -210,6 +230,9 @@ private:
   SubmitHandle last_submit_handle = {};
 
   VkPipeline last_pipeline_bound = VK_NULL_HANDLE;
+  // Set while the most recently bound pipeline is still compiling in the
+  // background. Work recorded against it is dropped until the next bind.
+  bool pipeline_pending = false;
 
   bool is_rendering = false;
   std::uint32_t view_mask = 0;
@@ -50,6 +50,9 @@ public:
   auto submit(const CommandBufferWrapper&) -> SubmitHandle;
 
   auto wait_semaphore(VkSemaphore) -> void;
+  /// Makes the next submission wait until a timeline semaphore reaches
+  /// value. Repeated calls before that submission keep the largest value.
+  auto wait_timeline_semaphore(VkSemaphore, std::uint64_t value) -> void;
   auto signal_semaphore(VkSemaphore, std::uint64_t) -> void;
   auto acquire_last_submit_semaphore() -> VkSemaphore;
 
@@ -87,6 +90,14 @@ private:
     .stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
     .deviceIndex = 0,
   };
+  VkSemaphoreSubmitInfo timeline_wait_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+    .pNext = nullptr,
+    .semaphore = VK_NULL_HANDLE,
+    .value = 0,
+    .stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+    .deviceIndex = 0,
+  };
   VkSemaphoreSubmitInfo signal_semaphore_info = {
     .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
     .pNext = nullptr,
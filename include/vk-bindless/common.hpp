@@ -273,6 +273,9 @@ enum class Format : uint8_t
   ETC2_RGB8,
   ETC2_SRGB8,
   BC7_RGBA,
+  BC7_SRGB,
+  BC4_R,
+  BC5_RG,
 
   Z_UN16,
   Z_UN24,
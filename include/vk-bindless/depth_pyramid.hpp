@@ -0,0 +1,57 @@
+#pragma once
+
+#include "vk-bindless/forward.hpp"
+#include "vk-bindless/handle.hpp"
+#include "vk-bindless/holder.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace VkBindless {
+
+/// Hierarchical-Z of a depth texture for occlusion culling. Level 0 is half
+/// the depth texture, and every level halves the one below it down to 1x1.
+/// A texel holds the smallest depth of everything it covers: with the
+/// Greater depth test, geometry whose depth stays below it is hidden.
+///
+/// Levels are single-mip R_F32 storage textures that stay in
+/// VK_IMAGE_LAYOUT_GENERAL; shaders find them through the bindless indices
+/// in get_level_indices().
+class DepthPyramid
+{
+public:
+  explicit DepthPyramid(IContext&);
+
+  /// Records the reduction of depth, outside of rendering. A depth texture
+  /// not seen before has not been drawn into yet: the levels are only
+  /// resized to it and the pyramid is not ready until the next build.
+  auto build(ICommandBuffer&, TextureHandle depth) -> void;
+
+  /// False until a build has actually run against the current depth.
+  [[nodiscard]] auto is_ready() const -> bool { return ready; }
+  [[nodiscard]] auto get_extent() const -> VkExtent2D { return extent; }
+  [[nodiscard]] auto get_level_count() const -> std::uint32_t
+  {
+    return static_cast<std::uint32_t>(levels.size());
+  }
+  /// uint32 bindless storage image index per level.
+  [[nodiscard]] auto get_level_indices() const -> BufferHandle
+  {
+    return *level_indices;
+  }
+
+private:
+  auto resize(VkExtent2D depth_extent) -> void;
+
+  IContext& context;
+  Holder<ShaderModuleHandle> shader;
+  Holder<ComputePipelineHandle> pipeline;
+  std::vector<Holder<TextureHandle>> levels{};
+  Holder<BufferHandle> level_indices;
+  TextureHandle source{};
+  VkExtent2D extent{ 0, 0 };
+  bool ready{ false };
+};
+
+} // namespace VkBindless
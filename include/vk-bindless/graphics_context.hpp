@@ -12,7 +12,10 @@
 
 #include <deque>
 #include <functional>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
@@ -77,6 +80,9 @@ struct IContext
                                    std::uint64_t offset,
                                    std::uint64_t size) -> void = 0;
   [[nodiscard]] virtual auto use_staging() const -> bool = 0;
+  /// Whether task and mesh shader pipelines (VK_EXT_mesh_shader) can be
+  /// created and drawn with cmd_draw_mesh_tasks.
+  [[nodiscard]] virtual auto supports_mesh_shaders() const -> bool = 0;
 
   virtual auto get_swapchain() -> Swapchain& = 0;
   virtual auto resize_swapchain(std::uint32_t width, std::uint32_t height)
@@ -107,6 +113,18 @@ struct IContext
     -> bool = 0;
   virtual auto update_pipeline(ComputePipelineHandle, ShaderModuleHandle)
     -> bool = 0;
+  /// Compile pipelines on worker threads instead of inside the bind that
+  /// first needs them. Draws keep using the previous pipeline (or are
+  /// skipped if there is none) until the new one is ready.
+  virtual auto set_async_pipeline_compilation(bool) -> void {}
+  /// Builds the given pipelines up front, in parallel, so the first frames
+  /// do not stall on them. view_masks is either empty (all zero) or holds
+  /// one mask per pipeline. Returns the build time of each pipeline.
+  virtual auto prewarm(std::span<const GraphicsPipelineHandle>,
+                       std::span<const std::uint32_t> view_masks)
+    -> std::vector<PipelineCompileTime> = 0;
+  virtual auto prewarm(std::span<const ComputePipelineHandle>)
+    -> std::vector<PipelineCompileTime> = 0;
 
   virtual auto acquire_command_buffer() -> ICommandBuffer& = 0;
   virtual auto acquire_immediate_command_buffer() -> CommandBufferWrapper& = 0;
@@ -114,6 +132,10 @@ struct IContext
     -> Expected<SubmitHandle, std::string> = 0;
   virtual auto get_current_swapchain_texture() -> TextureHandle = 0;
   virtual void wait_for(SubmitHandle value) = 0;
+  /// Groups the staging uploads made by buffer and texture creation into a
+  /// single submission. Prefer the UploadBatch scope below.
+  virtual auto begin_upload_batch() -> void = 0;
+  virtual auto end_upload_batch() -> SubmitHandle = 0;
 
   virtual auto on_shader_changed(std::string_view filename,
                                  GraphicsPipelineHandle) -> void = 0;
@@ -121,4 +143,32 @@ struct IContext
   auto get_format(TextureHandle handle) -> Format;
 };
 
+/// Submits every upload made during its lifetime at once, when it goes out
+/// of scope or when submit() is called.
+class UploadBatch final
+{
+public:
+  explicit UploadBatch(IContext& ctx)
+    : context(&ctx)
+  {
+    context->begin_upload_batch();
+  }
+  ~UploadBatch()
+  {
+    if (context != nullptr) {
+      context->end_upload_batch();
+    }
+  }
+  UploadBatch(const UploadBatch&) = delete;
+  auto operator=(const UploadBatch&) -> UploadBatch& = delete;
+
+  auto submit() -> SubmitHandle
+  {
+    return std::exchange(context, nullptr)->end_upload_batch();
+  }
+
+private:
+  IContext* context;
+};
+
 } // namespace VkBindless
\ No newline at end of file
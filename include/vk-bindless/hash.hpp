@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+namespace VkBindless {
+
+/// Incremental 64-bit FNV-1a. Not cryptographic, but stable across runs and
+/// platforms, which is all the on-disk caches need for invalidation.
+class Fnv1a64
+{
+public:
+  static constexpr std::uint64_t offset_basis = 0xcbf29ce484222325ULL;
+  static constexpr std::uint64_t prime = 0x100000001b3ULL;
+
+  constexpr auto update(std::span<const std::uint8_t> bytes) -> Fnv1a64&
+  {
+    for (const auto byte : bytes) {
+      state ^= byte;
+      state *= prime;
+    }
+    return *this;
+  }
+
+  auto update(std::span<const std::byte> bytes) -> Fnv1a64&
+  {
+    for (const auto byte : bytes) {
+      state ^= static_cast<std::uint8_t>(byte);
+      state *= prime;
+    }
+    return *this;
+  }
+
+  constexpr auto update(const std::string_view text) -> Fnv1a64&
+  {
+    for (const auto c : text) {
+      state ^= static_cast<std::uint8_t>(c);
+      state *= prime;
+    }
+    return *this;
+  }
+
+  /// Hashes the object representation, so only use with types that have no
+  /// padding.
+  template<typename T>
+    requires std::is_trivially_copyable_v<T>
+  auto update_value(const T& value) -> Fnv1a64&
+  {
+    return update(std::as_bytes(std::span{ &value, 1 }));
+  }
+
+  [[nodiscard]] constexpr auto digest() const -> std::uint64_t
+  {
+    return state;
+  }
+
+private:
+  std::uint64_t state{ offset_basis };
+};
+
+} // namespace VkBindless
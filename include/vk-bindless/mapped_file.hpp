@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+
+namespace VkBindless {
+
+/// Read-only mapping of a whole file. Spans into bytes() stay valid for as
+/// long as the MappedFile, or whatever it was moved into, is alive.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(MappedFile&&) noexcept;
+  auto operator=(MappedFile&&) noexcept -> MappedFile&;
+  MappedFile(const MappedFile&) = delete;
+  auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+  static auto open(const std::filesystem::path&)
+    -> std::expected<MappedFile, std::string>;
+
+  [[nodiscard]] auto bytes() const -> std::span<const std::byte>
+  {
+    return { data, size };
+  }
+
+private:
+  auto reset() -> void;
+
+  const std::byte* data{ nullptr };
+  std::size_t size{ 0 };
+#ifdef _WIN32
+  void* file{ nullptr };
+  void* mapping{ nullptr };
+#endif
+};
+
+} // namespace VkBindless
@@ -3,23 +3,33 @@
 #include "vk-bindless/buffer.hpp"
 #include "vk-bindless/common.hpp"
 #include "vk-bindless/container.hpp"
+#include "vk-bindless/depth_pyramid.hpp"
 #include "vk-bindless/forward.hpp"
 #include "vk-bindless/handle.hpp"
 #include "vk-bindless/holder.hpp"
+#include "vk-bindless/mapped_file.hpp"
 #include "vk-bindless/material.hpp"
+#include "vk-bindless/texture_streamer.hpp"
 
 #include <array>
 #include <cstdint>
 #include <filesystem>
 #include <ktx.h>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_set>
 #include <vector>
 
+struct aiMesh;
+
 namespace VkBindless {
 
 constexpr std::uint32_t max_lods{ 8 };
+/// Meshlet limits passed to meshopt_buildMeshlets; the mesh shader's
+/// max_vertices and max_primitives match them.
+constexpr std::uint32_t max_meshlet_vertices{ 64 };
+constexpr std::uint32_t max_meshlet_triangles{ 124 };
 
 using IndexType = std::uint32_t;
 
@@ -32,6 +42,12 @@ struct Mesh final
   std::uint32_t material_id{ 0 };
 
   std::array<std::uint32_t, max_lods + 1> lod_offset{};
+  /// The meshlets of LOD i are lod_meshlet_offset[i] up to
+  /// lod_meshlet_offset[i + 1] in MeshData::meshlets.
+  std::array<std::uint32_t, max_lods + 1> lod_meshlet_offset{};
+  /// Object-space distance each LOD strays from LOD 0, as reported by
+  /// meshopt_simplify. 0 for LOD 0.
+  std::array<float, max_lods> lod_error{};
 
   auto get_lod_indices_count(std::unsigned_integral auto lod_index) const
   {
@@ -41,6 +57,29 @@ struct Mesh final
   }
 };
 
+/// A cluster of at most max_meshlet_triangles triangles, laid out like
+/// Meshlet in opaque_geometry_mesh.shader.
+struct Meshlet final
+{
+  /// Object-space centre and radius.
+  glm::vec4 bounding_sphere{};
+  /// Object-space axis and cosine of the backface cone. Every triangle
+  /// faces away from a camera inside the cone behind cone_apex.
+  glm::vec4 cone_axis_cutoff{};
+  glm::vec3 cone_apex{};
+  /// Index into MeshData::meshes.
+  std::uint32_t mesh_index{ 0 };
+  /// First entry in MeshData::meshlet_vertices.
+  std::uint32_t vertex_offset{ 0 };
+  /// First byte in MeshData::meshlet_triangles; a multiple of four.
+  std::uint32_t triangle_offset{ 0 };
+  std::uint32_t vertex_count{ 0 };
+  std::uint32_t triangle_count{ 0 };
+};
+static_assert(sizeof(Meshlet) == 64, "Meshlet must match its std430 layout");
+
+/// What a material uses an imported texture for, which picks its block
+/// format: BC7 for colour, BC5 for normals and BC4 for single channels.
 enum class LoadedTextureType : std::uint8_t
 {
   Emissive,
@@ -48,6 +87,9 @@ enum class LoadedTextureType : std::uint8_t
   Normals,
   Height,
   Opacity,
+  Roughness,
+  Metalness,
+  AmbientOcclusion,
 };
 
 struct ProcessedTexture
@@ -75,36 +117,175 @@ struct MeshData final
 
   std::vector<Mesh> meshes{};
   std::vector<BoundingBox> aabbs{};
+  std::vector<Meshlet> meshlets{};
+  /// Vertex index, into vertex_data, of every meshlet vertex.
+  std::vector<std::uint32_t> meshlet_vertices{};
+  /// Three meshlet-local vertex indices per triangle.
+  std::vector<std::uint8_t> meshlet_triangles{};
   std::vector<Material> materials{};
   std::vector<ProcessedTexture> textures;
   std::vector<ProcessedTexture> opacity_textures;
 };
 
+/// One aiMesh converted on its own. Offsets and meshlet vertex indices are
+/// local to these buffers until append_converted_meshes places them.
+struct ConvertedMesh
+{
+  Mesh mesh{};
+  VertexInput vertex_streams{};
+  std::vector<std::uint8_t> vertex_data{};
+  std::vector<std::uint32_t> index_data{};
+  std::vector<Meshlet> meshlets{};
+  std::vector<std::uint32_t> meshlet_vertices{};
+  std::vector<std::uint8_t> meshlet_triangles{};
+};
+
+/// Builds the vertices, LODs and meshlets of one mesh. Independent of every
+/// other mesh, so a scene's meshes can convert in parallel.
+auto convert_assimp_mesh_to_mesh(const aiMesh&) -> ConvertedMesh;
+/// Appends converted, in scene order, after what output already holds. Each
+/// mesh's offsets are the running totals of everything before it, exactly
+/// as converting and appending one mesh at a time would produce. Leaves
+/// converted empty.
+auto append_converted_meshes(std::vector<ConvertedMesh>& converted,
+                             MeshData& output) -> void;
+
+/// MeshData as loaded from the cache: the arrays point into the mapped
+/// file and can be uploaded from there without another copy.
+struct MeshDataView final
+{
+  VertexInput vertex_streams{};
+
+  std::span<const IndexType> index_data{};
+  std::span<const std::uint8_t> vertex_data{};
+
+  std::span<const Mesh> meshes{};
+  std::span<const BoundingBox> aabbs{};
+  std::span<const Meshlet> meshlets{};
+  std::span<const std::uint32_t> meshlet_vertices{};
+  std::span<const std::uint8_t> meshlet_triangles{};
+  std::span<const Material> materials{};
+  std::vector<ProcessedTexture> textures;
+  std::vector<ProcessedTexture> opacity_textures;
+};
+
+enum class MeshFileSection : std::uint8_t
+{
+  VertexStreams,
+  Meshes,
+  BoundingBoxes,
+  IndexData,
+  VertexData,
+  Meshlets,
+  MeshletVertices,
+  MeshletTriangles,
+  Materials,
+  Textures,
+  Count,
+};
+
+struct MeshFileSectionRange
+{
+  std::uint64_t offset{ 0 };
+  std::uint64_t size{ 0 };
+};
+
+enum class MeshFileFlags : std::uint32_t
+{
+  None = 0,
+  Meshlets = 1 << 0,
+  Textures = 1 << 1,
+};
+MAKE_BIT_FIELD(MeshFileFlags)
+
 struct MeshFileHeader
 {
-  static constexpr auto magic_header = 0x46696E65U;
+  static constexpr auto magic_header = 0x46696E34U;
+  /// Bumped whenever the layout changes; other versions are rebuilt.
+  static constexpr std::uint32_t current_version = 3;
+  /// Every section starts at a multiple of this, which covers the
+  /// alignment of everything stored in them.
+  static constexpr std::uint64_t section_alignment = 64;
+  static constexpr auto section_count =
+    static_cast<std::size_t>(MeshFileSection::Count);
 
-  std::uint32_t magic_bytes = magic_header; // 'Fine' in ASCII.
+  std::uint32_t magic_bytes = magic_header; // 'Fin4' in ASCII.
+  std::uint32_t version{ current_version };
+  MeshFileFlags flags{ MeshFileFlags::None };
   std::uint32_t mesh_count{ 0 };
+  /// MeshFile::compute_source_hash of the asset this was imported from.
+  std::uint64_t source_hash{ 0 };
   std::size_t index_data_size{ 0 };
   std::size_t vertex_data_size{ 0 };
+  std::array<MeshFileSectionRange, section_count> sections{};
+
+  [[nodiscard]] auto section(const MeshFileSection which) const -> const auto&
+  {
+    return sections[static_cast<std::size_t>(which)];
+  }
+  [[nodiscard]] auto section(const MeshFileSection which) -> auto&
+  {
+    return sections[static_cast<std::size_t>(which)];
+  }
+};
+static_assert(sizeof(MeshFileHeader) == 200,
+              "MeshFileHeader is written as is and must not contain padding");
+
+/// How much time the importer spends compressing textures to BC7. Every
+/// preset encodes UASTC with Basis and transcodes it; they differ in the
+/// UASTC level and in whether rate-distortion optimisation runs.
+enum class TextureEncodePreset : std::uint8_t
+{
+  /// Fastest UASTC level, for iterating on assets.
+  Fast,
+  /// Default UASTC level.
+  Balanced,
+  /// Slowest UASTC level plus RDO, which makes the blocks compress better
+  /// in packaged builds at a small cost in quality.
+  Archival,
 };
 
+#ifndef TEXTURE_ENCODE_PRESET
+#define TEXTURE_ENCODE_PRESET Balanced
+#endif
+/// Set per build through the TEXTURE_ENCODE_PRESET CMake cache variable.
+constexpr auto default_texture_encode_preset =
+  TextureEncodePreset::TEXTURE_ENCODE_PRESET;
+
 class MeshFile
 {
   MeshFileHeader header;
-  MeshData mesh_data;
+  // Owns the memory mesh_data points into.
+  MappedFile mapping;
+  MeshDataView mesh_data;
 
 public:
   [[nodiscard]] auto get_header() const -> const auto& { return header; }
   [[nodiscard]] auto get_data() const -> const auto& { return mesh_data; }
   [[nodiscard]] auto get_data() -> auto& { return mesh_data; }
 
+  /// Maps a file written by preload_mesh. Only the textures are copied out
+  /// of the mapping, which the MeshFile keeps alive.
   static auto create(IContext&, const std::filesystem::path&)
     -> std::expected<MeshFile, std::string>;
-  static auto preload_mesh(const std::filesystem::path&,
-                           const std::filesystem::path& cache_directory = {
-                             "assets/.mesh_cache" }) -> bool;
+  /// Imports the asset at path into cache_directory, unless a cache of the
+  /// current version built from the same bytes and settings is there.
+  static auto preload_mesh(
+    const std::filesystem::path&,
+    const std::filesystem::path& cache_directory = { "assets/.mesh_cache" },
+    TextureEncodePreset preset = default_texture_encode_preset) -> bool;
+  /// Hash of the asset's bytes, of the files a glTF references and of
+  /// everything in the importer that shapes the cache.
+  static auto compute_source_hash(
+    const std::filesystem::path& source,
+    TextureEncodePreset preset = default_texture_encode_preset)
+    -> std::expected<std::uint64_t, std::string>;
+  /// Whether the cache at cache_path can be loaded in place of importing
+  /// source again with the same preset.
+  static auto is_cache_current(
+    const std::filesystem::path& source,
+    const std::filesystem::path& cache_path,
+    TextureEncodePreset preset = default_texture_encode_preset) -> bool;
 };
 
 class VkMesh final
@@ -118,12 +299,95 @@ class VkMesh final
   Holder<ShaderModuleHandle> shader;
   Holder<GraphicsPipelineHandle> pipeline;
 
+  // Only created when the device has mesh shaders and the file has
+  // meshlets and bounds; draw() then always uses them.
+  BufferHolder meshlet_buffer;
+  BufferHolder meshlet_vertex_buffer;
+  BufferHolder meshlet_triangle_buffer;
+  // The submesh and first meshlet each task workgroup culls.
+  BufferHolder task_group_buffer;
+  // The addresses of the buffers above, the vertices and the submeshes.
+  BufferHolder meshlet_geometry;
+  std::uint64_t meshlet_geometry_address{ 0 };
+  Holder<ShaderModuleHandle> mesh_shader;
+  Holder<GraphicsPipelineHandle> mesh_pipeline;
+  std::uint32_t task_group_count{ 0 };
+  // The pyramid the last cull() tested against, which the task shader
+  // tests each meshlet against too.
+  std::uint64_t pyramid_address{ 0 };
+  glm::uvec2 pyramid_size{};
+  std::uint32_t pyramid_level_count{ 0 };
+
+  // Per submesh bounds, LOD ranges and last chosen LOD for the culling
+  // pass; empty when the file lacks bounds, which disables culling.
+  BufferHolder submesh_buffer;
+  // Written by the culling pass, with the surviving count in front.
+  std::unique_ptr<IndirectBuffer> culled_commands;
+  Holder<ShaderModuleHandle> culling_shader;
+  Holder<ComputePipelineHandle> culling_pipeline;
+  bool is_culled{ false };
+  float lod_pixel_error{ 1.0F };
+
   std::uint32_t index_count{ 0 };
 
+  TextureStreamer* streamer{ nullptr };
+  // Indexed like MeshData::textures; only filled when streaming.
+  std::vector<TextureHandle> streamed_textures{};
+  // What materials holds, kept to patch the bindless indices of textures
+  // the streamer moves; only filled when streaming.
+  std::vector<GPUMaterial> streamed_materials{};
+  std::uint32_t streamer_listener{ 0 };
+
+  VkMesh(IContext&, const MeshFile&, TextureStreamer*);
+  auto create_meshlet_pipeline(IContext&, const MeshDataView&) -> void;
+  auto on_textures_moved(IContext&,
+                         std::span<const TextureStreamer::TextureMove>)
+    -> void;
+
 public:
   VkMesh(IContext&, const MeshFile&);
-  auto draw(ICommandBuffer&, const MeshFile&, std::span<const std::byte>)
+  /// Textures start with only their mip tail resident and are streamed in
+  /// by streamer, which has to outlive the mesh; see request_textures.
+  VkMesh(IContext&, const MeshFile&, TextureStreamer& streamer);
+  ~VkMesh();
+  // The streamer's listener points at the mesh.
+  VkMesh(const VkMesh&) = delete;
+  auto operator=(const VkMesh&) -> VkMesh& = delete;
+
+  /// Requests the mips each submesh's textures need at its projected size,
+  /// from the bounds of the submesh as seen from camera_position.
+  auto request_textures(const MeshFile&,
+                        const glm::mat4& model,
+                        const glm::vec3& camera_position,
+                        const glm::mat4& projection,
+                        float viewport_height) const -> void;
+  /// Records, outside of rendering, a compute pass that keeps the submeshes
+  /// inside the frustum and, once the pyramid is ready, not hidden behind
+  /// its depth, and picks each one's LOD. The next draw() only issues
+  /// those; pass get_culled_commands() as a buffer dependency of its
+  /// render pass. With mesh shaders, the task shader then draws the
+  /// meshlets of each kept submesh's LOD that pass the same tests.
+  auto cull(ICommandBuffer&,
+            IContext&,
+            const MeshFile&,
+            const DepthPyramid&,
+            const glm::mat4& model,
+            std::uint64_t ubo_address,
+            float viewport_height) -> void;
+  /// Screen-space error in pixels below which a coarser LOD is drawn.
+  auto set_lod_pixel_error(const float pixels) -> void
+  {
+    lod_pixel_error = pixels;
+  }
+  /// pc is pushed as is to the vertex pipeline. The mesh shader pipeline
+  /// appends the meshlet buffers and the culling state after it, so pc can
+  /// be at most 96 bytes.
+  auto draw(ICommandBuffer&, const MeshFile&, std::span<const std::byte> pc)
     -> void;
+  [[nodiscard]] auto get_culled_commands() const -> BufferHandle
+  {
+    return culled_commands ? culled_commands->get_buffer() : BufferHandle{};
+  }
   auto get_material_buffer_handle(const IContext&) const -> std::uint64_t;
   auto get_material_remap_buffer_handle(const IContext&) const -> std::uint64_t;
 };
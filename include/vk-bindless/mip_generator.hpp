@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace VkBindless {
+
+/// How the texels of a level are combined into the level below it.
+enum class MipContent : std::uint8_t
+{
+  /// Plain data, averaged as stored.
+  Linear,
+  /// sRGB-encoded colour, averaged in linear space. Alpha stays linear.
+  Srgb,
+  /// Tangent-space normals in RGB, renormalised after averaging.
+  NormalMap,
+};
+
+/// Extent of the next level down along one axis.
+constexpr auto
+mip_extent(const std::uint32_t size) -> std::uint32_t
+{
+  return size > 1 ? size >> 1 : 1;
+}
+
+/// Box-filters one tightly packed RGBA8 level into the next, which is
+/// mip_extent(width) by mip_extent(height) texels. Each destination texel
+/// averages a 2x2 block; the last column or row of an odd level is dropped,
+/// and a single column or row is averaged with itself.
+auto downsample_rgba8(std::span<const std::uint8_t> source,
+                      std::uint32_t width,
+                      std::uint32_t height,
+                      std::span<std::uint8_t> destination,
+                      MipContent content) -> void;
+
+} // namespace VkBindless
@@ -5,12 +5,14 @@
 #include "vk-bindless/holder.hpp"
 
 #include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstdint>
 
 #include <ranges>
 #include <string_view>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace VkBindless {
@@ -40,17 +42,29 @@ template<typename ObjectType, typename ImplObjectType>
 class Pool
 {
   static constexpr std::uint32_t list_end_sentinel = 0xffffffff;
+  static constexpr std::uint32_t occupancy_word_bits = 64;
+
+  static constexpr auto occupancy_bit(const std::uint32_t index)
+    -> std::uint64_t
+  {
+    return std::uint64_t{ 1 } << (index % occupancy_word_bits);
+  }
 
   struct PoolEntryMetadata
   {
     std::uint32_t generation{ 1 };
     std::uint32_t next_free{ list_end_sentinel };
+    bool dirty{ false };
   };
 
   std::uint32_t free_list_head = list_end_sentinel;
   std::vector<ImplObjectType> objects;
   std::vector<PoolEntryMetadata> metadata;
+  // One bit per slot, set while the slot holds a live object.
+  std::vector<std::uint64_t> occupancy;
   std::uint32_t num_objects = 0;
+  // Slots created or destroyed since the last consume_dirty_slots call.
+  std::vector<std::uint32_t> dirty_slots;
 
 public:
   [[nodiscard]]
@@ -65,7 +79,12 @@ public:
       index = static_cast<std::uint32_t>(objects.size());
       objects.emplace_back(std::move(impl));
       metadata.emplace_back();
+      if (index % occupancy_word_bits == 0) {
+        occupancy.push_back(0);
+      }
     }
+    occupancy[index / occupancy_word_bits] |= occupancy_bit(index);
+    mark_dirty(index);
     num_objects++;
     return Handle<ObjectType>(index, metadata[index].generation);
   }
@@ -95,6 +114,8 @@ public:
     ++data.generation;
     data.next_free = free_list_head;
     free_list_head = index;
+    occupancy[index / occupancy_word_bits] &= ~occupancy_bit(index);
+    mark_dirty(index);
     num_objects--;
     return {};
   }
@@ -144,15 +165,46 @@ public:
 
   [[nodiscard]] auto size() const -> std::uint32_t { return num_objects; }
   [[nodiscard]] auto empty() const -> bool { return num_objects == 0; }
+  [[nodiscard]] auto slot_count() const -> std::uint32_t
+  {
+    return static_cast<std::uint32_t>(objects.size());
+  }
 
   auto clear() -> void
   {
     free_list_head = list_end_sentinel;
     objects.clear();
     metadata.clear();
+    occupancy.clear();
+    dirty_slots.clear();
     num_objects = 0;
   }
 
+  auto mark_all_dirty() -> void
+  {
+    for (std::uint32_t i = 0; i < objects.size(); ++i) {
+      mark_dirty(i);
+    }
+  }
+
+  [[nodiscard]] auto has_dirty_slots() const -> bool
+  {
+    return !dirty_slots.empty();
+  }
+
+  /// Calls func(index, object) for every slot touched since the last call, in
+  /// ascending index order. object is nullptr for slots that are now free.
+  template<typename Func>
+  auto consume_dirty_slots(Func&& func) -> void
+  {
+    std::ranges::sort(dirty_slots);
+    for (const auto index : dirty_slots) {
+      metadata[index].dirty = false;
+      func(index, is_slot_valid(index) ? &objects[index] : nullptr);
+    }
+    dirty_slots.clear();
+  }
+
   [[nodiscard]]
   auto unsafe_handle(const std::uint32_t index) const -> Handle<ObjectType>
   {
@@ -185,7 +237,7 @@ public:
     assert(index < objects.size() && "Index out of bounds");
     return objects.at(index);
   }
-  auto at(const std::uint32_t index) const -> decltype(objects.at(0))
+  auto at(const std::uint32_t index) const -> const ImplObjectType&
   {
     assert(!objects.empty() && "Pool is empty");
     assert(index < objects.size() && "Index out of bounds");
@@ -195,27 +247,49 @@ public:
   template<typename Func>
   auto for_each_valid(Func&& func) const -> void
   {
-    for (std::uint32_t i = 0; i < objects.size(); ++i) {
-      if (is_slot_valid(i)) {
-        func(objects[i]);
+    for_each_valid_index(
+      [this, &func](const std::uint32_t index) { func(objects[index]); });
+  }
+
+  template<typename Func>
+  auto for_each_valid(Func&& func) -> void
+  {
+    for_each_valid_index(
+      [this, &func](const std::uint32_t index) { func(objects[index]); });
+  }
+
+  /// Visits live slot indices in ascending order, a word of the occupancy
+  /// bitset at a time, skipping empty words entirely.
+  template<typename Func>
+  auto for_each_valid_index(Func&& func) const -> void
+  {
+    for (std::uint32_t word_index = 0; word_index < occupancy.size();
+         ++word_index) {
+      auto word = occupancy[word_index];
+      while (word != 0) {
+        const auto bit = static_cast<std::uint32_t>(std::countr_zero(word));
+        func(word_index * occupancy_word_bits + bit);
+        word &= word - 1;
       }
     }
   }
 
 private:
+  auto mark_dirty(const std::uint32_t index) -> void
+  {
+    if (!metadata[index].dirty) {
+      metadata[index].dirty = true;
+      dirty_slots.push_back(index);
+    }
+  }
+
   auto is_slot_valid(std::uint32_t index) const -> bool
   {
     if (index >= objects.size())
       return false;
 
-    std::uint32_t current = free_list_head;
-    while (current != list_end_sentinel) {
-      if (current == index) {
-        return false;
-      }
-      current = metadata[current].next_free;
-    }
-    return true;
+    return (occupancy[index / occupancy_word_bits] & occupancy_bit(index)) !=
+           0;
   }
 };
 
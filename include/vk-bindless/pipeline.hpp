@@ -8,12 +8,33 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <span>
+#include <string>
 
 namespace VkBindless {
 
+/// Output of a pipeline built off the render thread. The worker fills in
+/// everything else and then sets ready, which is the only field that may be
+/// read before the build has finished.
+struct PipelineBuildResult
+{
+  VkPipeline pipeline{ VK_NULL_HANDLE };
+  VkPipelineLayout layout{ VK_NULL_HANDLE };
+  VkDescriptorSetLayout descriptor_set_layout{ VK_NULL_HANDLE };
+  std::uint32_t view_mask{ 0 };
+  double milliseconds{ 0.0 };
+  std::atomic<bool> ready{ false };
+};
+
+struct PipelineCompileTime
+{
+  std::string debug_name{};
+  double milliseconds{ 0.0 };
+};
+
 namespace detail {
 template<typename Derived, typename DescriptionType>
 class VkPipelineBase
@@ -30,6 +51,10 @@ protected:
 
   std::unique_ptr<std::byte[]> specialisation_constants_storage{ nullptr };
 
+  // In-flight asynchronous build. Until it is ready, pipeline and layout
+  // still describe the last pipeline that was built, if any.
+  std::shared_ptr<PipelineBuildResult> pending_build{ nullptr };
+
 public:
   [[nodiscard]] auto get_layout() const -> const VkPipelineLayout&
   {
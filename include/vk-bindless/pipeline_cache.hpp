@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vk-bindless/expected.hpp"
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace VkBindless {
+
+struct PipelineCacheError
+{
+  std::string message;
+};
+
+/// Everything a serialised VkPipelineCache is only valid for. A blob written
+/// on another GPU, vendor or driver build is rejected before it reaches the
+/// driver.
+struct PipelineCacheIdentity
+{
+  std::uint32_t vendor_id{ 0 };
+  std::uint32_t device_id{ 0 };
+  std::uint32_t driver_version{ 0 };
+  std::array<std::uint8_t, VK_UUID_SIZE> driver_uuid{};
+  std::array<std::uint8_t, VK_UUID_SIZE> pipeline_cache_uuid{};
+
+  static auto from(const VkPhysicalDeviceProperties&,
+                   const VkPhysicalDeviceVulkan11Properties&)
+    -> PipelineCacheIdentity;
+
+  auto operator==(const PipelineCacheIdentity&) const -> bool = default;
+};
+
+/// Wraps a VkPipelineCache payload in a header carrying the identity and a
+/// checksum of the payload.
+auto
+serialise_pipeline_cache_blob(std::span<const std::uint8_t> payload,
+                              const PipelineCacheIdentity&)
+  -> std::vector<std::uint8_t>;
+
+/// Returns the VkPipelineCache payload inside blob if the wrapper header,
+/// the checksum and the driver's own VkPipelineCacheHeaderVersionOne all
+/// match identity.
+auto
+validate_pipeline_cache_blob(std::span<const std::uint8_t> blob,
+                             const PipelineCacheIdentity&)
+  -> Expected<std::span<const std::uint8_t>, PipelineCacheError>;
+
+class PipelineCache
+{
+public:
+  static constexpr auto default_path = "assets/.pipeline_cache/pipelines.bin";
+
+  PipelineCache() = default;
+  ~PipelineCache();
+  PipelineCache(const PipelineCache&) = delete;
+  auto operator=(const PipelineCache&) -> PipelineCache& = delete;
+  PipelineCache(PipelineCache&&) noexcept;
+  auto operator=(PipelineCache&&) noexcept -> PipelineCache&;
+
+  /// Warm-starts from path when its contents match identity, otherwise
+  /// starts empty. Only fails if the VkPipelineCache can not be created.
+  static auto create(VkDevice,
+                     const PipelineCacheIdentity&,
+                     std::filesystem::path path = default_path)
+    -> Expected<PipelineCache, PipelineCacheError>;
+
+  /// Writes the current cache contents next to path and renames over it,
+  /// so a crash mid-write never leaves a truncated cache behind.
+  auto save() const -> Expected<void, PipelineCacheError>;
+
+  [[nodiscard]] auto get() const -> VkPipelineCache { return cache; }
+  [[nodiscard]] auto get_loaded_bytes() const -> std::size_t
+  {
+    return loaded_bytes;
+  }
+
+private:
+  VkDevice device{ VK_NULL_HANDLE };
+  VkPipelineCache cache{ VK_NULL_HANDLE };
+  PipelineCacheIdentity identity{};
+  std::filesystem::path path{};
+  std::size_t loaded_bytes{ 0 };
+};
+
+} // namespace VkBindless
@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <filesystem>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -16,6 +17,8 @@
 
 namespace VkBindless {
 
+struct CachedShaderStage;
+
 inline auto
 to_vk_stage(const ShaderStage stage) -> VkShaderStageFlagBits
 {
@@ -88,6 +91,11 @@ public:
 
   static auto create(IContext* context, const std::filesystem::path& path)
     -> Expected<Holder<ShaderModuleHandle>, ShaderError>;
+  /// Compiles every stage of every shader in parallel and returns one
+  /// result per path, in the same order.
+  static auto create_many(IContext* context,
+                          std::span<const std::filesystem::path> paths)
+    -> std::vector<Expected<Holder<ShaderModuleHandle>, ShaderError>>;
 
   [[nodiscard]] auto get_modules() const -> const auto& { return modules; }
 
@@ -130,6 +138,12 @@ private:
 
   static auto compile(IContext* device, const std::filesystem::path& path)
     -> Expected<VkShader, ShaderError>;
+  static auto from_stages(IContext*,
+                          const ParsedShader&,
+                          std::span<const CachedShaderStage>)
+    -> Expected<VkShader, ShaderError>;
+  static auto add_to_pool(IContext*, VkShader&&)
+    -> Expected<Holder<ShaderModuleHandle>, ShaderError>;
 
   void move_from(VkShader&& other)
   {
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "vk-bindless/expected.hpp"
+#include "vk-bindless/shader_compilation.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace VkBindless {
+
+struct ShaderCacheError
+{
+  std::string message;
+};
+
+/// An #include resolved the same way glslang resolves it during
+/// compilation.
+struct ResolvedInclude
+{
+  std::string name;
+  std::string contents;
+};
+
+/// What VkShader needs from one compiled stage: the SPIR-V and the
+/// reflected push constant block, so a cache hit skips reflection as well.
+struct CachedShaderStage
+{
+  std::vector<std::uint8_t> spirv{};
+  std::uint32_t push_constant_size{ 0 };
+  bool has_push_constants{ false };
+
+  auto operator==(const CachedShaderStage&) const -> bool = default;
+};
+
+/// Content address of a stage. source must already carry the preamble;
+/// compile_options fingerprints every setting that changes the SPIR-V.
+auto
+shader_cache_key(ShaderStage,
+                 std::string_view entry_name,
+                 std::string_view source,
+                 std::span<const ResolvedInclude> includes,
+                 std::uint64_t compile_options) -> std::uint64_t;
+
+auto
+serialise_shader_cache_entry(std::uint64_t key, const CachedShaderStage&)
+  -> std::vector<std::uint8_t>;
+
+/// Rejects entries written for another key, by another format version, or
+/// that were truncated or corrupted on disk.
+auto
+parse_shader_cache_entry(std::span<const std::uint8_t> bytes, std::uint64_t key)
+  -> Expected<CachedShaderStage, ShaderCacheError>;
+
+/// One file per key under directory. Safe to use from several threads: each
+/// entry is written to a unique temporary file and renamed into place.
+class ShaderCache
+{
+public:
+  static constexpr auto default_directory = "assets/.shader_cache";
+
+  explicit ShaderCache(std::filesystem::path directory = default_directory)
+    : directory(std::move(directory))
+  {
+  }
+
+  [[nodiscard]] auto load(std::uint64_t key) const
+    -> Expected<CachedShaderStage, ShaderCacheError>;
+  auto store(std::uint64_t key, const CachedShaderStage&) const
+    -> Expected<void, ShaderCacheError>;
+
+private:
+  [[nodiscard]] auto path_for(std::uint64_t key) const -> std::filesystem::path;
+
+  std::filesystem::path directory;
+};
+
+} // namespace VkBindless
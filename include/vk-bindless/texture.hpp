@@ -161,9 +161,11 @@ public:
                         std::span<const float> data) -> bool;
 
 private:
+  // Hot: read for every live texture by the descriptor rebuild and the
+  // render pass setup, kept together at the front of the object.
+  VkImage image{ VK_NULL_HANDLE };
   VkImageView image_view{ VK_NULL_HANDLE };
   VkImageView storage_image_view{ VK_NULL_HANDLE };
-  VkSampler sampler{ VK_NULL_HANDLE };
   VkImageLayout current_layout{ VK_IMAGE_LAYOUT_UNDEFINED };
   VkSampleCountFlagBits sample_count{ VK_SAMPLE_COUNT_1_BIT };
   VkImageAspectFlags image_aspect_flags{ VK_IMAGE_ASPECT_COLOR_BIT };
@@ -171,20 +173,20 @@ private:
   Format format{ Format::Invalid };
   bool image_owns_itself{ true };
   bool is_swapchain{ false };
+  bool sampled{ false };
+  bool storage{ false };
+  bool is_depth{ false };
   std::uint32_t mip_levels{ 1 };
   std::uint32_t array_layers{ 0 };
 
+  // Cold: only touched on creation, destruction and attachment lookups.
+  VkSampler sampler{ VK_NULL_HANDLE };
   std::vector<VkImageView> mip_layer_views;
-
   AllocationInfo image_allocation{};
-  VkImage image{ VK_NULL_HANDLE };
-
-  std::array<VkImageView, max_mip_levels * cube_array_layers>
-    cached_framebuffer_views{};
 
-  bool sampled{ false };
-  bool storage{ false };
-  bool is_depth{ false };
+  // Sized to max_mip_levels * cube_array_layers on first use, so textures
+  // that are never attachments do not carry the array inline.
+  std::vector<VkImageView> cached_framebuffer_views{};
 
   std::string debug_name{};
   auto create_internal_image(IContext&, const VkTextureDescription&) -> void;
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "vk-bindless/common.hpp"
+#include "vk-bindless/forward.hpp"
+#include "vk-bindless/handle.hpp"
+#include "vk-bindless/holder.hpp"
+#include "vk-bindless/thread_pool.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <ktx.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace VkBindless {
+
+struct TextureStreamerSettings
+{
+  /// Staging bytes update() may spend per frame. At least one texture is
+  /// made resident per frame, so a single texture larger than the budget
+  /// still streams in.
+  std::uint64_t bytes_per_frame{ 32ULL * 1024ULL * 1024ULL };
+  /// Mips no larger than this along either axis form the tail, which is
+  /// uploaded by add() and always resident.
+  std::uint32_t resident_tail_extent{ 128 };
+  /// Textures being read on the loader thread at once.
+  std::uint32_t max_in_flight{ 4 };
+};
+
+/// Creates textures with only their mip tail resident and streams the
+/// higher mips in as they are requested. Mips are read out of the source
+/// KTX on a loader thread and uploaded through the staging allocator by
+/// update(), most wanted first.
+///
+/// Making more mips resident creates a larger image in a new pool slot, so
+/// a streamed texture's handle, and its bindless index, changes as it
+/// sharpens. Listeners are told about every move while the old slot is
+/// still alive, and rewrite the indices they stored with queue-ordered
+/// uploads. The old slot is released once the last frame that could read
+/// it has retired. Resident mips are never dropped again.
+class TextureStreamer
+{
+public:
+  struct TextureMove
+  {
+    TextureHandle from{};
+    TextureHandle to{};
+  };
+  using TexturesMovedCallback =
+    std::function<void(std::span<const TextureMove>)>;
+
+  explicit TextureStreamer(IContext&, TextureStreamerSettings = {});
+  ~TextureStreamer();
+  TextureStreamer(const TextureStreamer&) = delete;
+  auto operator=(const TextureStreamer&) -> TextureStreamer& = delete;
+
+  /// source has to outlive the streamer. Uploads the mip tail right away;
+  /// the streamer owns the returned texture.
+  auto add(ktxTexture2* source, Format, std::string_view debug_name)
+    -> TextureHandle;
+
+  /// Asks for the texture to be sharp when it covers about projected_pixels
+  /// along its longest axis on screen. Larger coverage wins when the same
+  /// texture is requested several times in a frame, and streams in first.
+  auto request(TextureHandle, float projected_pixels) -> void;
+
+  /// Call once per frame: uploads what the loader finished, within the
+  /// budget, then hands the most wanted requests to the loader.
+  auto update() -> void;
+
+  /// Called from update() with the textures that moved to a new handle.
+  /// The id is for remove_listener.
+  auto add_listener(TexturesMovedCallback) -> std::uint32_t;
+  auto remove_listener(std::uint32_t id) -> void;
+
+  /// The largest mip currently resident; 0 once fully streamed.
+  [[nodiscard]] auto resident_mip(TextureHandle) const -> std::uint32_t;
+  [[nodiscard]] auto pending_count() const -> std::size_t
+  {
+    return in_flight.size() + ready.size();
+  }
+
+private:
+  struct StreamedTexture
+  {
+    Holder<TextureHandle> texture{};
+    ktxTexture2* source{ nullptr };
+    Format format{ Format::Invalid };
+    std::string debug_name{};
+    std::uint32_t mip_count{ 1 };
+    std::uint32_t resident_mip{ 0 };
+    // Reset every update(): the sharpest mip and largest coverage asked for
+    // since the previous one.
+    std::uint32_t wanted_mip{ 0 };
+    float priority{ 0.0F };
+    bool loading{ false };
+  };
+
+  // Mips first_mip and up, packed for one staging upload.
+  struct PreparedMips
+  {
+    std::size_t texture{ 0 };
+    std::uint32_t first_mip{ 0 };
+    std::vector<std::uint8_t> data{};
+    std::vector<VkBufferImageCopy> copies{};
+  };
+
+  static auto prepare(std::size_t texture,
+                      ktxTexture2* source,
+                      std::uint32_t first_mip) -> PreparedMips;
+  /// Returns the image the new one replaced, if any.
+  auto make_resident(PreparedMips&&) -> Holder<TextureHandle>;
+
+  IContext& context;
+  TextureStreamerSettings settings;
+  std::vector<StreamedTexture> textures{};
+  std::unordered_map<std::uint32_t, std::size_t> texture_slots{};
+  std::vector<std::future<PreparedMips>> in_flight{};
+  std::deque<PreparedMips> ready{};
+  std::vector<std::pair<std::uint32_t, TexturesMovedCallback>> listeners{};
+  std::uint32_t next_listener_id{ 0 };
+  // Last, so it finishes its jobs before anything they read is destroyed.
+  ThreadPool loader{ 1 };
+};
+
+} // namespace VkBindless
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace VkBindless {
+
+/// Fixed set of worker threads draining a FIFO of jobs. Jobs still queued
+/// when the pool is destroyed are run before the workers exit, so anything
+/// a job owns is always released.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(std::uint32_t thread_count = default_thread_count());
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+  /// One thread per hardware thread, minus one for the caller.
+  static auto default_thread_count() -> std::uint32_t;
+
+  template<typename Func>
+  auto submit(Func&& func) -> std::future<std::invoke_result_t<Func>>
+  {
+    using Result = std::invoke_result_t<Func>;
+    auto task =
+      std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+    auto future = task->get_future();
+    enqueue([task = std::move(task)] { (*task)(); });
+    return future;
+  }
+
+  /// Blocks until the queue is empty and no job is running.
+  auto wait_idle() -> void;
+
+  [[nodiscard]] auto thread_count() const -> std::uint32_t
+  {
+    return static_cast<std::uint32_t>(workers.size());
+  }
+
+private:
+  auto enqueue(std::function<void()>&& job) -> void;
+  auto run(const std::stop_token& stop) -> void;
+
+  std::mutex mutex;
+  std::condition_variable_any work_available;
+  std::condition_variable idle;
+  std::deque<std::function<void()>> jobs{};
+  std::uint32_t running{ 0 };
+  std::vector<std::jthread> workers{};
+};
+
+} // namespace VkBindless
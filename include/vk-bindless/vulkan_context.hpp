@@ -7,10 +7,14 @@
 #include "vk-bindless/graphics_context.hpp"
 #include "vk-bindless/handle.hpp"
 #include "vk-bindless/object_pool.hpp"
+#include "vk-bindless/pipeline_cache.hpp"
 #include "vk-bindless/swapchain.hpp"
 #include "vk-bindless/texture.hpp"
+#include "vk-bindless/thread_pool.hpp"
 #include "vk-bindless/types.hpp"
 
+#include <array>
+#include <deque>
 #include <functional>
 #include <memory>
 
@@ -28,7 +32,7 @@ class StagingAllocator final
 {
 public:
   explicit StagingAllocator(IContext& ctx);
-  ~StagingAllocator() = default;
+  ~StagingAllocator();
 
   StagingAllocator(const StagingAllocator&) = delete;
   StagingAllocator& operator=(const StagingAllocator&) = delete;
@@ -59,6 +63,14 @@ public:
                         std::uint32_t height,
                         std::uint32_t mips,
                         std::uint32_t layer_count) -> void;
+
+  /// Uploads made until the matching end_batch are recorded into one
+  /// command buffer per queue and submitted once, with their barriers
+  /// merged, so upload each resource at most once per batch. Batches nest;
+  /// only the outermost end_batch submits. The handle can be passed to
+  /// IContext::wait_for.
+  auto begin_batch() -> void;
+  auto end_batch() -> SubmitHandle;
   /*void imageData3D(VkTexture& image, const VkOffset3D& offset, const
   VkExtent3D& extent, VkFormat format, const void* data); void
   getImageData(VkTexture& image, const VkOffset3D& offset, const VkExtent3D&
@@ -67,16 +79,76 @@ public:
 private:
   static constexpr auto staging_buffer_alignment = 16;
 
+  // Uploads go to the dedicated transfer queue when the device has one, so
+  // the copies run alongside rendering. Resources change owner afterwards:
+  // the transfer queue releases them and the graphics queue acquires them
+  // once the transfer upload timeline says the copy has landed.
+  enum class UploadQueue : std::uint8_t
+  {
+    Graphics,
+    Transfer,
+  };
+
   struct MemoryRegionDescription
   {
     std::uint64_t offset = 0;
     std::uint64_t size = 0;
-    SubmitHandle handle = {};
   };
 
-  auto get_next_free_offset(std::uint32_t) -> MemoryRegionDescription;
+  // The staging buffer is a ring: allocations are carved out at head and
+  // retired from tail, oldest first, once the upload timeline of the queue
+  // that copies from them reaches their value.
+  struct InFlightRegion
+  {
+    std::uint64_t offset = 0;
+    UploadQueue queue = UploadQueue::Graphics;
+    std::uint64_t value = 0;
+  };
+  // Signalled by every upload submission on one queue.
+  struct UploadTimeline
+  {
+    VkSemaphore semaphore{ VK_NULL_HANDLE };
+    std::uint64_t submitted{ 0 };
+    std::uint64_t completed{ 0 };
+  };
+
+  /// At most the staging buffer's size; only smaller than size when size
+  /// does not fit at all. Blocks on the oldest upload while the ring is full.
+  auto allocate(std::uint64_t size, UploadQueue) -> MemoryRegionDescription;
+  auto retire() -> void;
+  auto wait_for_oldest() -> void;
   auto ensure_size(std::uint32_t) -> void;
-  auto wait_and_reset() -> void;
+
+  /// Transfer if available. Images that already hold contents stay on the
+  /// graphics queue, which owns them.
+  [[nodiscard]] auto upload_queue(
+    VkImageLayout old_layout = VK_IMAGE_LAYOUT_UNDEFINED) const -> UploadQueue;
+  /// Transfer submissions do not wait for frames in flight, so buffers that
+  /// were uploaded before are rewritten on the graphics queue.
+  [[nodiscard]] auto upload_queue(const VkDataBuffer&) const -> UploadQueue;
+  [[nodiscard]] auto commands_for(UploadQueue) const -> ImmediateCommands&;
+
+  // Uploads recorded on one queue but not submitted yet.
+  struct PendingUploads
+  {
+    const CommandBufferWrapper* wrapper{ nullptr };
+    std::vector<VkBufferMemoryBarrier2> buffer_barriers{};
+    std::vector<VkImageMemoryBarrier2> image_barriers{};
+    // Transfer queue only: the graphics-side halves of the barriers above.
+    std::vector<VkBufferMemoryBarrier2> buffer_acquires{};
+    std::vector<VkImageMemoryBarrier2> image_acquires{};
+  };
+
+  /// The command buffer uploads to queue are recorded into.
+  auto begin_upload(UploadQueue) -> const CommandBufferWrapper&;
+  /// Queues the barrier that publishes an upload; on the transfer queue it
+  /// is split into a release and a graphics-side acquire.
+  auto make_visible(VkBufferMemoryBarrier2, UploadQueue) -> void;
+  auto make_visible(VkImageMemoryBarrier2, UploadQueue) -> void;
+  /// Submits right away unless a batch is open.
+  auto finish_upload(UploadQueue) -> void;
+  auto flush() -> SubmitHandle;
+  auto flush(UploadQueue) -> SubmitHandle;
 
   Context& context;
   Holder<BufferHandle> staging_buffer;
@@ -85,7 +157,12 @@ private:
   // the staging buffer grows from minBufferSize up to maxBufferSize as needed
   VkDeviceSize max_buffer_size = 0;
   VkDeviceSize min_buffer_size = 4ULL * 2048ULL * 2048ULL;
-  std::vector<MemoryRegionDescription> regions{};
+  std::uint64_t head{ 0 };
+  std::uint64_t tail{ 0 };
+  std::deque<InFlightRegion> in_flight{};
+  std::array<UploadTimeline, 2> timelines{};
+  std::array<PendingUploads, 2> pending{};
+  std::uint32_t batch_depth{ 0 };
 };
 
 class Context final : public IContext
@@ -126,7 +203,10 @@ public:
   auto update_resource_bindings() -> void override;
   auto pre_frame_task(PreFrameCallback&& callback) -> void override
   {
-    pre_frame_callbacks.push_back(std::move(callback));
+    pre_frame_callbacks.push_back(DeferredTask{
+      .callback = std::move(callback),
+      .handle = last_referencing_submit(),
+    });
   }
   auto get_allocator_implementation() -> IAllocator& override;
 
@@ -172,6 +252,10 @@ public:
   {
     return use_staging_system;
   }
+  [[nodiscard]] auto supports_mesh_shaders() const -> bool override
+  {
+    return has_mesh_shaders;
+  }
   auto wait_for(const SubmitHandle value) -> void override
   {
     immediate_commands->wait(value);
@@ -197,8 +281,18 @@ public:
                             0,
                             nullptr);
   }
+  /// In async mode these return the previous pipeline, or VK_NULL_HANDLE if
+  /// there is none yet, while a new one is compiled in the background.
   auto get_pipeline(GraphicsPipelineHandle, std::uint32_t) -> VkPipeline;
   auto get_pipeline(ComputePipelineHandle) -> VkPipeline;
+  auto begin_upload_batch() -> void override;
+  auto end_upload_batch() -> SubmitHandle override;
+  auto set_async_pipeline_compilation(bool) -> void override;
+  auto prewarm(std::span<const GraphicsPipelineHandle>,
+               std::span<const std::uint32_t> view_masks)
+    -> std::vector<PipelineCompileTime> override;
+  auto prewarm(std::span<const ComputePipelineHandle>)
+    -> std::vector<PipelineCompileTime> override;
 
 private:
   vkb::Instance vkb_instance{};
@@ -238,6 +332,8 @@ private:
   Handle<Sampler> dummy_sampler;
 
   std::unique_ptr<ImmediateCommands> immediate_commands{ nullptr };
+  // Only created when transfer_queue_family differs from the graphics one.
+  std::unique_ptr<ImmediateCommands> transfer_commands{ nullptr };
   bool is_headless{ false };
   CommandBuffer command_buffer{};
   Unique<IAllocator> allocator_impl{ nullptr, default_deleter<IAllocator> };
@@ -256,18 +352,105 @@ private:
   };
   VulkanProperties vulkan_properties{};
   bool has_swapchain_maintenance_1{ false };
+  bool has_mesh_shaders{ false };
+  // Extension entry point, loaded for this device when it has mesh shaders.
+  PFN_vkCmdDrawMeshTasksEXT cmd_draw_mesh_tasks{ nullptr };
+
+  PipelineCache pipeline_cache{};
+  std::uint32_t pipelines_built{ 0 };
+  double pipeline_build_ms{ 0.0 };
+  auto record_pipeline_build(const double milliseconds) -> void
+  {
+    pipeline_build_ms += milliseconds;
+    ++pipelines_built;
+  }
 
-  std::deque<PreFrameCallback> pre_frame_callbacks{};
+  // Pipeline builds are split into a snapshot taken on the render thread
+  // (prepare_build) and the Vulkan calls (build_pipeline), which only read
+  // the snapshot and can therefore run on pipeline_workers.
+  struct GraphicsPipelineBuild;
+  struct ComputePipelineBuild;
+  bool async_pipeline_compilation{ false };
+  std::unique_ptr<ThreadPool> pipeline_workers{ nullptr };
+  // Builds whose pipeline was rebuilt or destroyed before they finished.
+  std::vector<std::shared_ptr<PipelineBuildResult>> abandoned_pipeline_builds{};
+  // Every build started on pipeline_workers that may not have finished yet.
+  std::vector<std::shared_ptr<PipelineBuildResult>> running_pipeline_builds{};
+  // Destroyed shader modules that builds still running may be reading. They
+  // are freed once those builds are ready and the submission has retired.
+  struct RetiredShaderModule
+  {
+    VkShaderModule module{ VK_NULL_HANDLE };
+    SubmitHandle handle{};
+    std::vector<std::shared_ptr<PipelineBuildResult>> builds{};
+  };
+  std::vector<RetiredShaderModule> retired_shader_modules{};
+
+  auto prepare_build(const VkGraphicsPipeline&, std::uint32_t view_mask) const
+    -> GraphicsPipelineBuild;
+  auto prepare_build(const VkComputePipeline&, std::uint32_t view_mask) const
+    -> ComputePipelineBuild;
+  static auto build_pipeline(const GraphicsPipelineBuild&,
+                             PipelineBuildResult&) -> void;
+  static auto build_pipeline(const ComputePipelineBuild&, PipelineBuildResult&)
+    -> void;
+  auto get_pipeline_workers() -> ThreadPool&;
+  template<typename PipelineType>
+  auto resolve_pipeline(PipelineType&, std::uint32_t view_mask) -> VkPipeline;
+  template<typename PipelineType>
+  auto prewarm_pipelines(std::span<PipelineType*>,
+                         std::span<const std::uint32_t> view_masks)
+    -> std::vector<PipelineCompileTime>;
+  template<typename PipelineType>
+  auto start_build(PipelineType&, std::uint32_t view_mask) -> void;
+  template<typename PipelineType>
+  auto install_pipeline(PipelineType&, const PipelineBuildResult&) -> void;
+  template<typename PipelineType>
+  auto retire_pipeline(PipelineType&) -> void;
+  template<typename PipelineType>
+  auto abandon_build(PipelineType&) -> void;
+  auto destroy_build_result(const PipelineBuildResult&) const -> void;
+  auto reap_abandoned_pipeline_builds() -> void;
+  auto reap_retired_shader_modules() -> void;
+
+  // Deferred destruction: each task remembers the newest submission that
+  // could still reference what it frees and only runs once that retires.
+  // Submissions on immediate_commands are chained through semaphores, so
+  // they retire in order and the queue can be drained from the front.
+  struct DeferredTask
+  {
+    PreFrameCallback callback;
+    SubmitHandle handle{};
+  };
+  std::deque<DeferredTask> pre_frame_callbacks{};
+  auto last_referencing_submit() const -> SubmitHandle
+  {
+    if (command_buffer.wrapper != nullptr) {
+      return command_buffer.wrapper->handle;
+    }
+    return immediate_commands ? immediate_commands->get_last_submit_handle()
+                              : SubmitHandle{};
+  }
   auto process_callbacks() -> void
+  {
+    while (!pre_frame_callbacks.empty() &&
+           immediate_commands->is_ready(pre_frame_callbacks.front().handle)) {
+      auto task = std::move(pre_frame_callbacks.front());
+      pre_frame_callbacks.pop_front();
+      task.callback(*this);
+    }
+  }
+  // Only valid once the device is idle.
+  auto flush_callbacks() -> void
   {
     while (!pre_frame_callbacks.empty()) {
-      auto callback = std::move(pre_frame_callbacks.front());
+      auto task = std::move(pre_frame_callbacks.front());
       pre_frame_callbacks.pop_front();
-      callback(*this);
+      task.callback(*this);
     }
   }
 
-  static auto get_dsl_binding(std::uint32_t, VkDescriptorType, uint32_t)
+  auto get_dsl_binding(std::uint32_t, VkDescriptorType, uint32_t) const
     -> VkDescriptorSetLayoutBinding;
   auto grow_descriptor_pool(std::uint32_t textures, std::uint32_t samplers)
     -> Expected<void, ContextError>;
@@ -283,6 +466,8 @@ private:
   friend class CommandBuffer;
   friend class StagingAllocator;
   friend class VkTexture;
+  friend class VkDataBuffer;
+  friend class TextureStreamer;
 };
 
 } // namespace VkBindless
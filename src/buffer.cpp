@@ -14,9 +14,11 @@ static constexpr auto storage_type_to_vk_memory_property_flags =
 
   switch (storage) {
     case StorageType::DeviceLocal:
+    case StorageType::DeviceOnly:
       memory_flags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
       break;
     case StorageType::HostVisible:
+    case StorageType::Staging:
       memory_flags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
       break;
@@ -49,13 +51,19 @@ VkDataBuffer::create(IContext& context, const BufferDescription& c)
   }
 
   auto storage = desc.storage;
-  if (!context.use_staging() && (desc.storage == StorageType::DeviceLocal)) {
+  if (!context.use_staging() && (desc.storage == StorageType::DeviceLocal ||
+                                 desc.storage == StorageType::DeviceOnly)) {
     storage = StorageType::HostVisible;
   }
-  VkBufferUsageFlags usage_flags =
-    storage == StorageType::DeviceLocal
-      ? VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
-      : 0;
+  VkBufferUsageFlags usage_flags = 0;
+  if (storage == StorageType::DeviceLocal ||
+      storage == StorageType::DeviceOnly) {
+    usage_flags |=
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  }
+  if (storage == StorageType::Staging) {
+    usage_flags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  }
 
   assert(desc.usage != BufferUsageFlags{ 0 });
 
@@ -79,7 +87,6 @@ VkDataBuffer::create(IContext& context, const BufferDescription& c)
   VkDataBuffer buffer{};
   buffer.size = desc.size;
   buffer.usage_flags = usage_flags;
-  buffer.memory_flags = memory_flags;
 
   AllocationCreateInfo allocation_create_info{
     .usage = MemoryUsage::AutoPreferDevice,
@@ -88,7 +95,23 @@ VkDataBuffer::create(IContext& context, const BufferDescription& c)
     .required_memory_bits = 0,
     .debug_name = std::string{ desc.debug_name },
   };
-  if (memory_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+  if (storage == StorageType::DeviceLocal) {
+    // Only ever written front to back, so write-combined memory is fine.
+    // Device-local host-visible memory (ReBAR) is mapped and written in
+    // place; without it the allocation stays device-local and unmapped.
+    allocation_create_info.host_access = HostAccess::SequentialWrite;
+    allocation_create_info.allow_transfer_instead = true;
+  } else if (storage == StorageType::DeviceOnly) {
+    allocation_create_info.map_memory = false;
+  } else if (storage == StorageType::Staging) {
+    // Write-combined system memory: the GPU reads it once per copy and the
+    // host never reads it back.
+    allocation_create_info.usage = MemoryUsage::AutoPreferHost;
+    allocation_create_info.host_access = HostAccess::SequentialWrite;
+    allocation_create_info.required_memory_bits =
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  } else if (memory_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
     allocation_create_info.map_memory = true;
     allocation_create_info.preferred_memory_bits =
       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
@@ -111,8 +134,18 @@ VkDataBuffer::create(IContext& context, const BufferDescription& c)
 
   buffer.buffer = buf;
   buffer.allocation = allocation;
+  buffer.memory_flags = allocation.memory_properties;
   if (!desc.data.empty()) {
-    buffer.upload(desc.data);
+    if (buffer.is_mapped()) {
+      buffer.upload(desc.data);
+      if (!(buffer.memory_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        buffer.flush_mapped_memory(context);
+      }
+      buffer.set_initialised();
+    } else {
+      dynamic_cast<Context&>(context).staging_allocator->upload(
+        buffer, 0, desc.data.size_bytes(), desc.data.data());
+    }
   }
 
   assert(!desc.debug_name.empty());
@@ -129,6 +162,15 @@ VkDataBuffer::create(IContext& context, const BufferDescription& c)
   };
 }
 
+auto
+VkDataBuffer::write(IContext& context,
+                    const std::span<const std::byte> data,
+                    const std::uint64_t offset) -> void
+{
+  dynamic_cast<Context&>(context).staging_allocator->upload(
+    *this, offset, data.size_bytes(), data.data());
+}
+
 auto
 VkDataBuffer::flush_mapped_memory(IContext& context,
                                   std::uint64_t offset,
@@ -160,7 +202,8 @@ IndirectBuffer::IndirectBuffer(IContext& ctx,
   const BufferDescription description{
     .size = sizeof(std::uint32_t) + std::span(draw_commands).size_bytes(),
     .storage = type,
-    .usage = BufferUsageFlags::IndirectBuffer | BufferUsageFlags::StorageBuffer,
+    .usage = BufferUsageFlags::IndirectBuffer |
+             BufferUsageFlags::StorageBuffer | BufferUsageFlags::TransferDst,
     .debug_name = "Indirect Buffer",
   };
   indirect_buffer = VkDataBuffer::create(ctx, description);
@@ -108,6 +108,60 @@ static constexpr auto store_op_to_vk_attachment_store_op =
   }
 };
 
+auto
+memory_barrier(const VkCommandBuffer cmd,
+               const VkPipelineStageFlags2 src_stage,
+               const VkAccessFlags2 src_access,
+               const VkPipelineStageFlags2 dst_stage,
+               const VkAccessFlags2 dst_access) -> void
+{
+  const VkMemoryBarrier2 barrier{
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+    .pNext = nullptr,
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+  const VkDependencyInfo dependency_info{
+    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  };
+  vkCmdPipelineBarrier2(cmd, &dependency_info);
+}
+
+// Moves an image whose layout is tracked to layout, with the barrier the
+// two layouts imply, covering all of its aspects.
+auto
+transition_tracked(const VkCommandBuffer cmd,
+                   VkTexture& image,
+                   const VkImageLayout layout) -> void
+{
+  if (image.get_layout() == layout) {
+    return;
+  }
+  ImageTransition::transition_layout(
+    cmd,
+    image.get_image(),
+    image.get_layout(),
+    layout,
+    {
+      .aspectMask = image.get_image_aspect_flags(),
+      .baseMipLevel = 0,
+      .levelCount = VK_REMAINING_MIP_LEVELS,
+      .baseArrayLayer = 0,
+      .layerCount = VK_REMAINING_ARRAY_LAYERS,
+    });
+  image.set_layout(layout);
+}
+
+auto
+has_dependencies(const Dependencies& deps) -> bool
+{
+  return deps.textures[0].valid() || deps.buffers[0].valid();
+}
+
 } // namespace
 
 CommandBuffer::~CommandBuffer()
@@ -141,6 +195,26 @@ CommandBuffer::cmd_begin_rendering(const RenderPass& render_pass,
                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
   }
 
+  // Buffers written by compute, e.g. culled draw commands, are read as
+  // indirect arguments or by the shaders of this pass. This also covers the
+  // depth pyramid, which the task shader of a mesh pipeline tests against.
+  if (deps.buffers[0].valid()) {
+    VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                                   VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                                   VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                                   VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT;
+    if (context->supports_mesh_shaders()) {
+      stages |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT |
+                VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+    }
+    memory_barrier(wrapper->command_buffer,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_WRITE_BIT,
+                   stages,
+                   VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                     VK_ACCESS_2_SHADER_READ_BIT);
+  }
+
   const std::uint32_t framebuffer_colour_attachment_count =
     fb.get_colour_attachment_count();
 
@@ -164,6 +238,12 @@ CommandBuffer::cmd_begin_rendering(const RenderPass& render_pass,
   }
 
   TextureHandle depth_texture = fb.depth_stencil.texture;
+  // Depth may have been sampled by compute since it was last attached.
+  if (depth_texture) {
+    transition_tracked(wrapper->command_buffer,
+                       **context->get_texture_pool().get(depth_texture),
+                       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+  }
   /*
   if (depth_texture) {
     const auto* depth_image = *context->get_texture_pool().get(depth_texture);
@@ -399,6 +479,9 @@ CommandBuffer::cmd_draw(std::uint32_t vertex_count,
                         std::uint32_t base_instance) -> void
 {
   assert(is_rendering && "Draw can only be called during rendering");
+  if (pipeline_pending) {
+    return;
+  }
   vkCmdDraw(wrapper->command_buffer,
             vertex_count,
             instance_count,
@@ -414,6 +497,9 @@ CommandBuffer::cmd_draw_indexed(std::uint32_t index_count,
                                 std::uint32_t base_instance) -> void
 {
   assert(is_rendering && "Draw indexed can only be called during rendering");
+  if (pipeline_pending) {
+    return;
+  }
   vkCmdDrawIndexed(wrapper->command_buffer,
                    index_count,
                    instance_count,
@@ -428,6 +514,10 @@ CommandBuffer::cmd_draw_indexed_indirect(BufferHandle indirect_buffer,
                                          uint32_t draw_count,
                                          uint32_t stride) -> void
 {
+  if (pipeline_pending) {
+    return;
+  }
+
   auto* bufIndirect = *context->get_buffer_pool().get(indirect_buffer);
 
   vkCmdDrawIndexedIndirect(wrapper->command_buffer,
@@ -439,8 +529,94 @@ CommandBuffer::cmd_draw_indexed_indirect(BufferHandle indirect_buffer,
 }
 
 auto
-CommandBuffer::cmd_dispatch_thread_groups(const Dimensions& xyz) -> void
+CommandBuffer::cmd_draw_indexed_indirect_count(BufferHandle indirect_buffer,
+                                               size_t indirect_buffer_offset,
+                                               BufferHandle count_buffer,
+                                               size_t count_buffer_offset,
+                                               uint32_t max_draw_count,
+                                               uint32_t stride) -> void
 {
+  if (pipeline_pending) {
+    return;
+  }
+
+  auto* bufIndirect = *context->get_buffer_pool().get(indirect_buffer);
+  auto* bufCount = *context->get_buffer_pool().get(count_buffer);
+
+  vkCmdDrawIndexedIndirectCount(wrapper->command_buffer,
+                                bufIndirect->get_buffer(),
+                                indirect_buffer_offset,
+                                bufCount->get_buffer(),
+                                count_buffer_offset,
+                                max_draw_count,
+                                stride ? stride
+                                       : sizeof(VkDrawIndexedIndirectCommand));
+}
+
+auto
+CommandBuffer::cmd_draw_mesh_tasks(const Dimensions& xyz) -> void
+{
+  assert(is_rendering && "Mesh tasks can only be drawn during rendering");
+  assert(context->supports_mesh_shaders());
+  if (pipeline_pending) {
+    return;
+  }
+
+  context->cmd_draw_mesh_tasks(
+    wrapper->command_buffer, xyz.width, xyz.height, xyz.depth);
+}
+
+auto
+CommandBuffer::cmd_fill_buffer(BufferHandle buffer,
+                               size_t buffer_offset,
+                               size_t size,
+                               uint32_t data) -> void
+{
+  assert(!is_rendering && "Buffers cannot be filled during rendering");
+
+  auto* buf = *context->get_buffer_pool().get(buffer);
+
+  // Earlier readers of the buffer, including previous frames, go first.
+  memory_barrier(wrapper->command_buffer,
+                 VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                 VK_ACCESS_2_MEMORY_WRITE_BIT,
+                 VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                 VK_ACCESS_2_TRANSFER_WRITE_BIT);
+  vkCmdFillBuffer(
+    wrapper->command_buffer, buf->get_buffer(), buffer_offset, size, data);
+}
+
+auto
+CommandBuffer::cmd_dispatch_thread_groups(const Dimensions& xyz,
+                                          const Dependencies& deps) -> void
+{
+  if (pipeline_pending) {
+    return;
+  }
+
+  for (std::uint32_t i = 0;
+       i != Dependencies::max_dependencies && deps.textures[i];
+       i++) {
+    auto* image = *context->get_texture_pool().get(deps.textures[i]);
+    if (image->is_storage()) {
+      transition_tracked(
+        wrapper->command_buffer, *image, VK_IMAGE_LAYOUT_GENERAL);
+    } else if (image->get_image_aspect_flags() & VK_IMAGE_ASPECT_DEPTH_BIT) {
+      // Waits for the depth writes; cmd_begin_rendering moves it back.
+      transition_tracked(wrapper->command_buffer,
+                         *image,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+  }
+
+  if (has_dependencies(deps)) {
+    memory_barrier(wrapper->command_buffer,
+                   VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                   VK_ACCESS_2_MEMORY_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+  }
+
   const auto x = std::max(xyz.width, 1u);
   const auto y = std::max(xyz.height, 1u);
   const auto z = std::max(xyz.depth, 1u);
@@ -462,7 +638,10 @@ CommandBuffer::cmd_bind_compute_pipeline(ComputePipelineHandle handle) -> void
 
   const auto vk_pipeline = context->get_pipeline(handle);
 
-  assert(vk_pipeline != VK_NULL_HANDLE);
+  pipeline_pending = vk_pipeline == VK_NULL_HANDLE;
+  if (pipeline_pending) {
+    return;
+  }
 
   if (last_pipeline_bound != vk_pipeline) {
     last_pipeline_bound = vk_pipeline;
@@ -499,7 +678,10 @@ CommandBuffer::cmd_bind_graphics_pipeline(const GraphicsPipelineHandle handle)
 
   const auto vk_pipeline = context->get_pipeline(handle, view_mask);
 
-  assert(vk_pipeline != VK_NULL_HANDLE);
+  pipeline_pending = vk_pipeline == VK_NULL_HANDLE;
+  if (pipeline_pending) {
+    return;
+  }
 
   if (last_pipeline_bound != vk_pipeline) {
     last_pipeline_bound = vk_pipeline;
@@ -514,6 +696,10 @@ CommandBuffer::cmd_bind_graphics_pipeline(const GraphicsPipelineHandle handle)
 auto
 CommandBuffer::cmd_push_constants(const std::span<const std::byte> data) -> void
 {
+  if (pipeline_pending) {
+    return;
+  }
+
   const auto device_limits =
     context->vulkan_properties.base.limits.maxPushConstantsSize;
   if (data.empty() || data.size_bytes() % 4 != 0 ||
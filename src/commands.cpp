@@ -1,6 +1,7 @@
 #include "vk-bindless/commands.hpp"
 #include "vk-bindless/types.hpp"
 #include "vk-bindless/vulkan_context.hpp"
+#include <algorithm>
 #include <cassert>
 #include <format>
 #include <stdexcept>
@@ -154,7 +155,8 @@ auto
 ImmediateCommands::submit(const CommandBufferWrapper& wrapper) -> SubmitHandle
 {
   vkEndCommandBuffer(wrapper.command_buffer);
-  std::array<VkSemaphoreSubmitInfo, 2> wait_semaphores{
+  std::array<VkSemaphoreSubmitInfo, 3> wait_semaphores{
+    VkSemaphoreSubmitInfo{},
     VkSemaphoreSubmitInfo{},
     VkSemaphoreSubmitInfo{},
   };
@@ -162,6 +164,9 @@ ImmediateCommands::submit(const CommandBufferWrapper& wrapper) -> SubmitHandle
   if (wait_semaphore_info.semaphore != VK_NULL_HANDLE) {
     wait_semaphores[wait_semaphore_count++] = wait_semaphore_info;
   }
+  if (timeline_wait_info.semaphore != VK_NULL_HANDLE) {
+    wait_semaphores[wait_semaphore_count++] = timeline_wait_info;
+  }
   if (last_submit_semaphore.semaphore != VK_NULL_HANDLE) {
     wait_semaphores[wait_semaphore_count++] = last_submit_semaphore;
   }
@@ -204,6 +209,7 @@ ImmediateCommands::submit(const CommandBufferWrapper& wrapper) -> SubmitHandle
   last_submit_handle = wrapper.handle;
 
   wait_semaphore_info.semaphore = VK_NULL_HANDLE;
+  timeline_wait_info.semaphore = VK_NULL_HANDLE;
   signal_semaphore_info.semaphore = VK_NULL_HANDLE;
   const_cast<CommandBufferWrapper&>(wrapper).is_encoding = false;
   submit_counter++;
@@ -219,8 +225,9 @@ ImmediateCommands::is_ready(SubmitHandle handle) const -> bool
     return true;
 
   const auto& buf = command_buffers[handle.buffer_index];
+  // Already purged, so it completed and has not been reused yet.
   if (buf.command_buffer == VK_NULL_HANDLE)
-    return false;
+    return true;
 
   if (buf.handle.submit_identifier != handle.submit_identifier)
     return true;
@@ -269,6 +276,19 @@ ImmediateCommands::wait_semaphore(VkSemaphore s) -> void
   wait_semaphore_info.semaphore = s;
 }
 
+auto
+ImmediateCommands::wait_timeline_semaphore(VkSemaphore semaphore,
+                                           const std::uint64_t value) -> void
+{
+  assert(timeline_wait_info.semaphore == VK_NULL_HANDLE ||
+         timeline_wait_info.semaphore == semaphore);
+
+  const auto pending = timeline_wait_info.semaphore != VK_NULL_HANDLE;
+  timeline_wait_info.semaphore = semaphore;
+  timeline_wait_info.value =
+    pending ? std::max(timeline_wait_info.value, value) : value;
+}
+
 void
 ImmediateCommands::signal_semaphore(VkSemaphore semaphore,
                                     std::uint64_t signalValue)
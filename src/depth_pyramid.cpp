@@ -0,0 +1,141 @@
+#include "vk-bindless/depth_pyramid.hpp"
+
+#include "vk-bindless/buffer.hpp"
+#include "vk-bindless/command_buffer.hpp"
+#include "vk-bindless/container.hpp"
+#include "vk-bindless/graphics_context.hpp"
+#include "vk-bindless/object_pool.hpp"
+#include "vk-bindless/pipeline.hpp"
+#include "vk-bindless/shader.hpp"
+#include "vk-bindless/texture.hpp"
+#include "vk-bindless/vulkan_context.hpp"
+
+#include <algorithm>
+#include <format>
+
+namespace VkBindless {
+
+namespace {
+
+constexpr std::uint32_t group_size = 8;
+
+// Matches the push constants of depth_pyramid.shader.
+struct ReducePushConstants
+{
+  std::uint32_t source_width;
+  std::uint32_t source_height;
+  std::uint32_t destination_width;
+  std::uint32_t destination_height;
+  std::uint32_t source_index;
+  std::uint32_t destination_index;
+  std::uint32_t source_is_depth;
+};
+
+auto
+half_extent(const VkExtent2D extent) -> VkExtent2D
+{
+  return { std::max(extent.width / 2, 1U), std::max(extent.height / 2, 1U) };
+}
+
+} // namespace
+
+DepthPyramid::DepthPyramid(IContext& ctx)
+  : context(ctx)
+{
+  shader = *VkShader::create(&context, "assets/shaders/depth_pyramid.shader");
+  pipeline = VkComputePipeline::create(&context,
+                                       {
+                                         .shader = *shader,
+                                         .entry_point = "main",
+                                         .debug_name = "Depth Pyramid",
+                                       });
+}
+
+auto
+DepthPyramid::resize(const VkExtent2D depth_extent) -> void
+{
+  extent = half_extent(depth_extent);
+  levels.clear();
+
+  std::vector<std::uint32_t> indices;
+  auto level_extent = extent;
+  while (true) {
+    levels.push_back(VkTexture::create(
+      context,
+      VkTextureDescription{
+        .format = Format::R_F32,
+        .extent = { level_extent.width, level_extent.height, 1 },
+        .usage_flags = TextureUsageFlags::Storage,
+        .mip_levels = 1,
+        .debug_name = std::format("Depth Pyramid {}", levels.size()),
+      }));
+    indices.push_back(levels.back().index());
+    if (level_extent.width == 1 && level_extent.height == 1) {
+      break;
+    }
+    level_extent = half_extent(level_extent);
+  }
+
+  level_indices =
+    VkDataBuffer::create(context,
+                         {
+                           .data = VkBindless::as_bytes(indices),
+                           .storage = StorageType::DeviceLocal,
+                           .usage = BufferUsageFlags::StorageBuffer,
+                           .debug_name = "Depth Pyramid Levels",
+                         });
+}
+
+auto
+DepthPyramid::build(ICommandBuffer& cmd, const TextureHandle depth) -> void
+{
+  if (depth != source) {
+    const auto depth_extent =
+      (*context.get_texture_pool().get(depth))->get_extent();
+    resize({ depth_extent.width, depth_extent.height });
+    source = depth;
+    ready = false;
+    return;
+  }
+
+  // Dispatches against a pipeline that is still compiling are dropped.
+  if (dynamic_cast<Context&>(context).get_pipeline(*pipeline) ==
+      VK_NULL_HANDLE) {
+    ready = false;
+    return;
+  }
+
+  cmd.cmd_bind_compute_pipeline(*pipeline);
+
+  auto source_texture = depth;
+  const auto depth_extent =
+    (*context.get_texture_pool().get(depth))->get_extent();
+  VkExtent2D source_extent{ depth_extent.width, depth_extent.height };
+  auto level_extent = extent;
+  for (const auto& level : levels) {
+    const ReducePushConstants pc{
+      .source_width = source_extent.width,
+      .source_height = source_extent.height,
+      .destination_width = level_extent.width,
+      .destination_height = level_extent.height,
+      .source_index = source_texture.index(),
+      .destination_index = level.index(),
+      .source_is_depth = source_texture == depth ? 1U : 0U,
+    };
+    cmd.cmd_push_constants(pc, 0);
+    cmd.cmd_dispatch_thread_groups(
+      {
+        (level_extent.width + group_size - 1) / group_size,
+        (level_extent.height + group_size - 1) / group_size,
+        1,
+      },
+      { .textures = { source_texture, *level } });
+
+    source_texture = *level;
+    source_extent = level_extent;
+    level_extent = half_extent(level_extent);
+  }
+  ready = true;
+}
+
+} // namespace VkBindless
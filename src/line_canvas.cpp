@@ -171,7 +171,7 @@ LineCanvas3D::render(IContext& ctx,
                            {
                              .data = VkBindless::as_bytes(line_span),
                              .size = required_size,
-                             .storage = StorageType::DeviceLocal,
+                             .storage = StorageType::HostVisible,
                              .usage = BufferUsageFlags::StorageBuffer,
                              .debug_name = "LineCanvas3D::buffer",
                            });
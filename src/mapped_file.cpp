@@ -0,0 +1,151 @@
+#include "vk-bindless/mapped_file.hpp"
+
+#include <format>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VkBindless {
+
+MappedFile::~MappedFile()
+{
+  reset();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data(std::exchange(other.data, nullptr))
+  , size(std::exchange(other.size, 0))
+#ifdef _WIN32
+  , file(std::exchange(other.file, nullptr))
+  , mapping(std::exchange(other.mapping, nullptr))
+#endif
+{
+}
+
+auto
+MappedFile::operator=(MappedFile&& other) noexcept -> MappedFile&
+{
+  if (this != &other) {
+    reset();
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+#ifdef _WIN32
+    file = std::exchange(other.file, nullptr);
+    mapping = std::exchange(other.mapping, nullptr);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+
+auto
+MappedFile::open(const std::filesystem::path& path)
+  -> std::expected<MappedFile, std::string>
+{
+  MappedFile result;
+  result.file = CreateFileW(path.c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                            nullptr);
+  if (result.file == INVALID_HANDLE_VALUE) {
+    result.file = nullptr;
+    return std::unexpected(std::format("Could not open {}", path.string()));
+  }
+
+  LARGE_INTEGER file_size{};
+  if (!GetFileSizeEx(result.file, &file_size) || file_size.QuadPart == 0) {
+    return std::unexpected(std::format("{} is empty", path.string()));
+  }
+
+  result.mapping =
+    CreateFileMappingW(result.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (result.mapping == nullptr) {
+    return std::unexpected(std::format("Could not map {}", path.string()));
+  }
+
+  result.data = static_cast<const std::byte*>(
+    MapViewOfFile(result.mapping, FILE_MAP_READ, 0, 0, 0));
+  if (result.data == nullptr) {
+    return std::unexpected(std::format("Could not map {}", path.string()));
+  }
+  result.size = static_cast<std::size_t>(file_size.QuadPart);
+  return result;
+}
+
+auto
+MappedFile::reset() -> void
+{
+  if (data != nullptr) {
+    UnmapViewOfFile(data);
+  }
+  if (mapping != nullptr) {
+    CloseHandle(mapping);
+  }
+  if (file != nullptr) {
+    CloseHandle(file);
+  }
+  data = nullptr;
+  size = 0;
+  mapping = nullptr;
+  file = nullptr;
+}
+
+#else
+
+auto
+MappedFile::open(const std::filesystem::path& path)
+  -> std::expected<MappedFile, std::string>
+{
+  const auto descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) {
+    return std::unexpected(std::format("Could not open {}", path.string()));
+  }
+
+  struct stat status{};
+  if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+    close(descriptor);
+    return std::unexpected(std::format("{} is empty", path.string()));
+  }
+
+  const auto size = static_cast<std::size_t>(status.st_size);
+  auto* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  // The mapping keeps its own reference to the file.
+  close(descriptor);
+  if (address == MAP_FAILED) {
+    return std::unexpected(std::format("Could not map {}", path.string()));
+  }
+  // Sections are read front to back, mostly once.
+  madvise(address, size, MADV_SEQUENTIAL);
+
+  MappedFile result;
+  result.data = static_cast<const std::byte*>(address);
+  result.size = size;
+  return result;
+}
+
+auto
+MappedFile::reset() -> void
+{
+  if (data != nullptr) {
+    munmap(const_cast<std::byte*>(data), size);
+  }
+  data = nullptr;
+  size = 0;
+}
+
+#endif
+
+} // namespace VkBindless
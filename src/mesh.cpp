@@ -10,25 +10,32 @@
 #include "vk-bindless/command_buffer.hpp"
 #include "vk-bindless/common.hpp"
 #include "vk-bindless/graphics_context.hpp"
+#include "vk-bindless/hash.hpp"
 #include "vk-bindless/material.hpp"
+#include "vk-bindless/mip_generator.hpp"
 #include "vk-bindless/texture.hpp"
+#include "vk-bindless/thread_pool.hpp"
+#include "vk-bindless/vulkan_context.hpp"
 
+#include <algorithm>
 #include <bit>
+#include <chrono>
+#include <cstdlib>
 #include <cstdio>
 #include <expected>
 #include <filesystem>
 #include <fstream>
 
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#include <stb_image_resize2.h>
-
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
+#include <exception>
 #include <execution>
 #include <future>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <ktx.h>
+#include <limits>
+#include <map>
 #include <semaphore>
 #include <stb_image.h>
 #include <type_traits>
@@ -38,101 +45,319 @@ namespace VkBindless {
 
 namespace {
 
+// Everything below shapes the cache, so it is all part of its source hash.
+// Bump importer_revision for changes to the conversion code itself.
+constexpr std::uint32_t importer_revision = 5;
+constexpr std::uint32_t import_flags =
+  aiProcess_JoinIdenticalVertices | aiProcess_Triangulate |
+  aiProcess_GenSmoothNormals | aiProcess_LimitBoneWeights |
+  aiProcess_SplitLargeMeshes | aiProcess_ImproveCacheLocality |
+  aiProcess_RemoveRedundantMaterials | aiProcess_FindDegenerates |
+  aiProcess_FindInvalidData | aiProcess_GenUVCoords | aiProcess_FlipUVs |
+  aiProcess_FlipWindingOrder | aiProcess_CalcTangentSpace |
+  aiProcess_GlobalScale;
+constexpr std::array lod_reduction_rates{ 0.75f, 0.5f, 0.25f, 0.1f };
+constexpr std::array lod_target_errors{ 0.01f, 0.05f, 0.1f, 0.2f };
+constexpr auto meshlet_cone_weight = 0.25F;
+
+struct DecodedImage
+{
+  std::vector<std::uint8_t> rgba{};
+  std::uint32_t width{ 0 };
+  std::uint32_t height{ 0 };
+};
+
+/// A KTX2 container written to memory by libktx, ready to go into the cache.
+struct SerializedTexture
+{
+  struct Deleter
+  {
+    auto operator()(ktx_uint8_t* ptr) const -> void { std::free(ptr); }
+  };
+  std::unique_ptr<ktx_uint8_t, Deleter> data{};
+  std::size_t size{ 0 };
+
+  [[nodiscard]] auto bytes() const -> std::span<const std::uint8_t>
+  {
+    return { data.get(), size };
+  }
+};
+
+/// One texture the materials refer to, from its first reference to its
+/// serialised container. Every stage fills in the next member.
+struct TextureJob
+{
+  std::string path;
+  LoadedTextureType role{};
+  std::expected<DecodedImage, std::string> image{};
+  std::uint64_t content_hash{ 0 };
+  std::expected<ProcessedTexture, std::string> texture{ std::unexpected(
+    "not processed") };
+  std::expected<SerializedTexture, std::string> container{ std::unexpected(
+    "not processed") };
+};
+
+/// Runs one stage of a texture job. The stages run on workers whose futures
+/// are dropped, so whatever a stage throws becomes the error of result.
+template<typename T, typename Stage>
+auto
+run_stage(std::expected<T, std::string>& result, Stage&& stage) -> void
+{
+  try {
+    stage();
+  } catch (const std::exception& e) {
+    result = std::unexpected(std::string{ e.what() });
+  } catch (...) {
+    result = std::unexpected(std::string{ "unknown exception" });
+  }
+}
+
 struct TextureCache
 {
-  std::vector<ProcessedTexture> textures;
-  std::unordered_map<std::string, std::int32_t> texture_path_to_index;
-  std::mutex textures_mutex;
+  /// One per distinct path, in the order materials first refer to them.
+  std::vector<TextureJob> jobs;
+  std::map<std::pair<std::string, LoadedTextureType>, std::int32_t>
+    path_to_job;
 
+  /// Distinct by content, in the same order; what the cache file stores.
+  std::vector<ProcessedTexture> textures;
+  std::vector<SerializedTexture> containers;
   std::vector<ProcessedTexture> opacity_textures;
-  std::unordered_map<std::string, std::int32_t> opacity_path_to_index;
-  std::mutex opacity_mutex;
 };
 
+/// How textures in one role are filtered and compressed.
+struct TextureEncoding
+{
+  /// Format of the uncompressed levels. sRGB makes Basis weigh errors
+  /// perceptually and the transcode produce BC7_SRGB.
+  VkFormat source_format{ VK_FORMAT_R8G8B8A8_UNORM };
+  MipContent mip_content{ MipContent::Linear };
+  ktx_transcode_fmt_e target{ KTX_TTF_BC7_RGBA };
+  /// The channel BC4 keeps.
+  std::uint32_t channel{ 0 };
+
+  auto operator==(const TextureEncoding&) const -> bool = default;
+};
+
+auto
+texture_encoding(const LoadedTextureType role) -> TextureEncoding
+{
+  switch (role) {
+    case LoadedTextureType::Emissive:
+    case LoadedTextureType::Diffuse:
+      return { VK_FORMAT_R8G8B8A8_SRGB, MipContent::Srgb, KTX_TTF_BC7_RGBA };
+    // Height maps are only imported in place of a missing normal map.
+    case LoadedTextureType::Normals:
+    case LoadedTextureType::Height:
+      return { VK_FORMAT_R8G8B8A8_UNORM,
+               MipContent::NormalMap,
+               KTX_TTF_BC5_RG };
+    // glTF packs roughness into green and metalness into blue; separate
+    // greyscale maps have the same value in every channel.
+    case LoadedTextureType::Roughness:
+      return { VK_FORMAT_R8G8B8A8_UNORM, MipContent::Linear, KTX_TTF_BC4_R, 1 };
+    case LoadedTextureType::Metalness:
+      return { VK_FORMAT_R8G8B8A8_UNORM, MipContent::Linear, KTX_TTF_BC4_R, 2 };
+    case LoadedTextureType::Opacity:
+    case LoadedTextureType::AmbientOcclusion:
+      return { VK_FORMAT_R8G8B8A8_UNORM, MipContent::Linear, KTX_TTF_BC4_R, 0 };
+  }
+  return {};
+}
+
+auto
+texture_format(const ProcessedTexture& texture) -> Format
+{
+  return vk_format_to_format(
+    static_cast<VkFormat>(texture.ktx_texture->vkFormat));
+}
+
 class TextureProcessor
 {
 public:
-  static auto process_assimp_texture(
-    const aiTexture* ai_texture,
-    const std::string& debug_name,
-    bool generate_mipmaps = true,
-    float quality = 1.0f // 0.0 = fastest, 1.0 = highest quality
-    ) -> std::expected<ProcessedTexture, std::string>
+  static auto decode_texture(const std::string& texture_path,
+                             const aiScene* scene)
+    -> std::expected<DecodedImage, std::string>
   {
-    assert(quality > 0.0F && quality <= 1.0F);
-
-    if (!ai_texture) {
-      return std::unexpected("Null texture provided");
+    if (!texture_path.starts_with("*")) {
+      return decode_external_texture(texture_path);
     }
 
-    std::vector<std::uint8_t> rgba_data;
-    int width, height, channels;
-
-    if (ai_texture->mHeight == 0) {
-      std::uint8_t* decompressed = stbi_load_from_memory(
-        reinterpret_cast<const stbi_uc*>(ai_texture->pcData),
-        ai_texture->mWidth,
-        &width,
-        &height,
-        &channels,
-        4);
+    int texture_index = -1;
+    try {
+      texture_index = std::stoi(texture_path.substr(1));
+    } catch (const std::exception&) {
+      return std::unexpected("Invalid embedded texture reference");
+    }
+    if (texture_index < 0 ||
+        texture_index >= static_cast<int>(scene->mNumTextures)) {
+      return std::unexpected("Embedded texture index out of range");
+    }
+    return decode_assimp_texture(scene->mTextures[texture_index]);
+  }
 
-      if (!decompressed) {
-        return std::unexpected("STB failed to decompress texture: " +
-                               std::string(stbi_failure_reason()));
-      }
+  /// An RGBA8 texture holding the image and, optionally, its mip chain.
+  static auto create_mip_chain(const DecodedImage& image,
+                               const std::string& debug_name,
+                               const TextureEncoding& encoding,
+                               bool generate_mipmaps)
+    -> std::expected<ProcessedTexture, std::string>
+  {
+    const auto mip_levels =
+      generate_mipmaps ? calculate_mip_levels(image.width, image.height) : 1u;
 
-      const size_t data_size = width * height * 4;
-      rgba_data.resize(data_size);
-      std::memcpy(rgba_data.data(), decompressed, data_size);
-      stbi_image_free(decompressed);
+    ktxTextureCreateInfo create_info{};
+    create_info.vkFormat = encoding.source_format;
+    create_info.baseWidth = image.width;
+    create_info.baseHeight = image.height;
+    create_info.baseDepth = 1;
+    create_info.numDimensions = 2;
+    create_info.numLevels = mip_levels;
+    create_info.numLayers = 1;
+    create_info.numFaces = 1;
+    create_info.isArray = KTX_FALSE;
+    create_info.generateMipmaps = KTX_FALSE;
 
-    } else {
-      width = ai_texture->mWidth;
-      height = ai_texture->mHeight;
-      channels = 4;
+    ktxTexture2* texture = nullptr;
+    if (auto rc = ktxTexture2_Create(
+          &create_info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture);
+        rc != KTX_SUCCESS) {
+      return std::unexpected("ktxTexture2_Create failed: " +
+                             std::to_string(rc));
+    }
+    std::unique_ptr<ktxTexture2, ProcessedTexture::Destructor> texture_ptr(
+      texture, ProcessedTexture::Destructor{});
 
-      rgba_data.reserve(width * height * 4);
+    if (auto rc = ktxTexture_SetImageFromMemory(ktxTexture(texture),
+                                                0,
+                                                0,
+                                                0,
+                                                image.rgba.data(),
+                                                image.rgba.size());
+        rc != KTX_SUCCESS) {
+      return std::unexpected("ktxTexture_SetImageFromMemory failed: " +
+                             std::to_string(rc));
+    }
 
-      for (int i = 0; i < width * height; ++i) {
-        const aiTexel& texel = ai_texture->pcData[i];
-        rgba_data.push_back(texel.r);
-        rgba_data.push_back(texel.g);
-        rgba_data.push_back(texel.b);
-        rgba_data.push_back(texel.a);
-      }
+    // Each level is filtered from the one above it, not from level 0.
+    auto* levels = ktxTexture_GetData(ktxTexture(texture));
+    auto w = image.width;
+    auto h = image.height;
+    std::size_t source_offset = 0;
+    for (auto i = 1U; i < mip_levels; ++i) {
+      std::size_t offset = 0;
+      ktxTexture_GetImageOffset(ktxTexture(texture), i, 0, 0, &offset);
+      downsample_rgba8(
+        std::span{ levels + source_offset, std::size_t{ w } * h * 4 },
+        w,
+        h,
+        std::span{ levels + offset,
+                   std::size_t{ mip_extent(w) } * mip_extent(h) * 4 },
+        encoding.mip_content);
+      w = mip_extent(w);
+      h = mip_extent(h);
+      source_offset = offset;
     }
 
-    return create_bc7_ktx_texture(
-      rgba_data, width, height, debug_name, generate_mipmaps, quality);
+    return ProcessedTexture{
+      .ktx_texture = std::move(texture_ptr),
+      .debug_name = debug_name,
+      .width = image.width,
+      .height = image.height,
+      .mip_levels = mip_levels,
+    };
   }
 
-  static auto process_external_texture(
-    const std::filesystem::path& texture_path,
-    const std::string& debug_name,
-    bool generate_mipmaps = true,
-    float quality = 1.0f) -> std::expected<ProcessedTexture, std::string>
+  static auto basis_params(TextureEncodePreset preset,
+                           std::uint32_t thread_count) -> ktxBasisParams
   {
+    ktxBasisParams params{};
+    params.structSize = sizeof(params);
+    params.uastc = KTX_TRUE;
+    params.threadCount = thread_count;
+    switch (preset) {
+      case TextureEncodePreset::Fast:
+        params.uastcFlags = KTX_PACK_UASTC_LEVEL_FASTEST;
+        break;
+      case TextureEncodePreset::Balanced:
+        params.uastcFlags = KTX_PACK_UASTC_LEVEL_DEFAULT;
+        break;
+      case TextureEncodePreset::Archival:
+        params.uastcFlags = KTX_PACK_UASTC_LEVEL_VERYSLOW;
+        params.uastcRDO = KTX_TRUE;
+        params.uastcRDOQualityScalar = 1.0F;
+        params.uastcRDODictSize = 32768;
+        break;
+    }
+    return params;
+  }
 
-    int width, height, channels;
-    std::uint8_t* data = stbi_load(texture_path.string().c_str(),
-                                   &width,
-                                   &height,
-                                   &channels,
-                                   4); // Force RGBA
+  /// Compresses every level of a create_mip_chain texture in place to the
+  /// block format encoding targets.
+  static auto encode(ProcessedTexture& processed,
+                     const TextureEncoding& encoding,
+                     TextureEncodePreset preset,
+                     std::uint32_t thread_count)
+    -> std::expected<void, std::string>
+  {
+    auto* texture = processed.ktx_texture.get();
+
+    // Basis builds BC4 from the colour's green and BC5 from the colour's
+    // and alpha's green, so the first channel is copied into RGB and the
+    // second, for BC5, into alpha.
+    if (encoding.target != KTX_TTF_BC7_RGBA) {
+      const auto texels = std::span{ ktxTexture_GetData(ktxTexture(texture)),
+                                     ktxTexture_GetDataSize(
+                                       ktxTexture(texture)) };
+      for (auto i = 0ULL; i < texels.size(); i += 4) {
+        auto* texel = &texels[i];
+        const auto x = encoding.target == KTX_TTF_BC5_RG
+                         ? texel[0]
+                         : texel[encoding.channel];
+        const auto y =
+          encoding.target == KTX_TTF_BC5_RG ? texel[1] : std::uint8_t{ 255 };
+        texel[0] = texel[1] = texel[2] = x;
+        texel[3] = y;
+      }
+    }
 
-    if (!data) {
-      const auto formatted = std::format("Failed to load texture {}: {}",
-                                         texture_path.string(),
-                                         stbi_failure_reason());
-      return std::unexpected(formatted);
+    auto params = basis_params(preset, thread_count);
+    if (auto rc = ktxTexture2_CompressBasisEx(texture, &params);
+        rc != KTX_SUCCESS) {
+      return std::unexpected("ktxTexture2_CompressBasisEx failed: " +
+                             std::to_string(rc));
+    }
+    if (auto rc = ktxTexture2_TranscodeBasis(texture, encoding.target, 0);
+        rc != KTX_SUCCESS) {
+      return std::unexpected("ktxTexture2_TranscodeBasis failed: " +
+                             std::to_string(rc));
     }
 
-    std::vector<std::uint8_t> rgba_data(data, data + (width * height * 4));
-    stbi_image_free(data);
+    // The loader picks the image format from the container.
+    const auto final_vk_format = static_cast<VkFormat>(texture->vkFormat);
+    if (vk_format_to_format(final_vk_format) == Format::Invalid) {
+      return std::unexpected(
+        std::format("Transcoded to unsupported vkFormat {}",
+                    static_cast<int>(final_vk_format)));
+    }
+    return {};
+  }
 
-    return create_bc7_ktx_texture(
-      rgba_data, width, height, debug_name, generate_mipmaps, quality);
+  static auto serialize(const ProcessedTexture& texture)
+    -> std::expected<SerializedTexture, std::string>
+  {
+    ktx_uint8_t* buffer = nullptr;
+    ktx_size_t size = 0;
+    if (auto rc = ktxTexture_WriteToMemory(
+          ktxTexture(texture.ktx_texture.get()), &buffer, &size);
+        rc != KTX_SUCCESS) {
+      return std::unexpected("ktxTexture_WriteToMemory failed: " +
+                             std::to_string(rc));
+    }
+    SerializedTexture result{};
+    result.data.reset(buffer);
+    result.size = size;
+    return result;
   }
 
   static auto save_ktx_to_file(const ProcessedTexture& texture,
@@ -154,159 +379,258 @@ public:
   }
 
 private:
-  static auto create_bc7_ktx_texture(const std::vector<std::uint8_t>& rgba_data,
-                                     int width,
-                                     int height,
-                                     const std::string& debug_name,
-                                     bool generate_mipmaps,
-                                     float)
-    -> std::expected<ProcessedTexture, std::string>
+  static auto decode_assimp_texture(const aiTexture* ai_texture)
+    -> std::expected<DecodedImage, std::string>
   {
-    const auto mip_levels =
-      generate_mipmaps ? calculate_mip_levels(width, height) : 1u;
+    if (!ai_texture) {
+      return std::unexpected("Null texture provided");
+    }
 
-    ktxTextureCreateInfo create_info{};
-    create_info.vkFormat = VK_FORMAT_R8G8B8A8_UNORM;
-    create_info.baseWidth = static_cast<ktx_uint32_t>(width);
-    create_info.baseHeight = static_cast<ktx_uint32_t>(height);
-    create_info.baseDepth = 1;
-    create_info.numDimensions = 2;
-    create_info.numLevels = mip_levels;
-    create_info.numLayers = 1;
-    create_info.numFaces = 1;
-    create_info.isArray = KTX_FALSE;
-    create_info.generateMipmaps = KTX_FALSE;
+    DecodedImage image{};
+    if (ai_texture->mHeight == 0) {
+      int width, height, channels;
+      std::uint8_t* decompressed = stbi_load_from_memory(
+        reinterpret_cast<const stbi_uc*>(ai_texture->pcData),
+        ai_texture->mWidth,
+        &width,
+        &height,
+        &channels,
+        4);
 
-    ktxTexture2* texture = nullptr;
-    if (auto rc = ktxTexture2_Create(
-          &create_info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture);
-        rc != KTX_SUCCESS) {
-      return std::unexpected("ktxTexture2_Create failed: " +
-                             std::to_string(rc));
-    }
-    std::unique_ptr<ktxTexture2, ProcessedTexture::Destructor> texture_ptr(
-      texture, ProcessedTexture::Destructor{});
+      if (!decompressed) {
+        return std::unexpected("STB failed to decompress texture: " +
+                               std::string(stbi_failure_reason()));
+      }
 
-    int w = width;
-    int h = height;
-    for (auto i = 0U; i != mip_levels; ++i) {
-      size_t offset = 0;
-      ktxTexture_GetImageOffset(ktxTexture(texture), i, 0, 0, &offset);
-      stbir_resize_uint8_linear((const unsigned char*)rgba_data.data(),
-                                width,
-                                height,
-                                0,
-                                ktxTexture_GetData(ktxTexture(texture)) +
-                                  offset,
-                                w,
-                                h,
-                                0,
-                                STBIR_RGBA);
-      h = h > 1 ? h >> 1 : 1;
-      w = w > 1 ? w >> 1 : 1;
-    }
+      const size_t data_size = width * height * 4;
+      image.rgba.assign(decompressed, decompressed + data_size);
+      image.width = static_cast<std::uint32_t>(width);
+      image.height = static_cast<std::uint32_t>(height);
+      stbi_image_free(decompressed);
+    } else {
+      image.width = ai_texture->mWidth;
+      image.height = ai_texture->mHeight;
+      image.rgba.reserve(std::size_t{ image.width } * image.height * 4);
 
-    if (auto rc = ktxTexture_SetImageFromMemory(
-          ktxTexture(texture), 0, 0, 0, rgba_data.data(), rgba_data.size());
-        rc != KTX_SUCCESS) {
-      return std::unexpected("ktxTexture_SetImageFromMemory failed: " +
-                             std::to_string(rc));
+      for (auto i = 0U; i < image.width * image.height; ++i) {
+        const aiTexel& texel = ai_texture->pcData[i];
+        image.rgba.push_back(texel.r);
+        image.rgba.push_back(texel.g);
+        image.rgba.push_back(texel.b);
+        image.rgba.push_back(texel.a);
+      }
     }
+    return image;
+  }
 
-    ktxTexture2_CompressBasis(texture, 255);
-    ktxTexture2_TranscodeBasis(texture, KTX_TTF_BC7_RGBA, 0);
+  static auto decode_external_texture(
+    const std::filesystem::path& texture_path)
+    -> std::expected<DecodedImage, std::string>
+  {
+    int width, height, channels;
+    std::uint8_t* data = stbi_load(texture_path.string().c_str(),
+                                   &width,
+                                   &height,
+                                   &channels,
+                                   4); // Force RGBA
 
-    // ensure container reports BC7
-    const auto final_vk_format = static_cast<VkFormat>(texture->vkFormat);
-    if (final_vk_format != VK_FORMAT_BC7_UNORM_BLOCK &&
-        final_vk_format != VK_FORMAT_BC7_SRGB_BLOCK) {
-      return std::unexpected("Final vkFormat is not BC7 after transcode.");
+    if (!data) {
+      const auto formatted = std::format("Failed to load texture {}: {}",
+                                         texture_path.string(),
+                                         stbi_failure_reason());
+      return std::unexpected(formatted);
     }
 
-    return ProcessedTexture{
-      .ktx_texture = std::move(texture_ptr),
-      .debug_name = debug_name,
+    DecodedImage image{
+      .rgba = std::vector<std::uint8_t>(data, data + (width * height * 4)),
       .width = static_cast<std::uint32_t>(width),
       .height = static_cast<std::uint32_t>(height),
-      .mip_levels = mip_levels,
     };
+    stbi_image_free(data);
+    return image;
   }
 
-  static auto calculate_mip_levels(int width, int height) -> std::uint32_t
+  static auto calculate_mip_levels(std::uint32_t width, std::uint32_t height)
+    -> std::uint32_t
   {
     return static_cast<std::uint32_t>(
       std::floor(std::log2(std::max(width, height))) + 1);
   }
 };
 
-template<typename T>
+/// Index of the job for texture_path in role, registering it on first use.
+/// A file used in two roles, like a packed metal/roughness map, is two jobs.
+/// Jobs are numbered in the order materials refer to them, whatever order
+/// they later finish in.
 auto
-add_unique_texture(std::vector<T>& textures,
-                   std::unordered_map<std::string, std::int32_t>& path_map,
+add_unique_texture(TextureCache& cache,
                    const std::string& texture_path,
-                   auto& mutex,
-                   const aiScene* scene) -> std::int32_t
+                   LoadedTextureType role) -> std::int32_t
 {
   if (texture_path.empty()) {
     return -1;
   }
 
-  auto it = path_map.find(texture_path);
-  if (it != path_map.end()) {
-    return it->second;
+  const auto [it, inserted] = cache.path_to_job.try_emplace(
+    std::pair{ texture_path, role },
+    static_cast<std::int32_t>(cache.jobs.size()));
+  if (inserted) {
+    cache.jobs.push_back(TextureJob{
+      .path = texture_path,
+      .role = role,
+    });
   }
+  return it->second;
+}
 
-  const aiTexture* ai_texture = nullptr;
-  if (texture_path.starts_with("*")) {
-    try {
-      int texture_index = std::stoi(texture_path.substr(1));
-      if (texture_index >= 0 &&
-          texture_index < static_cast<int>(scene->mNumTextures)) {
-        ai_texture = scene->mTextures[texture_index];
+/// Decodes, mips, encodes and serialises every registered texture on the
+/// pool, each stage a task of its own, and fills cache.textures. Textures
+/// with identical contents are processed once. Returns, per job, the index
+/// into cache.textures, or -1 where the texture could not be imported.
+auto
+import_textures(TextureCache& cache,
+                const aiScene* scene,
+                ThreadPool& workers,
+                const TextureEncodePreset preset) -> std::vector<std::int32_t>
+{
+  auto& jobs = cache.jobs;
+
+  // Each decoded image holds a slot until it is found to be a duplicate or
+  // its mip chain is built, which bounds the memory of a large scene to a
+  // few images per thread rather than all of them.
+  const auto max_live_images = std::ptrdiff_t{ 2 } * workers.thread_count();
+  std::counting_semaphore<> live_images{ max_live_images };
+
+  std::vector<std::future<void>> decoded(jobs.size());
+  const auto decode = [&](const std::size_t i) {
+    decoded[i] = workers.submit([&job = jobs[i], scene] {
+      run_stage(job.image, [&job, scene] {
+        job.image = TextureProcessor::decode_texture(job.path, scene);
+      });
+      if (job.image) {
+        // Roles that encode the same way share one texture.
+        const auto encoding = texture_encoding(job.role);
+        job.content_hash = Fnv1a64{}
+                             .update_value(encoding.source_format)
+                             .update_value(encoding.mip_content)
+                             .update_value(encoding.target)
+                             .update_value(encoding.channel)
+                             .update_value(job.image->width)
+                             .update_value(job.image->height)
+                             .update(std::span{ job.image->rgba })
+                             .digest();
       }
-    } catch (const std::exception&) {
-      return -1;
+    });
+  };
+
+  // Basis threads its own encodes; split the pool's threads between the
+  // textures so that a few large ones still use every core.
+  const auto encode_threads = std::max(
+    1U,
+    workers.thread_count() /
+      std::max(1U, static_cast<std::uint32_t>(jobs.size())));
+
+  // Resolved in job order, so which copy of a duplicate survives never
+  // depends on scheduling. Every job maps to the job whose output it will
+  // use. Equal hashes are taken as equal images, so that a duplicate is
+  // freed as soon as it is hashed.
+  constexpr auto no_job = std::numeric_limits<std::size_t>::max();
+  std::vector<std::size_t> source_job(jobs.size(), no_job);
+  std::unordered_map<std::uint64_t, std::size_t> first_with_hash;
+  std::size_t submitted{ 0 };
+  for (auto i = 0ULL; i < jobs.size(); ++i) {
+    // Job i has to be decoding before it can be resolved; past it, decode
+    // ahead while there are slots. Only this thread waits for slots, and
+    // the workers free them without waiting on anything.
+    if (submitted == i) {
+      live_images.acquire();
+      decode(submitted++);
     }
-  } else {
-    std::filesystem::path full_path = texture_path;
-    if (!std::filesystem::exists(full_path)) {
-      return -1;
+    while (submitted < jobs.size() && live_images.try_acquire()) {
+      decode(submitted++);
     }
+    decoded[i].get();
 
-    auto processed_result =
-      TextureProcessor::process_external_texture(full_path,
-                                                 texture_path,
-                                                 true, // generate_mipmaps
-                                                 1.0f  // quality
-      );
-
-    if (!processed_result) {
-      return -1;
+    auto& job = jobs[i];
+    if (!job.image) {
+      std::cerr << std::format(
+        "Could not import texture {}: {}\n", job.path, job.image.error());
+      live_images.release();
+      continue;
     }
-
-    std::lock_guard lock(mutex);
-    const auto index = static_cast<std::uint32_t>(textures.size());
-    textures.emplace_back(std::move(processed_result.value()));
-    path_map[texture_path] = index;
-    return index;
+    const auto [it, inserted] =
+      first_with_hash.try_emplace(job.content_hash, i);
+    if (!inserted) {
+      source_job[i] = it->second;
+      job.image = DecodedImage{};
+      live_images.release();
+      continue;
+    }
+    source_job[i] = i;
+
+    workers.submit([&workers, &live_images, &job, preset, encode_threads] {
+      run_stage(job.texture, [&job] {
+        job.texture = TextureProcessor::create_mip_chain(
+          *job.image, job.path, texture_encoding(job.role), true);
+      });
+      job.image = DecodedImage{};
+      live_images.release();
+      if (!job.texture) {
+        return;
+      }
+      workers.submit([&workers, &job, preset, encode_threads] {
+        const auto start = std::chrono::steady_clock::now();
+        run_stage(job.texture, [&job, preset, encode_threads] {
+          if (auto encoded =
+                TextureProcessor::encode(*job.texture,
+                                         texture_encoding(job.role),
+                                         preset,
+                                         encode_threads);
+              !encoded) {
+            job.texture = std::unexpected(encoded.error());
+          }
+        });
+        if (!job.texture) {
+          return;
+        }
+        const std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+        std::cout << std::format("Encoded {} ({}x{}, {} mips) in {:.1f} ms\n",
+                                 job.path,
+                                 job.texture->width,
+                                 job.texture->height,
+                                 job.texture->mip_levels,
+                                 elapsed.count());
+
+        workers.submit([&job] {
+          run_stage(job.container, [&job] {
+            job.container = TextureProcessor::serialize(*job.texture);
+          });
+        });
+      });
+    });
   }
-
-  if (ai_texture) {
-    auto processed_result = TextureProcessor::process_assimp_texture(
-      ai_texture, texture_path, true, 1.0F);
-
-    if (!processed_result) {
-      return -1;
+  workers.wait_idle();
+
+  std::vector<std::int32_t> texture_of_job(jobs.size(), -1);
+  for (auto i = 0ULL; i < jobs.size(); ++i) {
+    auto& job = jobs[i];
+    if (source_job[i] != i) {
+      if (source_job[i] != no_job) {
+        texture_of_job[i] = texture_of_job[source_job[i]];
+      }
+    } else if (!job.texture || !job.container) {
+      std::cerr << std::format(
+        "Could not import texture {}: {}\n",
+        job.path,
+        !job.texture ? job.texture.error() : job.container.error());
+    } else {
+      texture_of_job[i] = static_cast<std::int32_t>(cache.textures.size());
+      cache.textures.push_back(std::move(*job.texture));
+      cache.containers.push_back(std::move(*job.container));
     }
-
-    std::lock_guard lock(mutex);
-    const auto index = static_cast<std::uint32_t>(textures.size());
-    textures.emplace_back(std::move(processed_result.value()));
-    path_map[texture_path] = index;
-    return index;
   }
-
-  return -1;
+  return texture_of_job;
 }
 
 }
@@ -323,13 +647,66 @@ read_into(std::istream& stream, T& output) -> bool
     stream.read(std::bit_cast<char*>(&output), sizeof(T)));
 }
 
+/// Bounds-checked reads from the front of a mapped section.
+class SectionReader
+{
+public:
+  explicit SectionReader(const std::span<const std::byte> b)
+    : bytes(b)
+  {
+  }
+
+  template<typename T>
+    requires std::is_trivially_copyable_v<T>
+  auto read(T& output) -> bool
+  {
+    const auto source = take(sizeof(T));
+    if (source) {
+      std::memcpy(&output, source->data(), sizeof(T));
+    }
+    return source.has_value();
+  }
+
+  auto take(const std::size_t count)
+    -> std::optional<std::span<const std::byte>>
+  {
+    if (count > bytes.size() - offset) {
+      return std::nullopt;
+    }
+    const auto result = bytes.subspan(offset, count);
+    offset += count;
+    return result;
+  }
+
+private:
+  std::span<const std::byte> bytes;
+  std::size_t offset{ 0 };
+};
+
+/// Points output at a section of the mapped file, after checking that it
+/// lies inside the file and holds whole, aligned Ts.
 template<typename T>
-bool
-read_into(std::istream& stream, std::span<T> out)
+  requires std::is_trivially_copyable_v<T>
+auto
+view_section(const std::span<const std::byte> file,
+             const MeshFileHeader& header,
+             const MeshFileSection which,
+             std::span<const T>& output) -> std::expected<void, std::string>
 {
-  static_assert(std::is_trivially_copyable_v<T>);
-  return static_cast<bool>(
-    stream.read(reinterpret_cast<char*>(out.data()), out.size_bytes()));
+  const auto& section = header.section(which);
+  if (section.offset > file.size() ||
+      section.size > file.size() - section.offset) {
+    return std::unexpected(std::format(
+      "Mesh file section {} lies outside the file", std::to_underlying(which)));
+  }
+  const auto* data = file.data() + section.offset;
+  if (section.size % sizeof(T) != 0 ||
+      std::bit_cast<std::uintptr_t>(data) % alignof(T) != 0) {
+    return std::unexpected(std::format("Mesh file section {} is misaligned",
+                                       std::to_underlying(which)));
+  }
+  output = { reinterpret_cast<const T*>(data), section.size / sizeof(T) };
+  return {};
 }
 
 auto
@@ -363,8 +740,94 @@ template<typename T>
 auto
 write_to(std::ostream& output, const std::span<T>& out) -> bool
 {
-  return static_cast<bool>(
-    output.write(reinterpret_cast<char*>(out.data()), out.size_bytes()));
+  return static_cast<bool>(output.write(
+    reinterpret_cast<const char*>(out.data()), out.size_bytes()));
+}
+
+auto
+align_up(const std::uint64_t offset) -> std::uint64_t
+{
+  constexpr auto alignment = MeshFileHeader::section_alignment;
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/// Zero-fills the stream up to offset, where the next section starts.
+auto
+pad_to(std::ostream& output, const std::uint64_t offset) -> bool
+{
+  static constexpr std::array<char, MeshFileHeader::section_alignment>
+    zeroes{};
+  const auto position = static_cast<std::uint64_t>(output.tellp());
+  if (position > offset || offset - position > zeroes.size()) {
+    return false;
+  }
+  const auto count = static_cast<std::streamsize>(offset - position);
+  return static_cast<bool>(output.write(zeroes.data(), count));
+}
+
+/// Relative paths of the external buffers and images a glTF, or the JSON
+/// chunk of a GLB, references. Embedded data: URIs are skipped. Scans for
+/// "uri" keys rather than parsing, which is all the cache check needs.
+auto
+gltf_external_uris(const std::span<const std::byte> file)
+  -> std::vector<std::string>
+{
+  const std::string_view text{ reinterpret_cast<const char*>(file.data()),
+                               file.size() };
+  const auto hex = [](const char c) -> int {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    return -1;
+  };
+  const auto skip_space = [&text](std::size_t at) {
+    while (at < text.size() &&
+           (text[at] == ' ' || text[at] == '\t' || text[at] == '\n' ||
+            text[at] == '\r')) {
+      ++at;
+    }
+    return at;
+  };
+
+  std::vector<std::string> uris;
+  constexpr std::string_view key = "\"uri\"";
+  for (auto at = text.find(key); at != std::string_view::npos;
+       at = text.find(key, at)) {
+    at = skip_space(at + key.size());
+    if (at >= text.size() || text[at] != ':') {
+      continue;
+    }
+    at = skip_space(at + 1);
+    if (at >= text.size() || text[at] != '"') {
+      continue;
+    }
+
+    // JSON escapes first, then the percent-encoding of the URI itself.
+    std::string uri;
+    for (++at; at < text.size() && text[at] != '"'; ++at) {
+      if (text[at] == '\\' && at + 1 < text.size()) {
+        ++at;
+      }
+      if (text[at] == '%' && at + 2 < text.size() &&
+          hex(text[at + 1]) >= 0 && hex(text[at + 2]) >= 0) {
+        uri.push_back(
+          static_cast<char>(hex(text[at + 1]) * 16 + hex(text[at + 2])));
+        at += 2;
+        continue;
+      }
+      uri.push_back(text[at]);
+    }
+    if (!uri.starts_with("data:")) {
+      uris.push_back(std::move(uri));
+    }
+  }
+  return uris;
 }
 
 template<typename T>
@@ -382,7 +845,8 @@ write_to(std::vector<std::uint8_t>& output, const T& data) -> bool
 auto
 process_lods(const std::vector<std::uint32_t>& source_indices,
              const std::vector<float>& source_vertices,
-             std::vector<std::vector<std::uint32_t>>& output_lods) -> void
+             std::vector<std::vector<std::uint32_t>>& output_lods,
+             std::vector<float>& output_errors) -> void
 {
   if (source_indices.empty() || source_vertices.empty()) {
     return;
@@ -392,20 +856,25 @@ process_lods(const std::vector<std::uint32_t>& source_indices,
   const size_t index_count = source_indices.size();
 
   output_lods.clear();
+  output_errors.clear();
 
   std::vector<std::uint32_t> lod0_indices(index_count);
   meshopt_optimizeVertexCache(
     lod0_indices.data(), source_indices.data(), index_count, vertex_count);
   output_lods.push_back(std::move(lod0_indices));
+  output_errors.push_back(0.0f);
 
-  std::vector<std::uint32_t> current_indices = source_indices;
-  const float lod_reduction_rates[] = { 0.75f, 0.5f, 0.25f, 0.1f };
-  const float target_errors[] = { 0.01f, 0.05f, 0.1f, 0.2f };
+  // meshopt_simplify reports errors relative to the mesh extents.
+  const float error_scale = meshopt_simplifyScale(
+    source_vertices.data(), vertex_count, sizeof(float) * 3);
+  float accumulated_error = 0.0f;
 
-  for (size_t lod_index = 0; lod_index < 4; ++lod_index) {
+  std::vector<std::uint32_t> current_indices = source_indices;
+  for (size_t lod_index = 0; lod_index < lod_reduction_rates.size();
+       ++lod_index) {
     const size_t target_index_count = static_cast<size_t>(
       source_indices.size() * lod_reduction_rates[lod_index]);
-    const float target_error = target_errors[lod_index];
+    const float target_error = lod_target_errors[lod_index];
 
     if (target_index_count < 6) {
       break;
@@ -413,6 +882,7 @@ process_lods(const std::vector<std::uint32_t>& source_indices,
 
     // Simplify mesh
     std::vector<std::uint32_t> simplified_indices(current_indices.size());
+    float result_error = 0.0f;
     const size_t result_count = meshopt_simplify(simplified_indices.data(),
                                                  current_indices.data(),
                                                  current_indices.size(),
@@ -420,7 +890,9 @@ process_lods(const std::vector<std::uint32_t>& source_indices,
                                                  vertex_count,
                                                  sizeof(float) * 3, // stride
                                                  target_index_count,
-                                                 target_error);
+                                                 target_error,
+                                                 0,
+                                                 &result_error);
 
     if (result_count == 0 || result_count >= current_indices.size()) {
       break; // No further simplification possible
@@ -436,22 +908,102 @@ process_lods(const std::vector<std::uint32_t>& source_indices,
                                 result_count,
                                 vertex_count);
 
+    // Each LOD simplifies the previous one, so their errors add up.
+    accumulated_error += result_error;
     output_lods.push_back(std::move(optimized_indices));
+    output_errors.push_back(accumulated_error * error_scale);
     current_indices = simplified_indices;
   }
 
   // Ensure we have at least one LOD
   if (output_lods.empty()) {
     output_lods.push_back(source_indices);
+    output_errors.push_back(0.0f);
+  }
+}
+
+auto
+build_meshlets(const std::vector<std::uint32_t>& indices,
+               const std::vector<float>& source_vertices,
+               ConvertedMesh& output) -> void
+{
+  const auto vertex_count = source_vertices.size() / 3;
+  const auto max_meshlets = meshopt_buildMeshletsBound(
+    indices.size(), max_meshlet_vertices, max_meshlet_triangles);
+
+  std::vector<meshopt_Meshlet> meshlets(max_meshlets);
+  std::vector<std::uint32_t> meshlet_vertices(max_meshlets *
+                                              max_meshlet_vertices);
+  std::vector<std::uint8_t> meshlet_triangles(max_meshlets *
+                                              max_meshlet_triangles * 3);
+  meshlets.resize(meshopt_buildMeshlets(meshlets.data(),
+                                        meshlet_vertices.data(),
+                                        meshlet_triangles.data(),
+                                        indices.data(),
+                                        indices.size(),
+                                        source_vertices.data(),
+                                        vertex_count,
+                                        sizeof(float) * 3,
+                                        max_meshlet_vertices,
+                                        max_meshlet_triangles,
+                                        meshlet_cone_weight));
+
+  std::vector<std::uint32_t> cluster_indices;
+  for (const auto& meshlet : meshlets) {
+    auto* local_vertices = &meshlet_vertices[meshlet.vertex_offset];
+    auto* local_triangles = &meshlet_triangles[meshlet.triangle_offset];
+    meshopt_optimizeMeshlet(local_vertices,
+                            local_triangles,
+                            meshlet.triangle_count,
+                            meshlet.vertex_count);
+
+    // aiProcess_FlipWindingOrder reversed every triangle; the cone is
+    // computed on the original winding so that its axis points outwards.
+    cluster_indices.clear();
+    for (auto i = 0U; i < meshlet.triangle_count * 3; i += 3) {
+      cluster_indices.push_back(local_vertices[local_triangles[i]]);
+      cluster_indices.push_back(local_vertices[local_triangles[i + 2]]);
+      cluster_indices.push_back(local_vertices[local_triangles[i + 1]]);
+    }
+    const auto bounds = meshopt_computeClusterBounds(cluster_indices.data(),
+                                                     cluster_indices.size(),
+                                                     source_vertices.data(),
+                                                     vertex_count,
+                                                     sizeof(float) * 3);
+
+    output.meshlets.push_back(Meshlet{
+      .bounding_sphere = { glm::make_vec3(bounds.center), bounds.radius },
+      .cone_axis_cutoff = { glm::make_vec3(bounds.cone_axis),
+                            bounds.cone_cutoff },
+      .cone_apex = glm::make_vec3(bounds.cone_apex),
+      .mesh_index = 0,
+      .vertex_offset =
+        static_cast<std::uint32_t>(output.meshlet_vertices.size()),
+      .triangle_offset =
+        static_cast<std::uint32_t>(output.meshlet_triangles.size()),
+      .vertex_count = meshlet.vertex_count,
+      .triangle_count = meshlet.triangle_count,
+    });
+
+    for (auto i = 0U; i < meshlet.vertex_count; ++i) {
+      output.meshlet_vertices.push_back(local_vertices[i]);
+    }
+    // Padded so that the shader can read every meshlet as whole words.
+    output.meshlet_triangles.insert(output.meshlet_triangles.end(),
+                                    local_triangles,
+                                    local_triangles +
+                                      meshlet.triangle_count * 3);
+    output.meshlet_triangles.resize(
+      (output.meshlet_triangles.size() + 3) & ~std::size_t{ 3 });
   }
 }
 
+}
+
 auto
-convert_assimp_mesh_to_mesh(const aiMesh& mesh,
-                            MeshData& output,
-                            std::uint32_t& index_offset,
-                            std::uint32_t& vertex_offset) -> Mesh
+convert_assimp_mesh_to_mesh(const aiMesh& mesh) -> ConvertedMesh
 {
+  ConvertedMesh output{};
   const auto has_tex_coords = mesh.HasTextureCoords(0);
   const auto has_tangent_space = mesh.HasTangentsAndBitangents();
   const auto has_normals = mesh.HasNormals();
@@ -459,6 +1011,7 @@ convert_assimp_mesh_to_mesh(const aiMesh& mesh,
   std::vector<std::uint32_t> source_indices;
   auto& vertices = output.vertex_data;
   std::vector<std::vector<std::uint32_t>> out_lods;
+  std::vector<float> out_lod_errors;
   auto tex_span = has_tex_coords
                     ? std::span{ mesh.mTextureCoords[0], mesh.mNumVertices }
                     : std::span<aiVector3D>{};
@@ -540,11 +1093,12 @@ convert_assimp_mesh_to_mesh(const aiMesh& mesh,
       source_indices.push_back(mesh.mFaces[i].mIndices[j]);
   }
 
-  process_lods(source_indices, source_vertices, out_lods);
+  process_lods(source_indices, source_vertices, out_lods, out_lod_errors);
 
-  Mesh result{
-    .index_offset = index_offset,
-    .vertex_offset = vertex_offset,
+  auto& result = output.mesh;
+  result = Mesh{
+    .index_offset = 0,
+    .vertex_offset = 0,
     .vertex_count = mesh.mNumVertices,
     .material_id = mesh.mMaterialIndex,
   };
@@ -554,21 +1108,102 @@ convert_assimp_mesh_to_mesh(const aiMesh& mesh,
       output.index_data.push_back(out_lods[lod_choice][lod]);
     }
     result.lod_offset[lod_choice] = num_indices;
+    result.lod_error[lod_choice] = out_lod_errors[lod_choice];
     num_indices += static_cast<std::uint32_t>(out_lods[lod_choice].size());
   }
   result.lod_offset[out_lods.size()] = num_indices;
   result.lod_count = static_cast<std::uint32_t>(out_lods.size());
 
-  index_offset += num_indices;
-  vertex_offset += mesh.mNumVertices;
+  // Every LOD gets its own meshlets, so the task shader draws whichever one
+  // the culling pass picks.
+  for (auto lod = 0ULL; lod < out_lods.size(); lod++) {
+    result.lod_meshlet_offset[lod] =
+      static_cast<std::uint32_t>(output.meshlets.size());
+    build_meshlets(out_lods[lod], source_vertices, output);
+  }
+  result.lod_meshlet_offset[out_lods.size()] =
+    static_cast<std::uint32_t>(output.meshlets.size());
+
+  return output;
+}
+
+auto
+append_converted_meshes(std::vector<ConvertedMesh>& converted,
+                        MeshData& output) -> void
+{
+  std::size_t vertex_bytes = 0;
+  std::size_t index_count = 0;
+  std::size_t meshlet_count = 0;
+  std::size_t meshlet_vertex_count = 0;
+  std::size_t meshlet_triangle_bytes = 0;
+  for (const auto& part : converted) {
+    vertex_bytes += part.vertex_data.size();
+    index_count += part.index_data.size();
+    meshlet_count += part.meshlets.size();
+    meshlet_vertex_count += part.meshlet_vertices.size();
+    meshlet_triangle_bytes += part.meshlet_triangles.size();
+  }
+  output.vertex_data.reserve(output.vertex_data.size() + vertex_bytes);
+  output.index_data.reserve(output.index_data.size() + index_count);
+  output.meshlets.reserve(output.meshlets.size() + meshlet_count);
+  output.meshlet_vertices.reserve(output.meshlet_vertices.size() +
+                                  meshlet_vertex_count);
+  output.meshlet_triangles.reserve(output.meshlet_triangles.size() +
+                                   meshlet_triangle_bytes);
+
+  auto index_offset = static_cast<std::uint32_t>(output.index_data.size());
+  auto vertex_offset =
+    output.meshes.empty()
+      ? 0U
+      : output.meshes.back().vertex_offset + output.meshes.back().vertex_count;
+  for (auto& part : converted) {
+    auto mesh = part.mesh;
+    mesh.index_offset = index_offset;
+    mesh.vertex_offset = vertex_offset;
+    const auto meshlet_base =
+      static_cast<std::uint32_t>(output.meshlets.size());
+    for (auto lod = 0U; lod <= mesh.lod_count; ++lod) {
+      mesh.lod_meshlet_offset[lod] += meshlet_base;
+    }
 
-  return result;
+    const auto mesh_index = static_cast<std::uint32_t>(output.meshes.size());
+    const auto meshlet_vertex_base =
+      static_cast<std::uint32_t>(output.meshlet_vertices.size());
+    const auto meshlet_triangle_base =
+      static_cast<std::uint32_t>(output.meshlet_triangles.size());
+    for (auto meshlet : part.meshlets) {
+      meshlet.mesh_index = mesh_index;
+      meshlet.vertex_offset += meshlet_vertex_base;
+      meshlet.triangle_offset += meshlet_triangle_base;
+      output.meshlets.push_back(meshlet);
+    }
+    for (const auto vertex : part.meshlet_vertices) {
+      output.meshlet_vertices.push_back(vertex + vertex_offset);
+    }
+
+    output.vertex_data.insert(output.vertex_data.end(),
+                              part.vertex_data.begin(),
+                              part.vertex_data.end());
+    output.index_data.insert(output.index_data.end(),
+                             part.index_data.begin(),
+                             part.index_data.end());
+    output.meshlet_triangles.insert(output.meshlet_triangles.end(),
+                                    part.meshlet_triangles.begin(),
+                                    part.meshlet_triangles.end());
+    output.vertex_streams = part.vertex_streams;
+    output.meshes.push_back(mesh);
+
+    index_offset += static_cast<std::uint32_t>(part.index_data.size());
+    vertex_offset += mesh.vertex_count;
+    part = {};
+  }
 }
 
+namespace {
+
 auto
 convert_assimp_material_to_material(const aiMaterial& material,
-                                    TextureCache& texture_cache,
-                                    const aiScene* scene) -> Material
+                                    TextureCache& texture_cache) -> Material
 {
   Material output{};
 
@@ -584,89 +1219,37 @@ convert_assimp_material_to_material(const aiMaterial& material,
     output.albedo_factor.w = glm::clamp(output.albedo_factor.w, 0.0F, 1.0F);
   }
 
-  aiString path;
-  aiTextureMapping mapping;
-  std::uint32_t uv_index = 0;
-  float blend = 1.0f;
-  aiTextureOp texture_op = aiTextureOp_Add;
-  std::array<aiTextureMapMode, 2> texture_map_mode = { aiTextureMapMode_Wrap,
-                                                       aiTextureMapMode_Wrap };
-  std::uint32_t texture_flags = 0;
-
-  if (aiGetMaterialTexture(&material,
-                           aiTextureType_EMISSIVE,
-                           0,
-                           &path,
-                           &mapping,
-                           &uv_index,
-                           &blend,
-                           &texture_op,
-                           texture_map_mode.data(),
-                           &texture_flags) == AI_SUCCESS) {
-    output.emissive_texture_index =
-      add_unique_texture(texture_cache.textures,
-                         texture_cache.texture_path_to_index,
-                         path.C_Str(),
-                         texture_cache.textures_mutex,
-
-                         scene);
-  }
-
-  if (aiGetMaterialTexture(&material,
-                           aiTextureType_DIFFUSE,
-                           0,
-                           &path,
-                           &mapping,
-                           &uv_index,
-                           &blend,
-                           &texture_op,
-                           texture_map_mode.data(),
-                           &texture_flags) == AI_SUCCESS) {
-    output.albedo_texture_index =
-      add_unique_texture(texture_cache.textures,
-                         texture_cache.texture_path_to_index,
-                         path.C_Str(),
-                         texture_cache.textures_mutex,
-
-                         scene);
-  }
-
-  if (aiGetMaterialTexture(&material,
-                           aiTextureType_NORMALS,
-                           0,
-                           &path,
-                           &mapping,
-                           &uv_index,
-                           &blend,
-                           &texture_op,
-                           texture_map_mode.data(),
-                           &texture_flags) == AI_SUCCESS) {
-    output.normal_texture_index =
-      add_unique_texture(texture_cache.textures,
-                         texture_cache.texture_path_to_index,
-                         path.C_Str(),
-                         texture_cache.textures_mutex,
-
-                         scene);
-  }
-
-  if ((output.normal_texture_index == 0) &&
-      (aiGetMaterialTexture(&material,
-                            aiTextureType_HEIGHT,
-                            0,
-                            &path,
-                            &mapping,
-                            &uv_index,
-                            &blend,
-                            &texture_op,
-                            texture_map_mode.data(),
-                            &texture_flags) == AI_SUCCESS)) {
+  // The material's first texture of type, registered for role; -1 when it
+  // has none.
+  const auto find_texture = [&](const aiTextureType type,
+                                const LoadedTextureType role) {
+    aiString path;
+    if (aiGetMaterialTexture(&material, type, 0, &path) != AI_SUCCESS) {
+      return std::int32_t{ -1 };
+    }
+    return add_unique_texture(texture_cache, path.C_Str(), role);
+  };
+
+  output.emissive_texture_index =
+    find_texture(aiTextureType_EMISSIVE, LoadedTextureType::Emissive);
+  output.albedo_texture_index =
+    find_texture(aiTextureType_DIFFUSE, LoadedTextureType::Diffuse);
+  output.normal_texture_index =
+    find_texture(aiTextureType_NORMALS, LoadedTextureType::Normals);
+  if (output.normal_texture_index < 0) {
     output.normal_texture_index =
-      add_unique_texture(texture_cache.textures,
-                         texture_cache.texture_path_to_index,
-                         path.C_Str(),
-                         texture_cache.textures_mutex,
-                         scene);
+      find_texture(aiTextureType_HEIGHT, LoadedTextureType::Height);
+  }
+  output.roughness_texture_index =
+    find_texture(aiTextureType_DIFFUSE_ROUGHNESS, LoadedTextureType::Roughness);
+  output.metallic_texture_index =
+    find_texture(aiTextureType_METALNESS, LoadedTextureType::Metalness);
+  // glTF occlusion maps come through as lightmaps.
+  output.ao_texture_index = find_texture(aiTextureType_AMBIENT_OCCLUSION,
+                                         LoadedTextureType::AmbientOcclusion);
+  if (output.ao_texture_index < 0) {
+    output.ao_texture_index =
+      find_texture(aiTextureType_LIGHTMAP, LoadedTextureType::AmbientOcclusion);
   }
 
   return output;
@@ -697,44 +1280,74 @@ recalculate_bounding_boxes(MeshData& output) -> void
     output.aabbs.emplace_back(std::move(box));
   }
 }
+
+// Matches Submesh in mesh_culling.glsl.
+struct GPUSubmesh
+{
+  glm::vec4 minimum;
+  glm::vec4 maximum;
+  std::uint32_t index_offset;
+  std::uint32_t lod_count;
+  std::array<std::uint32_t, max_lods + 1> lod_offset;
+  std::array<float, max_lods> lod_error;
+  std::uint32_t lod;
+  std::uint32_t visible;
+  std::array<std::uint32_t, max_lods + 1> lod_meshlet_offset;
+  // std430 rounds Submesh up to the 16 byte alignment of its vec4s.
+  std::array<std::uint32_t, 2> padding;
+};
+static_assert(sizeof(GPUSubmesh) == 160,
+              "GPUSubmesh must match the std430 layout of Submesh");
 }
 
 auto
 MeshFile::preload_mesh(const std::filesystem::path& path,
-                       const std::filesystem::path& cache_directory) -> bool
+                       const std::filesystem::path& cache_directory,
+                       const TextureEncodePreset preset) -> bool
 {
-  if (std::filesystem::is_regular_file(cache_directory / path.filename()))
+  const auto cache_path = cache_directory / path.filename();
+  if (is_cache_current(path, cache_path, preset)) {
     return true;
+  }
+  if (std::filesystem::exists(cache_path)) {
+    std::cout << std::format("Rebuilding stale mesh cache {}\n",
+                             cache_path.string());
+  }
 
-  const std::uint32_t flags =
-    aiProcess_JoinIdenticalVertices | aiProcess_Triangulate |
-    aiProcess_GenSmoothNormals | aiProcess_LimitBoneWeights |
-    aiProcess_SplitLargeMeshes | aiProcess_ImproveCacheLocality |
-    aiProcess_RemoveRedundantMaterials | aiProcess_FindDegenerates |
-    aiProcess_FindInvalidData | aiProcess_GenUVCoords | aiProcess_FlipUVs |
-    aiProcess_FlipWindingOrder | aiProcess_CalcTangentSpace |
-    aiProcess_GlobalScale;
+  const auto source_hash = compute_source_hash(path, preset);
+  if (!source_hash) {
+    std::cerr << std::format("Could not import {}: {}\n",
+                             path.string(),
+                             source_hash.error());
+    return false;
+  }
 
   Assimp::Importer importer{};
   const aiScene* scene{ nullptr };
-  if (scene = importer.ReadFile(path.string().c_str(), flags);
+  if (scene = importer.ReadFile(path.string().c_str(), import_flags);
       nullptr == scene) {
     return false;
   }
 
-  MeshFile mesh_file{};
-  auto& mesh_data = mesh_file.mesh_data;
-  auto& header = mesh_file.header;
+  MeshData mesh_data{};
+  MeshFileHeader header{};
 
   mesh_data.meshes.reserve(scene->mNumMeshes);
   mesh_data.aabbs.reserve(scene->mNumMeshes);
 
-  std::uint32_t index_offset{ 0 };
-  std::uint32_t vertex_offset{ 0 };
+  // Meshes and textures share one pool, so a large scene never has more
+  // threads than cores.
+  ThreadPool workers;
+
+  // Every mesh converts into its own buffers; offsets are only assigned
+  // afterwards, in scene order, so the file matches a serial conversion.
+  std::vector<ConvertedMesh> converted(scene->mNumMeshes);
+  std::vector<std::future<void>> mesh_jobs;
+  mesh_jobs.reserve(scene->mNumMeshes);
   for (auto i = 0U; i < scene->mNumMeshes; i++) {
-    const auto& ai_mesh = *scene->mMeshes[i];
-    mesh_data.meshes.push_back(convert_assimp_mesh_to_mesh(
-      ai_mesh, mesh_data, index_offset, vertex_offset));
+    mesh_jobs.push_back(workers.submit([&converted, scene, i] {
+      converted[i] = convert_assimp_mesh_to_mesh(*scene->mMeshes[i]);
+    }));
   }
 
   auto texture_cache_dir = cache_directory / "textures";
@@ -743,25 +1356,44 @@ MeshFile::preload_mesh(const std::filesystem::path& path,
     std::filesystem::create_directories(texture_cache_dir, ec);
   }
 
+  // Materials only register their textures, which keeps this loop cheap
+  // and the texture indices in material order.
   TextureCache texture_cache;
-  std::vector<std::future<Material>> futures;
-  futures.reserve(scene->mNumMaterials);
-
+  mesh_data.materials.reserve(scene->mNumMaterials);
   for (auto i = 0U; i < scene->mNumMaterials; i++) {
-    const auto& ai_material = *scene->mMaterials[i];
-    futures.push_back(std::async(std::launch::async, [&]() {
-      return convert_assimp_material_to_material(
-        ai_material, texture_cache, scene);
-    }));
+    mesh_data.materials.push_back(convert_assimp_material_to_material(
+      *scene->mMaterials[i], texture_cache));
+  }
+  const auto texture_of_job =
+    import_textures(texture_cache, scene, workers, preset);
+  for (auto& material : mesh_data.materials) {
+    for (auto* index : { &material.albedo_texture_index,
+                         &material.normal_texture_index,
+                         &material.roughness_texture_index,
+                         &material.metallic_texture_index,
+                         &material.ao_texture_index,
+                         &material.emissive_texture_index }) {
+      if (*index >= 0) {
+        *index = texture_of_job[*index];
+      }
+    }
   }
 
-  for (auto& fut : futures) {
-    mesh_data.materials.push_back(fut.get());
+  for (auto& job : mesh_jobs) {
+    job.get();
   }
+  append_converted_meshes(converted, mesh_data);
 
   recalculate_bounding_boxes(mesh_data);
 
   header.mesh_count = static_cast<std::uint32_t>(mesh_data.meshes.size());
+  header.source_hash = *source_hash;
+  if (!mesh_data.meshlets.empty()) {
+    header.flags |= MeshFileFlags::Meshlets;
+  }
+  if (!texture_cache.textures.empty()) {
+    header.flags |= MeshFileFlags::Textures;
+  }
   header.index_data_size = std::span(mesh_data.index_data).size_bytes();
   header.vertex_data_size = std::span(mesh_data.vertex_data).size_bytes();
   mesh_data.textures = std::move(texture_cache.textures);
@@ -774,31 +1406,66 @@ MeshFile::preload_mesh(const std::filesystem::path& path,
     }
   }
 
-  std::ofstream output_file{ cache_directory / path.filename(),
-                             std::ios::out | std::ios::binary };
+  // Everything but the textures has a known size, so the sections are laid
+  // out up front; the textures go last and their size is patched in.
+  const auto vertex_streams = std::span{ &mesh_data.vertex_streams, 1 };
+  std::uint64_t end_of_sections = sizeof(MeshFileHeader);
+  const auto place = [&](const MeshFileSection which, const auto& data) {
+    auto& section = header.section(which);
+    section.offset = align_up(end_of_sections);
+    section.size = as_bytes(data).size();
+    end_of_sections = section.offset + section.size;
+  };
+  place(MeshFileSection::VertexStreams, vertex_streams);
+  place(MeshFileSection::Meshes, mesh_data.meshes);
+  place(MeshFileSection::BoundingBoxes, mesh_data.aabbs);
+  place(MeshFileSection::IndexData, mesh_data.index_data);
+  place(MeshFileSection::VertexData, mesh_data.vertex_data);
+  place(MeshFileSection::Meshlets, mesh_data.meshlets);
+  place(MeshFileSection::MeshletVertices, mesh_data.meshlet_vertices);
+  place(MeshFileSection::MeshletTriangles, mesh_data.meshlet_triangles);
+  place(MeshFileSection::Materials, mesh_data.materials);
+  header.section(MeshFileSection::Textures).offset =
+    align_up(end_of_sections);
+
+  // Written next to the cache and renamed over it once complete, so an
+  // interrupted import never leaves a cache that looks current.
+  auto partial_path = cache_path;
+  partial_path += ".partial";
+  std::ofstream output_file{ partial_path, std::ios::out | std::ios::binary };
   if (!output_file) {
     return false;
   }
 #define WRITE_MAYBE(x)                                                         \
   if (!write_to(output_file, (x)))                                             \
     return false;
+#define WRITE_SECTION(which, x)                                                \
+  if (!pad_to(output_file, header.section(which).offset) ||                    \
+      !write_to(output_file, as_bytes(x)))                                     \
+    return false;
 
   WRITE_MAYBE(header);
-  WRITE_MAYBE(mesh_data.vertex_streams)
-  WRITE_MAYBE(std::span{ mesh_data.meshes });
-  WRITE_MAYBE(std::span{ mesh_data.aabbs });
-  WRITE_MAYBE(std::span{ mesh_data.index_data });
-  WRITE_MAYBE(std::span{ mesh_data.vertex_data });
-
-  const auto materials = std::span(mesh_data.materials);
-  WRITE_MAYBE(materials.size());
-  WRITE_MAYBE(materials.size_bytes());
-  WRITE_MAYBE(std::span{ materials });
+  WRITE_SECTION(MeshFileSection::VertexStreams, vertex_streams);
+  WRITE_SECTION(MeshFileSection::Meshes, mesh_data.meshes);
+  WRITE_SECTION(MeshFileSection::BoundingBoxes, mesh_data.aabbs);
+  WRITE_SECTION(MeshFileSection::IndexData, mesh_data.index_data);
+  WRITE_SECTION(MeshFileSection::VertexData, mesh_data.vertex_data);
+  WRITE_SECTION(MeshFileSection::Meshlets, mesh_data.meshlets);
+  WRITE_SECTION(MeshFileSection::MeshletVertices, mesh_data.meshlet_vertices);
+  WRITE_SECTION(MeshFileSection::MeshletTriangles,
+                mesh_data.meshlet_triangles);
+  WRITE_SECTION(MeshFileSection::Materials, mesh_data.materials);
+
+  auto& texture_section = header.section(MeshFileSection::Textures);
+  if (!pad_to(output_file, texture_section.offset)) {
+    return false;
+  }
 
   const auto textures = std::span(mesh_data.textures);
   WRITE_MAYBE(textures.size());
 
-  for (const auto& tex : textures) {
+  for (auto i = 0ULL; i < textures.size(); ++i) {
+    const auto& tex = textures[i];
     std::uint8_t has_tex = tex.ktx_texture ? 1 : 0;
     WRITE_MAYBE(has_tex);
 
@@ -817,22 +1484,84 @@ MeshFile::preload_mesh(const std::filesystem::path& path,
     WRITE_MAYBE(tex.height);
     WRITE_MAYBE(tex.mip_levels);
 
-    ktx_uint8_t* ktx_buffer = nullptr;
-    ktx_size_t ktx_size = 0;
-    KTX_error_code wc = ktxTexture_WriteToMemory(
-      ktxTexture(tex.ktx_texture.get()), &ktx_buffer, &ktx_size);
+    // write container size then container bytes
+    const auto container = texture_cache.containers[i].bytes();
+    WRITE_MAYBE(static_cast<std::uint64_t>(container.size()));
+    output_file.write(reinterpret_cast<const char*>(container.data()),
+                      static_cast<std::streamsize>(container.size()));
+  }
 
-    if (wc != KTX_SUCCESS) {
+  texture_section.size =
+    static_cast<std::uint64_t>(output_file.tellp()) - texture_section.offset;
+  output_file.seekp(0);
+  WRITE_MAYBE(header);
+#undef WRITE_SECTION
+#undef WRITE_MAYBE
+  output_file.close();
+  if (!output_file) {
+    return false;
+  }
+  std::filesystem::rename(partial_path, cache_path, ec);
+  return ec.value() == 0;
+}
 
-      return false;
+auto
+MeshFile::compute_source_hash(const std::filesystem::path& source,
+                              const TextureEncodePreset preset)
+  -> std::expected<std::uint64_t, std::string>
+{
+  auto mapped = MappedFile::open(source);
+  if (!mapped) {
+    return std::unexpected(std::move(mapped.error()));
+  }
+
+  Fnv1a64 hash;
+  hash.update(mapped->bytes());
+
+  // Buffers and images next to a glTF change without touching it. Their
+  // size and modification time stand in for their bytes.
+  if (const auto extension = source.extension();
+      extension == ".gltf" || extension == ".glb") {
+    for (const auto& uri : gltf_external_uris(mapped->bytes())) {
+      // Missing files hash as empty and change it again once they appear.
+      const auto resolved = source.parent_path() / uri;
+      std::error_code size_error;
+      std::error_code time_error;
+      const auto size = std::filesystem::file_size(resolved, size_error);
+      const auto written =
+        std::filesystem::last_write_time(resolved, time_error);
+      hash.update(uri)
+        .update_value(size_error ? std::uintmax_t{ 0 } : size)
+        .update_value(time_error ? 0 : written.time_since_epoch().count());
     }
+  }
 
-    // write container size then container bytes
-    WRITE_MAYBE(static_cast<std::uint64_t>(ktx_size));
-    output_file.write(reinterpret_cast<const char*>(ktx_buffer),
-                      static_cast<std::streamsize>(ktx_size));
+  hash.update_value(importer_revision)
+    .update_value(import_flags)
+    .update_value(max_lods)
+    .update_value(max_meshlet_vertices)
+    .update_value(max_meshlet_triangles)
+    .update_value(lod_reduction_rates)
+    .update_value(lod_target_errors)
+    .update_value(meshlet_cone_weight)
+    .update_value(preset);
+  return hash.digest();
+}
+
+auto
+MeshFile::is_cache_current(const std::filesystem::path& source,
+                           const std::filesystem::path& cache_path,
+                           const TextureEncodePreset preset) -> bool
+{
+  auto cached = read_file(cache_path);
+  MeshFileHeader cached_header{};
+  if (!cached || !read_into(*cached, cached_header) ||
+      cached_header.magic_bytes != MeshFileHeader::magic_header ||
+      cached_header.version != MeshFileHeader::current_version) {
+    return false;
   }
-  return true;
+  const auto source_hash = compute_source_hash(source, preset);
+  return source_hash && *source_hash == cached_header.source_hash;
 }
 
 auto
@@ -840,81 +1569,81 @@ MeshFile::create(IContext&, const std::filesystem::path& path)
   -> std::expected<MeshFile, std::string>
 {
   MeshFile mesh_file{};
-  auto chosen = std::filesystem::is_regular_file(path)
-                  ? path
-                  : path.parent_path().parent_path() / path.filename();
 
-  auto file = std::move(*read_file(path));
-  if (!file) {
-    return std::unexpected("Could not open file.");
+  auto mapped = MappedFile::open(path);
+  if (!mapped) {
+    return std::unexpected(std::move(mapped.error()));
   }
+  mesh_file.mapping = std::move(*mapped);
+  const auto file = mesh_file.mapping.bytes();
 
-  if (!read_into(file, mesh_file.header)) {
-    return std::unexpected("Could not write into header");
+  if (file.size() < sizeof(MeshFileHeader)) {
+    return std::unexpected("Mesh file is too small for its header");
   }
+  std::memcpy(&mesh_file.header, file.data(), sizeof(MeshFileHeader));
+  const auto& header = mesh_file.header;
 
-  if (mesh_file.header.magic_bytes != MeshFileHeader::magic_header) {
+  if (header.magic_bytes != MeshFileHeader::magic_header) {
     return std::unexpected("Invalid mesh file. Maybe you're trying to decode "
                            "a GLTF(etc) mesh?");
   }
-
-  if (!read_into(file, mesh_file.mesh_data.vertex_streams)) {
-    return std::unexpected("Could not write vertex streams");
-  }
-  mesh_file.mesh_data.meshes.resize(mesh_file.header.mesh_count);
-  mesh_file.mesh_data.aabbs.resize(mesh_file.header.mesh_count);
-  if (!read_into(file, std::span{ mesh_file.mesh_data.meshes })) {
-    return std::unexpected("Could not write meshes");
-  }
-  if (!read_into(file, std::span{ mesh_file.mesh_data.aabbs })) {
-    return std::unexpected("Could not write meshes");
-  }
-  mesh_file.mesh_data.index_data.resize(mesh_file.header.index_data_size /
-                                        sizeof(std::uint32_t));
-  mesh_file.mesh_data.vertex_data.resize(mesh_file.header.vertex_data_size);
-  if (!read_into(file, std::span{ mesh_file.mesh_data.index_data })) {
-    return std::unexpected("Could not read index data");
-  }
-  if (!read_into(file, std::span{ mesh_file.mesh_data.vertex_data })) {
-    return std::unexpected("Could not read vertex data");
+  if (header.version != MeshFileHeader::current_version) {
+    return std::unexpected(
+      std::format("Mesh file version {} is not the current {}; run "
+                  "MeshFile::preload_mesh on its source again",
+                  header.version,
+                  MeshFileHeader::current_version));
   }
 
-  std::size_t num_materials{ 0 };
-  std::size_t materials_size{ 0 };
-  if (!read_into(file, num_materials)) {
-    return std::unexpected("Could not read material count");
-  }
-  if (!read_into(file, materials_size)) {
-    return std::unexpected("Could not read material count");
-  }
-  mesh_file.mesh_data.materials.resize(num_materials);
-  if (!read_into(file, std::span{ mesh_file.mesh_data.materials })) {
-    return std::unexpected("Could not read materials data");
+  auto& data = mesh_file.mesh_data;
+  std::span<const VertexInput> vertex_streams;
+  std::span<const std::byte> texture_bytes;
+#define VIEW_SECTION(which, output)                                            \
+  if (auto viewed = view_section(file, header, which, output); !viewed)        \
+    return std::unexpected(std::move(viewed.error()));
+
+  VIEW_SECTION(MeshFileSection::VertexStreams, vertex_streams);
+  VIEW_SECTION(MeshFileSection::Meshes, data.meshes);
+  VIEW_SECTION(MeshFileSection::BoundingBoxes, data.aabbs);
+  VIEW_SECTION(MeshFileSection::IndexData, data.index_data);
+  VIEW_SECTION(MeshFileSection::VertexData, data.vertex_data);
+  VIEW_SECTION(MeshFileSection::Meshlets, data.meshlets);
+  VIEW_SECTION(MeshFileSection::MeshletVertices, data.meshlet_vertices);
+  VIEW_SECTION(MeshFileSection::MeshletTriangles, data.meshlet_triangles);
+  VIEW_SECTION(MeshFileSection::Materials, data.materials);
+  VIEW_SECTION(MeshFileSection::Textures, texture_bytes);
+#undef VIEW_SECTION
+
+  if (vertex_streams.size() != 1 || data.meshes.size() != header.mesh_count ||
+      data.aabbs.size() != header.mesh_count) {
+    return std::unexpected("Mesh file sections disagree with its header");
   }
+  data.vertex_streams = vertex_streams.front();
 
-  std::size_t num_textures = 0;
-  if (!read_into(file, num_textures)) {
+  // The KTX containers are parsed straight out of the mapping; libktx
+  // copies the image data once, since the textures outlive the file.
+  SectionReader reader{ texture_bytes };
+  std::uint64_t num_textures = 0;
+  if (!reader.read(num_textures)) {
     return std::unexpected("Could not read texture count");
   }
 
-  mesh_file.mesh_data.textures.resize(num_textures);
+  data.textures.resize(num_textures);
 
-  for (auto& tex : mesh_file.mesh_data.textures) {
+  for (auto& tex : data.textures) {
     std::uint8_t has_tex = 0;
-    if (!read_into(file, has_tex))
+    if (!reader.read(has_tex))
       return std::unexpected("Could not read texture presence flag");
 
     std::uint64_t name_len = 0;
-    if (!read_into(file, name_len))
+    if (!reader.read(name_len))
       return std::unexpected("Could not read texture name length");
 
-    tex.debug_name.clear();
-    if (name_len > 0) {
-      tex.debug_name.resize(name_len);
-      file.read(tex.debug_name.data(), static_cast<std::streamsize>(name_len));
-      if (!file)
-        return std::unexpected("Failed to read texture debug_name bytes");
-    }
+    const auto name = reader.take(name_len);
+    if (!name)
+      return std::unexpected("Failed to read texture debug_name bytes");
+    tex.debug_name.assign(reinterpret_cast<const char*>(name->data()),
+                          name->size());
 
     if (!has_tex) {
       tex.width = tex.height = tex.mip_levels = 0;
@@ -922,15 +1651,15 @@ MeshFile::create(IContext&, const std::filesystem::path& path)
       continue;
     }
 
-    if (!read_into(file, tex.width))
+    if (!reader.read(tex.width))
       return std::unexpected("Texture width fail");
-    if (!read_into(file, tex.height))
+    if (!reader.read(tex.height))
       return std::unexpected("Texture height fail");
-    if (!read_into(file, tex.mip_levels))
+    if (!reader.read(tex.mip_levels))
       return std::unexpected("Texture mips fail");
 
     std::uint64_t data_size = 0;
-    if (!read_into(file, data_size))
+    if (!reader.read(data_size))
       return std::unexpected("Texture data size fail");
 
     if (data_size == 0) {
@@ -939,19 +1668,17 @@ MeshFile::create(IContext&, const std::filesystem::path& path)
       continue;
     }
 
-    std::vector<std::uint8_t> buffer(data_size);
-    file.read(reinterpret_cast<char*>(buffer.data()),
-              static_cast<std::streamsize>(data_size));
-    if (!file)
+    const auto container = reader.take(data_size);
+    if (!container)
       return std::unexpected("Could not read texture binary data");
 
     ktxTexture2* new_tex = nullptr;
 
-    if (auto rc =
-          ktxTexture2_CreateFromMemory(buffer.data(),
-                                       buffer.size(),
-                                       KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
-                                       &new_tex);
+    if (auto rc = ktxTexture2_CreateFromMemory(
+          reinterpret_cast<const ktx_uint8_t*>(container->data()),
+          container->size(),
+          KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+          &new_tex);
         rc != KTX_SUCCESS) {
       return std::unexpected("Failed to create KTX texture from file data");
     }
@@ -974,11 +1701,160 @@ VkMesh::get_material_remap_buffer_handle(const IContext& ctx) const
   return ctx.get_device_address(*material_remap_buffer);
 }
 
+auto
+VkMesh::request_textures(const MeshFile& file,
+                         const glm::mat4& model,
+                         const glm::vec3& camera_position,
+                         const glm::mat4& projection,
+                         const float viewport_height) const -> void
+{
+  if (streamer == nullptr) {
+    return;
+  }
+
+  // Keeps the camera from dividing by zero when it is inside a submesh.
+  static constexpr auto min_distance = 0.01F;
+  const auto pixels_per_unit = 0.5F * projection[1][1] * viewport_height;
+
+  const auto& data = file.get_data();
+  for (std::size_t i = 0; i < data.meshes.size(); ++i) {
+    const auto material_id = data.meshes[i].material_id;
+    if (i >= data.aabbs.size() || material_id >= data.materials.size()) {
+      continue;
+    }
+
+    const auto& box = data.aabbs[i];
+    const auto centre =
+      glm::vec3{ model * glm::vec4{ 0.5F * (box.min() + box.max()), 1.0F } };
+    const auto diagonal =
+      glm::vec3{ model * glm::vec4{ box.max() - box.min(), 0.0F } };
+    const auto radius = 0.5F * glm::length(diagonal);
+    const auto distance = std::max(
+      glm::distance(centre, camera_position) - radius, min_distance);
+    const auto projected_pixels = 2.0F * radius * pixels_per_unit / distance;
+
+    const auto& material = data.materials[material_id];
+    for (const auto texture : { material.albedo_texture_index,
+                                material.normal_texture_index,
+                                material.emissive_texture_index,
+                                material.roughness_texture_index,
+                                material.metallic_texture_index,
+                                material.ao_texture_index }) {
+      if (texture >= 0 &&
+          static_cast<std::size_t>(texture) < streamed_textures.size()) {
+        streamer->request(streamed_textures[texture], projected_pixels);
+      }
+    }
+  }
+}
+
+auto
+VkMesh::cull(ICommandBuffer& cmd,
+             IContext& ctx,
+             const MeshFile& file,
+             const DepthPyramid& pyramid,
+             const glm::mat4& model,
+             const std::uint64_t ubo_address,
+             const float viewport_height) -> void
+{
+  if (submesh_buffer.empty()) {
+    return;
+  }
+
+  const auto use_pyramid = pyramid.is_ready();
+  pyramid_address =
+    use_pyramid ? ctx.get_device_address(pyramid.get_level_indices()) : 0;
+  pyramid_size = { pyramid.get_extent().width, pyramid.get_extent().height };
+  pyramid_level_count = use_pyramid ? pyramid.get_level_count() : 0;
+
+  // Until the pipeline is compiled the dispatch would be dropped; draw()
+  // keeps issuing every command meanwhile.
+  if (dynamic_cast<Context&>(ctx).get_pipeline(*culling_pipeline) ==
+      VK_NULL_HANDLE) {
+    return;
+  }
+
+  const auto draw_count = file.get_header().mesh_count;
+  const struct
+  {
+    glm::mat4 model_transform;
+    std::uint64_t ubo;
+    std::uint64_t source;
+    std::uint64_t culled;
+    std::uint64_t submeshes;
+    std::uint64_t pyramid;
+    std::uint32_t pyramid_width;
+    std::uint32_t pyramid_height;
+    std::uint32_t draw_count;
+    std::uint32_t pyramid_level_count;
+    float viewport_height;
+    float lod_pixel_error;
+  } pc{
+    .model_transform = model,
+    .ubo = ubo_address,
+    .source = ctx.get_device_address(indirect_buffer->get_buffer()),
+    .culled = ctx.get_device_address(culled_commands->get_buffer()),
+    .submeshes = ctx.get_device_address(*submesh_buffer),
+    .pyramid = pyramid_address,
+    .pyramid_width = pyramid_size.x,
+    .pyramid_height = pyramid_size.y,
+    .draw_count = draw_count,
+    .pyramid_level_count = pyramid_level_count,
+    .viewport_height = viewport_height,
+    .lod_pixel_error = lod_pixel_error,
+  };
+
+  static constexpr std::uint32_t group_size = 64;
+  cmd.cmd_fill_buffer(culled_commands->get_buffer(), 0, sizeof(uint32_t), 0);
+  cmd.cmd_bind_compute_pipeline(*culling_pipeline);
+  cmd.cmd_push_constants(pc, 0);
+  cmd.cmd_dispatch_thread_groups(
+    { (draw_count + group_size - 1) / group_size, 1, 1 },
+    { .buffers = { culled_commands->get_buffer() } });
+  is_culled = true;
+}
+
 auto
 VkMesh::draw(ICommandBuffer& cmd,
              const MeshFile& file,
              const std::span<const std::byte> pc) -> void
 {
+  if (!mesh_pipeline.empty()) {
+    // Laid out as the push constants of opaque_geometry_mesh.shader.
+    const struct
+    {
+      std::uint64_t geometry;
+      std::uint64_t pyramid;
+      glm::uvec2 pyramid_size;
+      std::uint32_t pyramid_level_count;
+      std::uint32_t is_culled;
+    } culling{
+      .geometry = meshlet_geometry_address,
+      .pyramid = pyramid_address,
+      .pyramid_size = pyramid_size,
+      .pyramid_level_count = pyramid_level_count,
+      .is_culled = is_culled ? 1U : 0U,
+    };
+    std::array<std::byte, 128> constants{};
+    const auto appended = std::as_bytes(std::span{ &culling, 1 });
+    assert(pc.size() + appended.size() <= constants.size());
+    std::ranges::copy(pc, constants.begin());
+    std::ranges::copy(appended, constants.begin() + pc.size());
+
+    cmd.cmd_bind_graphics_pipeline(*mesh_pipeline);
+    cmd.cmd_bind_depth_state({
+      .compare_operation = CompareOp::Greater,
+      .is_depth_write_enabled = true,
+    });
+    cmd.cmd_push_constants(
+      std::span{ constants }.first(pc.size() + appended.size()));
+    cmd.cmd_draw_mesh_tasks({ task_group_count, 1, 1 });
+    // The pyramid may be rebuilt or resized before the next cull().
+    is_culled = false;
+    pyramid_level_count = 0;
+    return;
+  }
+
   cmd.cmd_bind_index_buffer(*index_buffer, IndexFormat::UI32, 0);
   cmd.cmd_bind_vertex_buffer(0, *vertex_buffer, 0);
   cmd.cmd_bind_graphics_pipeline(*pipeline);
@@ -987,16 +1863,184 @@ VkMesh::draw(ICommandBuffer& cmd,
     .is_depth_write_enabled = true,
   });
   cmd.cmd_push_constants(pc);
+  if (is_culled) {
+    is_culled = false;
+    cmd.cmd_draw_indexed_indirect_count(culled_commands->get_buffer(),
+                                        sizeof(uint32_t),
+                                        culled_commands->get_buffer(),
+                                        0,
+                                        file.get_header().mesh_count);
+    return;
+  }
   cmd.cmd_draw_indexed_indirect(indirect_buffer->get_buffer(),
                                 sizeof(uint32_t),
                                 file.get_header().mesh_count,
                                 0);
 }
 
+auto
+VkMesh::create_meshlet_pipeline(IContext& context, const MeshDataView& data)
+  -> void
+{
+  // Each submesh gets enough workgroups for the most meshlets any of its
+  // LODs has; those past the end of the chosen LOD emit nothing.
+  static constexpr std::uint32_t task_group_size = 32;
+  std::vector<glm::uvec2> task_groups;
+  for (auto i = 0U; i < data.meshes.size(); i++) {
+    const auto& offsets = data.meshes[i].lod_meshlet_offset;
+    std::uint32_t most = 0;
+    for (auto lod = 0U; lod < data.meshes[i].lod_count; lod++) {
+      most = std::max(most, offsets[lod + 1] - offsets[lod]);
+    }
+    for (auto first = 0U; first < most; first += task_group_size) {
+      task_groups.emplace_back(i, first);
+    }
+  }
+  task_group_count = static_cast<std::uint32_t>(task_groups.size());
+
+  meshlet_buffer =
+    VkDataBuffer::create(context,
+                         {
+                           .data = VkBindless::as_bytes(data.meshlets),
+                           .storage = StorageType::DeviceLocal,
+                           .usage = BufferUsageFlags::StorageBuffer,
+                           .debug_name = "Mesh Meshlets",
+                         });
+  meshlet_vertex_buffer =
+    VkDataBuffer::create(context,
+                         {
+                           .data = VkBindless::as_bytes(data.meshlet_vertices),
+                           .storage = StorageType::DeviceLocal,
+                           .usage = BufferUsageFlags::StorageBuffer,
+                           .debug_name = "Mesh Meshlet Vertices",
+                         });
+  meshlet_triangle_buffer =
+    VkDataBuffer::create(context,
+                         {
+                           .data = VkBindless::as_bytes(data.meshlet_triangles),
+                           .storage = StorageType::DeviceLocal,
+                           .usage = BufferUsageFlags::StorageBuffer,
+                           .debug_name = "Mesh Meshlet Triangles",
+                         });
+  task_group_buffer =
+    VkDataBuffer::create(context,
+                         {
+                           .data = VkBindless::as_bytes(task_groups),
+                           .storage = StorageType::DeviceLocal,
+                           .usage = BufferUsageFlags::StorageBuffer,
+                           .debug_name = "Mesh Task Groups",
+                         });
+  // In the order of MeshletGeometry in opaque_geometry_mesh.shader.
+  const std::array geometry{
+    context.get_device_address(*vertex_buffer),
+    context.get_device_address(*meshlet_buffer),
+    context.get_device_address(*meshlet_vertex_buffer),
+    context.get_device_address(*meshlet_triangle_buffer),
+    context.get_device_address(*submesh_buffer),
+    context.get_device_address(*task_group_buffer),
+  };
+  meshlet_geometry =
+    VkDataBuffer::create(context,
+                         {
+                           .data = VkBindless::as_bytes(geometry),
+                           .storage = StorageType::DeviceLocal,
+                           .usage = BufferUsageFlags::StorageBuffer,
+                           .debug_name = "Mesh Meshlet Geometry",
+                         });
+  meshlet_geometry_address = context.get_device_address(*meshlet_geometry);
+
+  mesh_shader =
+    *VkShader::create(&context, "assets/shaders/opaque_geometry_mesh.shader");
+  mesh_pipeline = VkGraphicsPipeline::create(
+    &context,
+    GraphicsPipelineDescription{
+      .shader = *mesh_shader,
+      .color = {
+        ColourAttachment{ .format = Format::RG_F16 },
+        ColourAttachment{ .format = Format::RGBA_F16 },
+        ColourAttachment{ .format = Format::RGBA_UI16 },
+      },
+      .depth_format = Format::Z_F32,
+      .cull_mode = CullMode::Back,
+      .debug_name = "Mesh Shader Pipeline",
+    });
+  context.on_shader_changed("assets/shaders/opaque_geometry_mesh.shader",
+                            *mesh_pipeline);
+}
+
 VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
+  : VkMesh(context, mesh_file, nullptr)
+{
+}
+
+VkMesh::VkMesh(IContext& context,
+               const MeshFile& mesh_file,
+               TextureStreamer& texture_streamer)
+  : VkMesh(context, mesh_file, &texture_streamer)
+{
+}
+
+VkMesh::~VkMesh()
+{
+  if (streamer != nullptr) {
+    streamer->remove_listener(streamer_listener);
+  }
+}
+
+auto
+VkMesh::on_textures_moved(
+  IContext& context,
+  const std::span<const TextureStreamer::TextureMove> moves) -> void
+{
+  for (const auto& [from, to] : moves) {
+    std::ranges::replace(streamed_textures, from, to);
+  }
+
+  // The old slots stay alive until the frames reading them retire, so an
+  // index can only match the texture that moved out of it.
+  std::size_t first = streamed_materials.size();
+  std::size_t last = 0;
+  for (std::size_t i = 0; i < streamed_materials.size(); ++i) {
+    auto& material = streamed_materials[i];
+    for (auto* index : { &material.albedo_texture,
+                         &material.normal_texture,
+                         &material.roughness_texture,
+                         &material.metallic_texture,
+                         &material.ao_texture,
+                         &material.emissive_texture }) {
+      const auto moved = std::ranges::find_if(moves, [index](const auto& m) {
+        return m.from.index() == *index;
+      });
+      if (moved != moves.end()) {
+        *index = moved->to.index();
+        first = std::min(first, i);
+        last = std::max(last, i);
+      }
+    }
+  }
+  if (first > last) {
+    return;
+  }
+
+  // materials is live, so this is a staged copy ordered before the frames
+  // that are submitted after it.
+  auto* buffer = *context.get_buffer_pool().get(*materials);
+  buffer->write(
+    context,
+    as_bytes(streamed_materials.data() + first, last - first + 1),
+    first * sizeof(GPUMaterial));
+}
+
+VkMesh::VkMesh(IContext& context,
+               const MeshFile& mesh_file,
+               TextureStreamer* texture_streamer)
   : index_count(static_cast<std::uint32_t>(
       mesh_file.get_header().index_data_size / sizeof(std::uint32_t)))
+  , streamer(texture_streamer)
 {
+  // Buffers and textures below are uploaded with one submission.
+  UploadBatch uploads{ context };
+
   const auto& data = mesh_file.get_data();
   const auto& header = mesh_file.get_header();
 
@@ -1008,14 +2052,15 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
                            .usage = BufferUsageFlags::IndexBuffer,
                            .debug_name = "Mesh IB",
                          });
-  vertex_buffer =
-    VkDataBuffer::create(context,
-                         {
-                           .data = VkBindless::as_bytes(data.vertex_data),
-                           .storage = StorageType::DeviceLocal,
-                           .usage = BufferUsageFlags::VertexBuffer,
-                           .debug_name = "Mesh IB",
-                         });
+  // The mesh shader pipeline reads vertices through their address.
+  vertex_buffer = VkDataBuffer::create(
+    context,
+    {
+      .data = VkBindless::as_bytes(data.vertex_data),
+      .storage = StorageType::DeviceLocal,
+      .usage = BufferUsageFlags::VertexBuffer | BufferUsageFlags::StorageBuffer,
+      .debug_name = "Mesh IB",
+    });
   std::vector<std::uint8_t> draw_commands;
   const uint32_t num_commands = header.mesh_count;
   draw_commands.resize(sizeof(VkDrawIndexedIndirectCommand) * num_commands +
@@ -1025,7 +2070,7 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
   indirect_buffer = std::make_unique<IndirectBuffer>(context, num_commands);
   auto command_array = indirect_buffer->as_span();
   for (auto i = 0U; i < num_commands; i++) {
-    const auto& mesh = data.meshes.at(i);
+    const auto& mesh = data.meshes[i];
     command_array[i] = VkDrawIndexedIndirectCommand{
       .indexCount = mesh.get_lod_indices_count(0U),
       .instanceCount = 1,
@@ -1049,6 +2094,45 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
                            .debug_name = "Material Remap Buffer",
                          });
 
+  if (data.aabbs.size() == num_commands) {
+    std::vector<GPUSubmesh> submeshes;
+    submeshes.reserve(num_commands);
+    for (auto i = 0U; i < num_commands; i++) {
+      const auto& mesh = data.meshes[i];
+      submeshes.push_back(GPUSubmesh{
+        .minimum = glm::vec4{ data.aabbs[i].min(), 1.0F },
+        .maximum = glm::vec4{ data.aabbs[i].max(), 1.0F },
+        .index_offset = mesh.index_offset,
+        .lod_count = std::max(mesh.lod_count, 1U),
+        .lod_offset = mesh.lod_offset,
+        .lod_error = mesh.lod_error,
+        .lod = 0,
+        .visible = 1,
+        .lod_meshlet_offset = mesh.lod_meshlet_offset,
+        .padding = {},
+      });
+    }
+    submesh_buffer =
+      VkDataBuffer::create(context,
+                           {
+                             .data = VkBindless::as_bytes(submeshes),
+                             .storage = StorageType::DeviceOnly,
+                             .usage = BufferUsageFlags::StorageBuffer,
+                             .debug_name = "Mesh Submeshes",
+                           });
+    culled_commands = std::make_unique<IndirectBuffer>(
+      context, num_commands, StorageType::DeviceOnly);
+    culling_shader =
+      *VkShader::create(&context, "assets/shaders/mesh_culling.shader");
+    culling_pipeline =
+      VkComputePipeline::create(&context,
+                                {
+                                  .shader = *culling_shader,
+                                  .entry_point = "main",
+                                  .debug_name = "Mesh Culling",
+                                });
+  }
+
   shader = *VkShader::create(&context, "assets/shaders/opaque_geometry.shader");
   pipeline = VkGraphicsPipeline::create(
     &context,
@@ -1070,6 +2154,13 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
                                  .debug_name = "Mesh Pipeline" });
   context.on_shader_changed("assets/shaders/opaque_geometry.shader", *pipeline);
 
+  // The task shader reads the LOD and visibility of each submesh from the
+  // culling pass, so it needs the bounds too.
+  if (context.supports_mesh_shaders() && !data.meshlets.empty() &&
+      !submesh_buffer.empty()) {
+    create_meshlet_pipeline(context, data);
+  }
+
   const auto materials_span = std::span{ mesh_file.get_data().materials };
 
   std::vector<GPUMaterial> copy;
@@ -1086,11 +2177,16 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
 
     // Upload regular textures
     for (const auto& processed_texture : texture_data) {
-      if (processed_texture.ktx_texture) {
+      if (processed_texture.ktx_texture && streamer != nullptr) {
+        texture_handles.push_back(
+          streamer->add(processed_texture.ktx_texture.get(),
+                        texture_format(processed_texture),
+                        processed_texture.debug_name));
+      } else if (processed_texture.ktx_texture) {
         auto ptr = processed_texture.ktx_texture.get();
         VkTextureDescription tex_desc{
           .fully_specified_data = ptr,
-          .format = Format::BC7_RGBA,
+          .format = texture_format(processed_texture),
           .extent = { processed_texture.width, processed_texture.height, 1 },
           .usage_flags =
             TextureUsageFlags::Sampled | TextureUsageFlags::TransferDestination,
@@ -1106,6 +2202,10 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
       }
     }
 
+    if (streamer != nullptr) {
+      streamed_textures = texture_handles;
+    }
+
     // Upload opacity textures
     /*for (const auto& processed_texture : opacity_texture_data) {
       if (processed_texture.ktx_texture) {
@@ -1169,6 +2269,20 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
         material.normal_texture =
           texture_handles[material.normal_texture].index();
       }
+
+      if (read_material.roughness_texture_index >= 0) {
+        material.roughness_texture =
+          texture_handles[material.roughness_texture].index();
+      }
+
+      if (read_material.metallic_texture_index >= 0) {
+        material.metallic_texture =
+          texture_handles[material.metallic_texture].index();
+      }
+
+      if (read_material.ao_texture_index >= 0) {
+        material.ao_texture = texture_handles[material.ao_texture].index();
+      }
       /*
       if (material.opacity_texture >= 0) {
         material.opacity_texture =
@@ -1185,5 +2299,14 @@ VkMesh::VkMesh(IContext& context, const MeshFile& mesh_file)
                                      .usage = BufferUsageFlags::StorageBuffer,
                                      .debug_name = "Mesh SSBO",
                                    });
+
+  if (streamer != nullptr) {
+    streamed_materials = std::move(copy);
+    streamer_listener = streamer->add_listener(
+      [this, &context](
+        const std::span<const TextureStreamer::TextureMove> moves) {
+        on_textures_moved(context, moves);
+      });
+  }
 }
 }
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "vk-bindless/mip_generator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define MIP_GENERATOR_NEON
+#include <arm_neon.h>
+#endif
+
+namespace VkBindless {
+
+namespace {
+
+constexpr std::uint32_t channels = 4;
+
+/// Linear values are quantised to this many steps for encoding. The
+/// smallest gap between two sRGB bytes in linear space is ~3e-4, so this is
+/// fine enough to always pick the nearest byte.
+constexpr std::uint32_t linear_steps = 65536;
+
+struct SrgbTables
+{
+  std::array<float, 256> to_linear{};
+  std::array<std::uint8_t, linear_steps> from_linear{};
+};
+
+auto
+srgb_tables() -> const SrgbTables&
+{
+  static const auto tables = [] {
+    SrgbTables result;
+    for (auto i = 0U; i < result.to_linear.size(); ++i) {
+      const auto c = static_cast<float>(i) / 255.0F;
+      result.to_linear[i] = c <= 0.04045F
+                              ? c / 12.92F
+                              : std::pow((c + 0.055F) / 1.055F, 2.4F);
+    }
+    // Each step maps to the byte whose linear value is nearest.
+    auto byte = 0U;
+    for (auto i = 0U; i < linear_steps; ++i) {
+      const auto value =
+        static_cast<float>(i) / static_cast<float>(linear_steps - 1);
+      while (byte < 255 && value > 0.5F * (result.to_linear[byte] +
+                                           result.to_linear[byte + 1])) {
+        ++byte;
+      }
+      result.from_linear[i] = static_cast<std::uint8_t>(byte);
+    }
+    return result;
+  }();
+  return tables;
+}
+
+auto
+encode_unorm(const float value) -> std::uint8_t
+{
+  return static_cast<std::uint8_t>(std::clamp(value, 0.0F, 1.0F) * 255.0F +
+                                   0.5F);
+}
+
+auto
+encode_srgb(const SrgbTables& tables, const float value) -> std::uint8_t
+{
+  const auto scale = static_cast<float>(linear_steps - 1);
+  const auto step = std::clamp(value, 0.0F, 1.0F) * scale + 0.5F;
+  return tables.from_linear[static_cast<std::uint32_t>(step)];
+}
+
+/// Destination texels [first, last) of one row, each the rounded mean of
+/// its 2x2 block.
+auto
+average_rows_scalar(const std::uint8_t* top,
+                    const std::uint8_t* bottom,
+                    const std::uint32_t width,
+                    std::uint8_t* out,
+                    const std::uint32_t first,
+                    const std::uint32_t last) -> void
+{
+  for (auto x = first; x < last; ++x) {
+    const auto left = 2 * x * channels;
+    const auto right = std::min(2 * x + 1, width - 1) * channels;
+    for (auto c = 0U; c < channels; ++c) {
+      const auto sum =
+        top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c];
+      out[x * channels + c] = static_cast<std::uint8_t>((sum + 2) >> 2);
+    }
+  }
+}
+
+/// Same result as average_rows_scalar, four destination texels at a time.
+auto
+average_rows(const std::uint8_t* top,
+             const std::uint8_t* bottom,
+             const std::uint32_t width,
+             std::uint8_t* out,
+             const std::uint32_t out_width) -> void
+{
+  auto x = 0U;
+#if defined(MIP_GENERATOR_SSE2)
+  const auto zero = _mm_setzero_si128();
+  const auto bias = _mm_set1_epi16(2);
+  // Four source texels from each row into two destination texels.
+  const auto reduce = [&](const __m128i a, const __m128i b) {
+    const auto left =
+      _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    const auto right =
+      _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    const auto sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right),
+                                   _mm_unpackhi_epi64(left, right));
+    return _mm_srli_epi16(_mm_add_epi16(sum, bias), 2);
+  };
+  for (; width >= 2 && x + 4 <= out_width; x += 4) {
+    const auto* t = reinterpret_cast<const __m128i*>(top + 2 * x * channels);
+    const auto* b =
+      reinterpret_cast<const __m128i*>(bottom + 2 * x * channels);
+    const auto low = reduce(_mm_loadu_si128(t), _mm_loadu_si128(b));
+    const auto high = reduce(_mm_loadu_si128(t + 1), _mm_loadu_si128(b + 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * channels),
+                     _mm_packus_epi16(low, high));
+  }
+#elif defined(MIP_GENERATOR_NEON)
+  const auto reduce = [](const uint8x16_t a, const uint8x16_t b) {
+    const auto left = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+    const auto right = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+    const auto sum =
+      vcombine_u16(vadd_u16(vget_low_u16(left), vget_high_u16(left)),
+                   vadd_u16(vget_low_u16(right), vget_high_u16(right)));
+    return vrshrn_n_u16(sum, 2);
+  };
+  for (; width >= 2 && x + 4 <= out_width; x += 4) {
+    const auto* t = top + 2 * x * channels;
+    const auto* b = bottom + 2 * x * channels;
+    const auto low = reduce(vld1q_u8(t), vld1q_u8(b));
+    const auto high = reduce(vld1q_u8(t + 16), vld1q_u8(b + 16));
+    vst1q_u8(out + x * channels, vcombine_u8(low, high));
+  }
+#endif
+  average_rows_scalar(top, bottom, width, out, x, out_width);
+}
+
+auto
+decode_row(const std::uint8_t* row,
+           const std::uint32_t width,
+           const MipContent content,
+           float* out) -> void
+{
+  const auto& srgb = srgb_tables();
+  for (auto i = 0U; i < width * channels; i += channels) {
+    for (auto c = 0U; c < 3; ++c) {
+      out[i + c] = content == MipContent::Srgb
+                     ? srgb.to_linear[row[i + c]]
+                     : static_cast<float>(row[i + c]) / 127.5F - 1.0F;
+    }
+    out[i + 3] = static_cast<float>(row[i + 3]) / 255.0F;
+  }
+}
+
+auto
+average_texel(const float* a,
+              const float* b,
+              const float* c,
+              const float* d,
+              float* out) -> void
+{
+#if defined(MIP_GENERATOR_SSE2)
+  const auto sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)),
+                              _mm_add_ps(_mm_loadu_ps(c), _mm_loadu_ps(d)));
+  _mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(0.25F)));
+#elif defined(MIP_GENERATOR_NEON)
+  const auto sum = vaddq_f32(vaddq_f32(vld1q_f32(a), vld1q_f32(b)),
+                             vaddq_f32(vld1q_f32(c), vld1q_f32(d)));
+  vst1q_f32(out, vmulq_n_f32(sum, 0.25F));
+#else
+  for (auto i = 0U; i < channels; ++i) {
+    out[i] = 0.25F * ((a[i] + b[i]) + (c[i] + d[i]));
+  }
+#endif
+}
+
+auto
+encode_texel(const float* value, const MipContent content, std::uint8_t* out)
+  -> void
+{
+  if (content == MipContent::Srgb) {
+    const auto& srgb = srgb_tables();
+    for (auto c = 0U; c < 3; ++c) {
+      out[c] = encode_srgb(srgb, value[c]);
+    }
+  } else {
+    std::array normal{ value[0], value[1], value[2] };
+    const auto length = std::sqrt(normal[0] * normal[0] +
+                                  normal[1] * normal[1] +
+                                  normal[2] * normal[2]);
+    // Opposing normals can cancel out; those become flat.
+    if (length > 1e-6F) {
+      for (auto& n : normal) {
+        n /= length;
+      }
+    } else {
+      normal = { 0.0F, 0.0F, 1.0F };
+    }
+    for (auto c = 0U; c < 3; ++c) {
+      out[c] = encode_unorm(normal[c] * 0.5F + 0.5F);
+    }
+  }
+  out[3] = encode_unorm(value[3]);
+}
+
+}
+
+auto
+downsample_rgba8(const std::span<const std::uint8_t> source,
+                 const std::uint32_t width,
+                 const std::uint32_t height,
+                 const std::span<std::uint8_t> destination,
+                 const MipContent content) -> void
+{
+  const auto out_width = mip_extent(width);
+  const auto out_height = mip_extent(height);
+  const auto row_bytes = std::size_t{ width } * channels;
+  const auto out_row_bytes = std::size_t{ out_width } * channels;
+  assert(source.size() >= row_bytes * height);
+  assert(destination.size() >= out_row_bytes * out_height);
+
+  const auto source_row = [&](const std::uint32_t y) {
+    return source.data() + std::min(y, height - 1) * row_bytes;
+  };
+
+  if (content == MipContent::Linear) {
+    for (auto y = 0U; y < out_height; ++y) {
+      average_rows(source_row(2 * y),
+                   source_row(2 * y + 1),
+                   width,
+                   destination.data() + y * out_row_bytes,
+                   out_width);
+    }
+    return;
+  }
+
+  std::vector<float> top(row_bytes);
+  std::vector<float> bottom(row_bytes);
+  std::array<float, channels> average{};
+  for (auto y = 0U; y < out_height; ++y) {
+    decode_row(source_row(2 * y), width, content, top.data());
+    decode_row(source_row(2 * y + 1), width, content, bottom.data());
+
+    auto* out = destination.data() + y * out_row_bytes;
+    for (auto x = 0U; x < out_width; ++x) {
+      const auto left = 2 * x * channels;
+      const auto right = std::min(2 * x + 1, width - 1) * channels;
+      average_texel(&top[left],
+                    &top[right],
+                    &bottom[left],
+                    &bottom[right],
+                    average.data());
+      encode_texel(average.data(), content, out + x * channels);
+    }
+  }
+}
+
+} // namespace VkBindless
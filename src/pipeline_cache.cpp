@@ -0,0 +1,271 @@
+#include "vk-bindless/pipeline_cache.hpp"
+
+#include "vk-bindless/hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace VkBindless {
+
+namespace {
+
+constexpr std::uint32_t blob_magic = 0x43504B56; // "VKPC"
+constexpr std::uint32_t blob_version = 1;
+
+struct BlobHeader
+{
+  std::uint32_t magic{ blob_magic };
+  std::uint32_t version{ blob_version };
+  std::uint32_t vendor_id{ 0 };
+  std::uint32_t device_id{ 0 };
+  std::uint32_t driver_version{ 0 };
+  std::uint32_t reserved{ 0 };
+  std::array<std::uint8_t, VK_UUID_SIZE> driver_uuid{};
+  std::array<std::uint8_t, VK_UUID_SIZE> pipeline_cache_uuid{};
+  std::uint64_t payload_size{ 0 };
+  std::uint64_t payload_hash{ 0 };
+};
+static_assert(sizeof(BlobHeader) == 72, "BlobHeader must not contain padding");
+
+auto
+read_file(const std::filesystem::path& path) -> std::vector<std::uint8_t>
+{
+  std::ifstream file{ path, std::ios::binary | std::ios::ate };
+  if (!file) {
+    return {};
+  }
+  const auto size = static_cast<std::size_t>(file.tellg());
+  std::vector<std::uint8_t> bytes(size);
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(bytes.data()),
+            static_cast<std::streamsize>(size));
+  if (!file) {
+    return {};
+  }
+  return bytes;
+}
+
+}
+
+auto
+PipelineCacheIdentity::from(const VkPhysicalDeviceProperties& base,
+                            const VkPhysicalDeviceVulkan11Properties& eleven)
+  -> PipelineCacheIdentity
+{
+  PipelineCacheIdentity identity{
+    .vendor_id = base.vendorID,
+    .device_id = base.deviceID,
+    .driver_version = base.driverVersion,
+  };
+  std::ranges::copy(eleven.driverUUID, identity.driver_uuid.begin());
+  std::ranges::copy(base.pipelineCacheUUID,
+                    identity.pipeline_cache_uuid.begin());
+  return identity;
+}
+
+auto
+serialise_pipeline_cache_blob(const std::span<const std::uint8_t> payload,
+                              const PipelineCacheIdentity& identity)
+  -> std::vector<std::uint8_t>
+{
+  const BlobHeader header{
+    .vendor_id = identity.vendor_id,
+    .device_id = identity.device_id,
+    .driver_version = identity.driver_version,
+    .driver_uuid = identity.driver_uuid,
+    .pipeline_cache_uuid = identity.pipeline_cache_uuid,
+    .payload_size = payload.size(),
+    .payload_hash = Fnv1a64{}.update(payload).digest(),
+  };
+
+  std::vector<std::uint8_t> blob(sizeof(BlobHeader) + payload.size());
+  std::memcpy(blob.data(), &header, sizeof(BlobHeader));
+  std::ranges::copy(payload, blob.begin() + sizeof(BlobHeader));
+  return blob;
+}
+
+auto
+validate_pipeline_cache_blob(const std::span<const std::uint8_t> blob,
+                             const PipelineCacheIdentity& identity)
+  -> Expected<std::span<const std::uint8_t>, PipelineCacheError>
+{
+  const auto fail = [](std::string_view reason) {
+    return unexpected<PipelineCacheError>(
+      PipelineCacheError{ std::string{ reason } });
+  };
+
+  if (blob.size() < sizeof(BlobHeader)) {
+    return fail("Pipeline cache is truncated");
+  }
+
+  BlobHeader header{};
+  std::memcpy(&header, blob.data(), sizeof(BlobHeader));
+  if (header.magic != blob_magic || header.version != blob_version) {
+    return fail("Pipeline cache has an unknown format");
+  }
+
+  const PipelineCacheIdentity stored{
+    .vendor_id = header.vendor_id,
+    .device_id = header.device_id,
+    .driver_version = header.driver_version,
+    .driver_uuid = header.driver_uuid,
+    .pipeline_cache_uuid = header.pipeline_cache_uuid,
+  };
+  if (stored != identity) {
+    return fail("Pipeline cache was written by a different device or driver");
+  }
+
+  const auto payload = blob.subspan(sizeof(BlobHeader));
+  if (payload.size() != header.payload_size ||
+      Fnv1a64{}.update(payload).digest() != header.payload_hash) {
+    return fail("Pipeline cache payload is corrupt");
+  }
+
+  // The driver checks this header too, but rejecting here keeps a bad blob
+  // away from drivers that are less careful about it.
+  VkPipelineCacheHeaderVersionOne vk_header{};
+  if (payload.size() < sizeof(vk_header)) {
+    return fail("Pipeline cache payload has no Vulkan header");
+  }
+  std::memcpy(&vk_header, payload.data(), sizeof(vk_header));
+  if (vk_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      vk_header.vendorID != identity.vendor_id ||
+      vk_header.deviceID != identity.device_id ||
+      !std::ranges::equal(vk_header.pipelineCacheUUID,
+                          identity.pipeline_cache_uuid)) {
+    return fail("Pipeline cache Vulkan header does not match the device");
+  }
+
+  return payload;
+}
+
+PipelineCache::~PipelineCache()
+{
+  if (cache != VK_NULL_HANDLE) {
+    vkDestroyPipelineCache(device, cache, nullptr);
+  }
+}
+
+PipelineCache::PipelineCache(PipelineCache&& other) noexcept
+  : device(std::exchange(other.device, VK_NULL_HANDLE))
+  , cache(std::exchange(other.cache, VK_NULL_HANDLE))
+  , identity(other.identity)
+  , path(std::move(other.path))
+  , loaded_bytes(other.loaded_bytes)
+{
+}
+
+auto
+PipelineCache::operator=(PipelineCache&& other) noexcept -> PipelineCache&
+{
+  if (this != &other) {
+    if (cache != VK_NULL_HANDLE) {
+      vkDestroyPipelineCache(device, cache, nullptr);
+    }
+    device = std::exchange(other.device, VK_NULL_HANDLE);
+    cache = std::exchange(other.cache, VK_NULL_HANDLE);
+    identity = other.identity;
+    path = std::move(other.path);
+    loaded_bytes = other.loaded_bytes;
+  }
+  return *this;
+}
+
+auto
+PipelineCache::create(VkDevice device,
+                      const PipelineCacheIdentity& identity,
+                      std::filesystem::path path)
+  -> Expected<PipelineCache, PipelineCacheError>
+{
+  PipelineCache result{};
+  result.device = device;
+  result.identity = identity;
+  result.path = std::move(path);
+
+  const auto blob = read_file(result.path);
+  std::span<const std::uint8_t> initial_data{};
+  if (!blob.empty()) {
+    if (auto payload = validate_pipeline_cache_blob(blob, identity)) {
+      initial_data = *payload;
+    } else {
+      std::cerr << std::format("Ignoring pipeline cache '{}': {}",
+                               result.path.string(),
+                               payload.error().message)
+                << std::endl;
+    }
+  }
+
+  const VkPipelineCacheCreateInfo create_info{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    .pNext = nullptr,
+    .flags = 0,
+    .initialDataSize = initial_data.size(),
+    .pInitialData = initial_data.empty() ? nullptr : initial_data.data(),
+  };
+  if (vkCreatePipelineCache(device, &create_info, nullptr, &result.cache) !=
+      VK_SUCCESS) {
+    return unexpected<PipelineCacheError>(
+      PipelineCacheError{ "Failed to create pipeline cache" });
+  }
+  result.loaded_bytes = initial_data.size();
+
+  return result;
+}
+
+auto
+PipelineCache::save() const -> Expected<void, PipelineCacheError>
+{
+  if (cache == VK_NULL_HANDLE) {
+    return {};
+  }
+
+  std::size_t size = 0;
+  if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS) {
+    return unexpected<PipelineCacheError>(
+      PipelineCacheError{ "Failed to query pipeline cache size" });
+  }
+  std::vector<std::uint8_t> payload(size);
+  if (vkGetPipelineCacheData(device, cache, &size, payload.data()) !=
+      VK_SUCCESS) {
+    return unexpected<PipelineCacheError>(
+      PipelineCacheError{ "Failed to read pipeline cache data" });
+  }
+  payload.resize(size);
+
+  const auto blob = serialise_pipeline_cache_blob(payload, identity);
+
+  std::error_code ec;
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path(), ec);
+  }
+
+  auto temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream file{ temporary, std::ios::binary | std::ios::trunc };
+    if (!file) {
+      return unexpected<PipelineCacheError>(PipelineCacheError{
+        std::format("Failed to open '{}' for writing", temporary.string()) });
+    }
+    file.write(reinterpret_cast<const char*>(blob.data()),
+               static_cast<std::streamsize>(blob.size()));
+    if (!file) {
+      return unexpected<PipelineCacheError>(PipelineCacheError{
+        std::format("Failed to write '{}'", temporary.string()) });
+    }
+  }
+
+  std::filesystem::rename(temporary, path, ec);
+  if (ec) {
+    return unexpected<PipelineCacheError>(PipelineCacheError{ std::format(
+      "Failed to move pipeline cache into place: {}", ec.message()) });
+  }
+
+  return {};
+}
+
+} // namespace VkBindless
@@ -1,10 +1,17 @@
 #include "vk-bindless/shader.hpp"
 
+#include <cassert>
+#include <chrono>
 #include <expected>
 #include <fstream>
+#include <future>
+#include <mutex>
+#include <optional>
 
 #include "vk-bindless/graphics_context.hpp"
 #include "vk-bindless/scope_exit.hpp"
+#include "vk-bindless/shader_cache.hpp"
+#include "vk-bindless/thread_pool.hpp"
 #include "vk-bindless/vulkan_context.hpp"
 
 #include "./shader_compilation_impl.inl"
@@ -150,37 +157,49 @@ to_glslang_stage(const ShaderStage stage) -> glslang_stage_t
       return GLSLANG_STAGE_TESSEVALUATION;
     case ShaderStage::compute:
       return GLSLANG_STAGE_COMPUTE;
+    case ShaderStage::task:
+      return GLSLANG_STAGE_TASK;
+    case ShaderStage::mesh:
+      return GLSLANG_STAGE_MESH;
     default:
       std::cerr << "Unknown shader stage: " << to_string(stage) << std::endl;
       return GLSLANG_STAGE_VERTEX; // fallback to vertex stage
   }
 }
-}
 
 auto
-VkShader::create(IContext* context, const std::filesystem::path& path)
-  -> Expected<Holder<ShaderModuleHandle>, ShaderError>
+reflect_push_constants(CachedShaderStage& stage) -> void
 {
-  auto& pool = context->get_shader_module_pool();
-  auto compiled = VkShader::compile(context, path);
-  if (!compiled) {
-    return unexpected<ShaderError>(compiled.error());
+  SpvReflectShaderModule reflect_module{};
+  if (spvReflectCreateShaderModule(
+        stage.spirv.size(), stage.spirv.data(), &reflect_module) !=
+      SPV_REFLECT_RESULT_SUCCESS) {
+    return;
   }
 
-  const auto handle = pool.create(std::move(compiled.value()));
-  if (!handle.valid()) {
-    return unexpected<ShaderError>{
-      ShaderError{ ShaderError::Code::module_creation_failed,
-                   "Failed to create shader module handle in pool" },
-    };
-  }
+  auto count = 0U;
+  if (auto res =
+        spvReflectEnumeratePushConstantBlocks(&reflect_module, &count, nullptr);
+      res == SPV_REFLECT_RESULT_SUCCESS && count > 0) {
 
-  return Holder{ context, handle };
+    std::vector<SpvReflectBlockVariable*> blocks(count);
+    res = spvReflectEnumeratePushConstantBlocks(
+      &reflect_module, &count, blocks.data());
+
+    if (res == SPV_REFLECT_RESULT_SUCCESS) {
+      for (const auto* block : blocks) {
+        stage.push_constant_size =
+          std::max(stage.push_constant_size, block->size);
+        stage.has_push_constants = true;
+      }
+    }
+  }
+  spvReflectDestroyShaderModule(&reflect_module);
 }
 
 auto
-VkShader::compile(IContext* context, const std::filesystem::path& path)
-  -> Expected<VkShader, ShaderError>
+read_shader_file(const std::filesystem::path& path)
+  -> Expected<ParsedShader, ShaderError>
 {
   auto stream = std::ifstream{ path };
   if (!stream) {
@@ -212,23 +231,203 @@ VkShader::compile(IContext* context, const std::filesystem::path& path)
       ShaderError::Code::preamble_failed, "Failed to prepend shader preamble"));
   }
 
-  std::vector<VkShader::StageModule> modules;
-  PushConstantInfo push_constant_info{};
+  return std::move(parsed.value());
+}
 
-  for (const auto& entry : parsed->entries) {
-    std::vector<std::uint8_t> spirv;
-    auto result = compile_shader(to_glslang_stage(entry.stage),
-                                 entry.source_code,
-                                 spirv,
-                                 &default_resource);
+// glslang allows compiling on several threads, but only once the process
+// has been initialised, which must itself happen exactly once.
+auto
+ensure_glslang_initialised() -> void
+{
+  static std::once_flag initialised;
+  std::call_once(initialised, [] { glslang_initialize_process(); });
+}
 
-    if (!result) {
-      return unexpected<ShaderError>(
-        ShaderError(ShaderError::Code::compilation_failed,
-                    std::format("Compilation failed for stage {}: {}",
-                                to_string(entry.stage),
-                                result.error())));
+/// Returns the SPIR-V for entry from the shader cache, compiling and
+/// caching it on a miss.
+auto
+compile_stage(const ShaderEntry& entry)
+  -> Expected<CachedShaderStage, ShaderError>
+{
+  static const ShaderCache cache{};
+
+  const auto includes = collect_includes(entry.source_code);
+  const auto key = shader_cache_key(entry.stage,
+                                    entry.entry_name,
+                                    entry.source_code,
+                                    includes,
+                                    compile_options_key(default_resource));
+  if (auto cached = cache.load(key); cached.has_value()) {
+    return std::move(cached.value());
+  }
+
+  CachedShaderStage compiled{};
+  auto result = compile_shader(to_glslang_stage(entry.stage),
+                               entry.source_code,
+                               compiled.spirv,
+                               &default_resource);
+  if (!result) {
+    return unexpected<ShaderError>(
+      ShaderError(ShaderError::Code::compilation_failed,
+                  std::format("Compilation failed for stage {}: {}",
+                              to_string(entry.stage),
+                              result.error())));
+  }
+  reflect_push_constants(compiled);
+
+  if (auto stored = cache.store(key, compiled); !stored.has_value()) {
+    std::cerr << std::format("Failed to cache SPIR-V for stage {}: {}",
+                             to_string(entry.stage),
+                             stored.error().message)
+              << std::endl;
+  }
+
+  return compiled;
+}
+}
+
+auto
+VkShader::create(IContext* context, const std::filesystem::path& path)
+  -> Expected<Holder<ShaderModuleHandle>, ShaderError>
+{
+  auto compiled = VkShader::compile(context, path);
+  if (!compiled) {
+    return unexpected<ShaderError>(compiled.error());
+  }
+
+  return add_to_pool(context, std::move(compiled.value()));
+}
+
+auto
+VkShader::create_many(IContext* context,
+                      const std::span<const std::filesystem::path> paths)
+  -> std::vector<Expected<Holder<ShaderModuleHandle>, ShaderError>>
+{
+  const auto start = std::chrono::steady_clock::now();
+  ensure_glslang_initialised();
+
+  std::vector<Expected<ParsedShader, ShaderError>> parsed;
+  parsed.reserve(paths.size());
+  for (const auto& path : paths) {
+    parsed.push_back(read_shader_file(path));
+  }
+
+  // Every stage of every shader is independent until module creation, which
+  // stays on this thread along with the (unsynchronised) shader pool.
+  using StageResult = Expected<CachedShaderStage, ShaderError>;
+  std::vector<std::vector<std::future<StageResult>>> pending(parsed.size());
+  std::size_t stage_count = 0;
+  ThreadPool workers{};
+  for (auto i = 0U; i < parsed.size(); ++i) {
+    if (!parsed[i]) {
+      continue;
+    }
+    for (const auto& entry : parsed[i]->entries) {
+      pending[i].push_back(
+        workers.submit([&entry] { return compile_stage(entry); }));
+      ++stage_count;
+    }
+  }
+
+  std::vector<Expected<Holder<ShaderModuleHandle>, ShaderError>> results;
+  results.reserve(parsed.size());
+  for (auto i = 0U; i < parsed.size(); ++i) {
+    if (!parsed[i]) {
+      results.emplace_back(unexpected<ShaderError>(parsed[i].error()));
+      continue;
+    }
+
+    std::vector<CachedShaderStage> stages;
+    std::optional<ShaderError> error;
+    for (auto& future : pending[i]) {
+      auto stage = future.get();
+      if (!stage) {
+        if (!error) {
+          error = stage.error();
+        }
+        continue;
+      }
+      stages.push_back(std::move(stage.value()));
     }
+    if (error) {
+      results.emplace_back(unexpected<ShaderError>(std::move(*error)));
+      continue;
+    }
+
+    auto shader = from_stages(context, *parsed[i], stages);
+    if (!shader) {
+      results.emplace_back(unexpected<ShaderError>(shader.error()));
+      continue;
+    }
+    results.emplace_back(add_to_pool(context, std::move(shader.value())));
+  }
+
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << std::format(
+    "Compiled {} shaders ({} stages) on {} threads in {:.2f} ms\n",
+    paths.size(),
+    stage_count,
+    workers.thread_count(),
+    std::chrono::duration<double, std::milli>(elapsed).count());
+
+  return results;
+}
+
+auto
+VkShader::add_to_pool(IContext* context, VkShader&& shader)
+  -> Expected<Holder<ShaderModuleHandle>, ShaderError>
+{
+  const auto handle =
+    context->get_shader_module_pool().create(std::move(shader));
+  if (!handle.valid()) {
+    return unexpected<ShaderError>{
+      ShaderError{ ShaderError::Code::module_creation_failed,
+                   "Failed to create shader module handle in pool" },
+    };
+  }
+
+  return Holder{ context, handle };
+}
+
+auto
+VkShader::compile(IContext* context, const std::filesystem::path& path)
+  -> Expected<VkShader, ShaderError>
+{
+  ensure_glslang_initialised();
+
+  auto parsed = read_shader_file(path);
+  if (!parsed) {
+    return unexpected<ShaderError>(parsed.error());
+  }
+
+  std::vector<CachedShaderStage> stages;
+  stages.reserve(parsed->entries.size());
+  for (const auto& entry : parsed->entries) {
+    auto stage = compile_stage(entry);
+    if (!stage) {
+      return unexpected<ShaderError>(stage.error());
+    }
+    stages.push_back(std::move(stage.value()));
+  }
+
+  return from_stages(context, *parsed, stages);
+}
+
+auto
+VkShader::from_stages(IContext* context,
+                      const ParsedShader& parsed,
+                      const std::span<const CachedShaderStage> stages)
+  -> Expected<VkShader, ShaderError>
+{
+  assert(stages.size() == parsed.entries.size());
+
+  std::vector<VkShader::StageModule> modules;
+  PushConstantInfo push_constant_info{};
+
+  for (auto i = 0U; i < parsed.entries.size(); ++i) {
+    const auto& entry = parsed.entries[i];
+    const auto& stage = stages[i];
+    const auto& spirv = stage.spirv;
 
     const VkShaderModuleCreateInfo create_info{
       .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -248,31 +447,9 @@ VkShader::compile(IContext* context, const std::filesystem::path& path)
                                 to_string(entry.stage))));
     }
 
-    // Reflection handling
-    SpvReflectShaderModule reflect_module{};
-    if (spvReflectCreateShaderModule(
-          spirv.size(), spirv.data(), &reflect_module) ==
-        SPV_REFLECT_RESULT_SUCCESS) {
-
-      auto count = 0U;
-      if (auto res = spvReflectEnumeratePushConstantBlocks(
-            &reflect_module, &count, nullptr);
-          res == SPV_REFLECT_RESULT_SUCCESS && count > 0) {
-
-        std::vector<SpvReflectBlockVariable*> blocks(count);
-        res = spvReflectEnumeratePushConstantBlocks(
-          &reflect_module, &count, blocks.data());
-
-        if (res == SPV_REFLECT_RESULT_SUCCESS) {
-          for (auto* block : blocks) {
-            if (block->size > push_constant_info.size) {
-              push_constant_info.size = block->size;
-            }
-            push_constant_info.stages |= to_vk_stage(entry.stage);
-          }
-        }
-      }
-      spvReflectDestroyShaderModule(&reflect_module);
+    if (stage.has_push_constants) {
+      push_constant_info.size = std::max<std::size_t>(
+        push_constant_info.size, stage.push_constant_size);
     }
 
     modules.emplace_back(entry.stage,
@@ -282,7 +459,7 @@ VkShader::compile(IContext* context, const std::filesystem::path& path)
 
   std::uint32_t total_stages{};
   for (const auto& stage :
-       parsed->entries |
+       parsed.entries |
          std::views::transform([](const auto& e) { return e.stage; })) {
     total_stages |= to_vk_stage(stage);
   }
@@ -302,11 +479,5 @@ VkShader::VkShader(IContext* ctx,
   , modules(std::move(mods))
   , flags(flag_bits)
 {
-
-  static bool glslang_is_initialised = false;
-  if (!glslang_is_initialised) {
-    glslang_initialize_process();
-    glslang_is_initialised = true;
-  }
 }
 }
@@ -0,0 +1,187 @@
+#include "vk-bindless/shader_cache.hpp"
+
+#include "vk-bindless/hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace VkBindless {
+
+namespace {
+
+constexpr std::uint32_t entry_magic = 0x43535653; // "SVSC"
+constexpr std::uint32_t entry_version = 1;
+
+struct EntryHeader
+{
+  std::uint32_t magic{ entry_magic };
+  std::uint32_t version{ entry_version };
+  std::uint64_t key{ 0 };
+  std::uint32_t push_constant_size{ 0 };
+  std::uint32_t has_push_constants{ 0 };
+  std::uint64_t spirv_size{ 0 };
+  std::uint64_t spirv_hash{ 0 };
+};
+static_assert(sizeof(EntryHeader) == 40,
+              "EntryHeader must not contain padding");
+
+auto
+hash_string(Fnv1a64& hasher, const std::string_view text) -> void
+{
+  // Length-prefixed, so moving bytes between adjacent strings changes the key.
+  hasher.update_value(static_cast<std::uint64_t>(text.size()));
+  hasher.update(text);
+}
+
+}
+
+auto
+shader_cache_key(const ShaderStage stage,
+                 const std::string_view entry_name,
+                 const std::string_view source,
+                 const std::span<const ResolvedInclude> includes,
+                 const std::uint64_t compile_options) -> std::uint64_t
+{
+  Fnv1a64 hasher{};
+  hasher.update_value(entry_version);
+  hasher.update_value(compile_options);
+  hasher.update_value(stage);
+  hash_string(hasher, entry_name);
+  hash_string(hasher, source);
+  hasher.update_value(static_cast<std::uint64_t>(includes.size()));
+  for (const auto& [name, contents] : includes) {
+    hash_string(hasher, name);
+    hash_string(hasher, contents);
+  }
+  return hasher.digest();
+}
+
+auto
+serialise_shader_cache_entry(const std::uint64_t key,
+                             const CachedShaderStage& stage)
+  -> std::vector<std::uint8_t>
+{
+  const EntryHeader header{
+    .key = key,
+    .push_constant_size = stage.push_constant_size,
+    .has_push_constants = stage.has_push_constants ? 1U : 0U,
+    .spirv_size = stage.spirv.size(),
+    .spirv_hash = Fnv1a64{}.update(stage.spirv).digest(),
+  };
+
+  std::vector<std::uint8_t> bytes(sizeof(EntryHeader) + stage.spirv.size());
+  std::memcpy(bytes.data(), &header, sizeof(EntryHeader));
+  std::ranges::copy(stage.spirv, bytes.begin() + sizeof(EntryHeader));
+  return bytes;
+}
+
+auto
+parse_shader_cache_entry(const std::span<const std::uint8_t> bytes,
+                         const std::uint64_t key)
+  -> Expected<CachedShaderStage, ShaderCacheError>
+{
+  const auto fail = [](std::string_view reason) {
+    return unexpected<ShaderCacheError>(
+      ShaderCacheError{ std::string{ reason } });
+  };
+
+  if (bytes.size() < sizeof(EntryHeader)) {
+    return fail("Shader cache entry is truncated");
+  }
+
+  EntryHeader header{};
+  std::memcpy(&header, bytes.data(), sizeof(EntryHeader));
+  if (header.magic != entry_magic || header.version != entry_version) {
+    return fail("Shader cache entry has an unknown format");
+  }
+  if (header.key != key) {
+    return fail("Shader cache entry belongs to another key");
+  }
+
+  const auto spirv = bytes.subspan(sizeof(EntryHeader));
+  if (spirv.size() != header.spirv_size || spirv.size() % 4 != 0 ||
+      Fnv1a64{}.update(spirv).digest() != header.spirv_hash) {
+    return fail("Shader cache entry is corrupt");
+  }
+
+  return CachedShaderStage{
+    .spirv = { spirv.begin(), spirv.end() },
+    .push_constant_size = header.push_constant_size,
+    .has_push_constants = header.has_push_constants != 0,
+  };
+}
+
+auto
+ShaderCache::path_for(const std::uint64_t key) const -> std::filesystem::path
+{
+  return directory / std::format("{:016x}.spv", key);
+}
+
+auto
+ShaderCache::load(const std::uint64_t key) const
+  -> Expected<CachedShaderStage, ShaderCacheError>
+{
+  const auto path = path_for(key);
+  std::ifstream file{ path, std::ios::binary | std::ios::ate };
+  if (!file) {
+    return unexpected<ShaderCacheError>(ShaderCacheError{
+      std::format("No shader cache entry at '{}'", path.string()) });
+  }
+
+  const auto size = static_cast<std::size_t>(file.tellg());
+  std::vector<std::uint8_t> bytes(size);
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(bytes.data()),
+            static_cast<std::streamsize>(size));
+  if (!file) {
+    return unexpected<ShaderCacheError>(ShaderCacheError{
+      std::format("Failed to read shader cache entry '{}'", path.string()) });
+  }
+
+  return parse_shader_cache_entry(bytes, key);
+}
+
+auto
+ShaderCache::store(const std::uint64_t key,
+                   const CachedShaderStage& stage) const
+  -> Expected<void, ShaderCacheError>
+{
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+
+  const auto path = path_for(key);
+  auto temporary = path;
+  temporary += std::format(
+    ".{:x}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+  const auto bytes = serialise_shader_cache_entry(key, stage);
+  {
+    std::ofstream file{ temporary, std::ios::binary | std::ios::trunc };
+    if (!file) {
+      return unexpected<ShaderCacheError>(ShaderCacheError{
+        std::format("Failed to open '{}' for writing", temporary.string()) });
+    }
+    file.write(reinterpret_cast<const char*>(bytes.data()),
+               static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+      return unexpected<ShaderCacheError>(ShaderCacheError{
+        std::format("Failed to write '{}'", temporary.string()) });
+    }
+  }
+
+  std::filesystem::rename(temporary, path, ec);
+  if (ec) {
+    auto message = std::format(
+      "Failed to move shader cache entry into place: {}", ec.message());
+    std::filesystem::remove(temporary, ec);
+    return unexpected<ShaderCacheError>(ShaderCacheError{ std::move(message) });
+  }
+
+  return {};
+}
+
+} // namespace VkBindless
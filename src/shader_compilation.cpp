@@ -145,6 +145,11 @@ ShaderParser::prepend_preamble(ParsedShader& parsed) -> bool
       vec4 textureBindless2DLod(uint textureid, uint samplerid, vec2 uv, float lod) {
         return textureLod(nonuniformEXT(sampler2D(textures_2d[textureid], samplers[samplerid])), uv, lod);
       }
+      // Tangent-space normal from a BC5 map, which only stores X and Y.
+      vec3 textureBindlessNormal2D(uint textureid, uint samplerid, vec2 uv) {
+        vec2 xy = textureBindless2D(textureid, samplerid, uv).rg * 2.0 - 1.0;
+        return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+      }
       float textureBindless2DShadow(uint textureid, uint samplerid, vec3 uvw) {
         return texture(nonuniformEXT(sampler2DShadow(textures_2d_shadow[textureid], shadow_samplers[samplerid])), uvw);
       }
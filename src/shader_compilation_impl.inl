@@ -1,15 +1,22 @@
 #pragma once
 
 #include "vk-bindless/expected.hpp"
+#include "vk-bindless/hash.hpp"
 #include "vk-bindless/scope_exit.hpp"
+#include "vk-bindless/shader_cache.hpp"
 
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
 #include <glslang/Include/glslang_c_interface.h>
 #include <iostream>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace {
 // Context structure to manage include result lifetimes
@@ -33,6 +40,15 @@ read_file_to_string(const std::filesystem::path& file_path) -> std::string
   return contents.str();
 }
 
+// Resolve system includes from assets/shaders/include/
+auto
+resolve_include_path(const std::string_view header_name)
+  -> std::filesystem::path
+{
+  std::filesystem::path include_path = "assets/shaders/include";
+  return include_path / header_name;
+}
+
 // Callback for system includes: #include <file.glsl>
 auto
 include_system_callback(void* ctx, const char* header_name, const char*, size_t)
@@ -40,11 +56,7 @@ include_system_callback(void* ctx, const char* header_name, const char*, size_t)
 {
   auto* context = static_cast<IncludeContext*>(ctx);
 
-  // Resolve system includes from assets/shaders/include/
-  std::filesystem::path include_path = "assets/shaders/include";
-  std::filesystem::path full_path = include_path / header_name;
-
-  std::string content = read_file_to_string(full_path);
+  std::string content = read_file_to_string(resolve_include_path(header_name));
   if (content.empty()) {
     return nullptr; // File not found or empty
   }
@@ -96,6 +108,127 @@ free_include_result_callback(void* ctx, glsl_include_result_t* result)
   return 1; // Success
 }
 
+// Walks #include directives the way the callbacks above resolve them, so
+// the shader cache key covers every file glslang would read. Directives
+// inside comments or disabled #if blocks are followed too, which only makes
+// the key more conservative.
+auto
+collect_includes(const std::string_view source,
+                 std::vector<VkBindless::ResolvedInclude>& includes,
+                 std::unordered_set<std::string>& visited) -> void
+{
+  std::size_t line_start = 0;
+  while (line_start < source.size()) {
+    auto line_end = source.find('\n', line_start);
+    if (line_end == std::string_view::npos) {
+      line_end = source.size();
+    }
+    auto line = source.substr(line_start, line_end - line_start);
+    line_start = line_end + 1;
+
+    line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size()));
+    if (!line.starts_with("#include")) {
+      continue;
+    }
+    const auto open = line.find_first_of("<\"", 8);
+    if (open == std::string_view::npos) {
+      continue;
+    }
+    const auto close = line.find(line[open] == '<' ? '>' : '"', open + 1);
+    if (close == std::string_view::npos) {
+      continue;
+    }
+
+    auto name = std::string{ line.substr(open + 1, close - open - 1) };
+    if (!visited.insert(name).second) {
+      continue;
+    }
+    auto contents = read_file_to_string(resolve_include_path(name));
+    collect_includes(contents, includes, visited);
+    includes.push_back({ std::move(name), std::move(contents) });
+  }
+}
+
+auto
+collect_includes(const std::string_view source)
+  -> std::vector<VkBindless::ResolvedInclude>
+{
+  std::vector<VkBindless::ResolvedInclude> includes;
+  std::unordered_set<std::string> visited;
+  collect_includes(source, includes, visited);
+  return includes;
+}
+
+constexpr auto spirv_client_version = GLSLANG_TARGET_VULKAN_1_4;
+constexpr auto spirv_target_version = GLSLANG_TARGET_SPV_1_6;
+constexpr glslang_spv_options_t spirv_options = {
+  .generate_debug_info = true,
+  .strip_debug_info = false,
+  .disable_optimizer = false,
+  .optimize_size = false,
+  .disassemble = false,
+  .validate = true,
+  .emit_nonsemantic_shader_debug_info = false,
+  .emit_nonsemantic_shader_debug_source = false,
+  .compile_only = false,
+  .optimize_allow_expanded_id_bound = false,
+};
+
+// Everything that changes the SPIR-V besides the source, for the shader
+// cache key: the options above, the compiler version and the resource
+// limits handed to compile_shader.
+auto
+compile_options_key(const glslang_resource_t& resources) -> std::uint64_t
+{
+  VkBindless::Fnv1a64 hasher{};
+
+  glslang_version_t version{};
+  glslang_get_version(&version);
+  hasher.update_value(version.major);
+  hasher.update_value(version.minor);
+  hasher.update_value(version.patch);
+  hasher.update(std::string_view{ version.flavor != nullptr ? version.flavor
+                                                            : "" });
+
+  // The limits are ints around a block of bools, so they are hashed field
+  // by field to stay clear of the padding after the bools.
+  const auto* bytes = reinterpret_cast<const std::byte*>(&resources);
+  constexpr auto limits_begin = offsetof(glslang_resource_t, limits);
+  constexpr auto limits_end =
+    (limits_begin + sizeof(glslang_limits_t) + alignof(int) - 1) /
+    alignof(int) * alignof(int);
+  hasher.update(std::span{ bytes, limits_begin });
+  hasher.update(
+    std::span{ bytes + limits_end, sizeof(glslang_resource_t) - limits_end });
+  const auto& limits = resources.limits;
+  for (const bool limit : { limits.non_inductive_for_loops,
+                            limits.while_loops,
+                            limits.do_while_loops,
+                            limits.general_uniform_indexing,
+                            limits.general_attribute_matrix_vector_indexing,
+                            limits.general_varying_indexing,
+                            limits.general_sampler_indexing,
+                            limits.general_variable_indexing,
+                            limits.general_constant_matrix_vector_indexing }) {
+    hasher.update_value(limit);
+  }
+
+  hasher.update_value(spirv_client_version);
+  hasher.update_value(spirv_target_version);
+  for (const bool option : { spirv_options.generate_debug_info,
+                             spirv_options.strip_debug_info,
+                             spirv_options.disable_optimizer,
+                             spirv_options.optimize_size,
+                             spirv_options.validate,
+                             spirv_options.emit_nonsemantic_shader_debug_info,
+                             spirv_options.emit_nonsemantic_shader_debug_source,
+                             spirv_options.compile_only,
+                             spirv_options.optimize_allow_expanded_id_bound }) {
+    hasher.update_value(option);
+  }
+  return hasher.digest();
+}
+
 auto
 compile_shader(glslang_stage_t stage,
                const std::string& source_code,
@@ -116,9 +249,9 @@ compile_shader(glslang_stage_t stage,
     .language = GLSLANG_SOURCE_GLSL,
     .stage = stage,
     .client = GLSLANG_CLIENT_VULKAN,
-    .client_version = GLSLANG_TARGET_VULKAN_1_4,
+    .client_version = spirv_client_version,
     .target_language = GLSLANG_TARGET_SPV,
-    .target_language_version = GLSLANG_TARGET_SPV_1_6,
+    .target_language_version = spirv_target_version,
     .code = source_code.c_str(),
     .default_version = 100,
     .default_profile = GLSLANG_NO_PROFILE,
@@ -173,18 +306,7 @@ compile_shader(glslang_stage_t stage,
     return VkBindless::unexpected<std::string>(error);
   }
 
-  glslang_spv_options_t options = {
-    .generate_debug_info = true,
-    .strip_debug_info = false,
-    .disable_optimizer = false,
-    .optimize_size = false,
-    .disassemble = false,
-    .validate = true,
-    .emit_nonsemantic_shader_debug_info = false,
-    .emit_nonsemantic_shader_debug_source = false,
-    .compile_only = false,
-    .optimize_allow_expanded_id_bound = false,
-  };
+  auto options = spirv_options;
   glslang_program_SPIRV_generate_with_options(program, input.stage, &options);
 
   if (glslang_program_SPIRV_get_messages(program) != nullptr) {
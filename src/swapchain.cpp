@@ -308,7 +308,10 @@ vkSetHdrMetadataEXT(device_, 1, &swapchain_, &metadata);
 */
 
   if (old_swapchain != VK_NULL_HANDLE) {
-    vkDestroySwapchainKHR(context_ref.get_device(), old_swapchain, nullptr);
+    context().pre_frame_task([old_swapchain](auto& ctx) {
+      vkDestroySwapchainKHR(
+        ctx.get_device(), old_swapchain, ctx.get_allocation_callbacks());
+    });
   }
 
   std::array<VkImage, max_swapchain_images> swapchain_images{};
@@ -435,10 +438,10 @@ Swapchain::resize(std::uint32_t new_width, std::uint32_t new_height) -> void
     return;
   }
 
+  // Old images, views, semaphores and the old swapchain itself go through
+  // the deferred destruction queue, so only in-flight frames need waiting.
   wait_for_pending_timeline_operations();
 
-  vkDeviceWaitIdle(context_ref.get_device());
-
   for (TextureHandle handle : swapchain_textures) {
     if (handle.valid()) {
       context().destroy(handle);
@@ -568,6 +568,11 @@ VkTexture::get_or_create_framebuffer_view(IContext& context,
     return VK_NULL_HANDLE;
   }
 
+  if (cached_framebuffer_views.empty()) {
+    cached_framebuffer_views.resize(max_mip_levels * cube_array_layers,
+                                    VK_NULL_HANDLE);
+  }
+
   if (VK_NULL_HANDLE !=
       cached_framebuffer_views.at(mip * cube_array_layers + layer)) {
     return cached_framebuffer_views.at(mip * cube_array_layers + layer);
@@ -0,0 +1,284 @@
+#include "vk-bindless/texture_streamer.hpp"
+
+#include "vk-bindless/graphics_context.hpp"
+#include "vk-bindless/object_pool.hpp"
+#include "vk-bindless/texture.hpp"
+#include "vk-bindless/vulkan_context.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace VkBindless {
+
+namespace {
+
+auto
+mip_extent(const ktxTexture2* source, const std::uint32_t mip) -> VkExtent3D
+{
+  return {
+    std::max(source->baseWidth >> mip, 1U),
+    std::max(source->baseHeight >> mip, 1U),
+    1,
+  };
+}
+
+auto
+first_tail_mip(const ktxTexture2* source, const std::uint32_t tail_extent)
+  -> std::uint32_t
+{
+  std::uint32_t mip = 0;
+  while (mip + 1 < source->numLevels) {
+    const auto extent = mip_extent(source, mip);
+    if (std::max(extent.width, extent.height) <= tail_extent) {
+      break;
+    }
+    ++mip;
+  }
+  return mip;
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer(IContext& ctx,
+                                 const TextureStreamerSettings s)
+  : context(ctx)
+  , settings(s)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  // The loader reads from the sources; let it finish before they go.
+  loader.wait_idle();
+}
+
+auto
+TextureStreamer::prepare(const std::size_t texture,
+                         ktxTexture2* source,
+                         const std::uint32_t first_mip) -> PreparedMips
+{
+  PreparedMips prepared{
+    .texture = texture,
+    .first_mip = first_mip,
+  };
+
+  auto* base = ktxTexture(source);
+  std::size_t total = 0;
+  for (auto mip = first_mip; mip < source->numLevels; ++mip) {
+    total += ktxTexture_GetImageSize(base, mip);
+  }
+  prepared.data.resize(total);
+  prepared.copies.reserve(source->numLevels - first_mip);
+
+  std::size_t offset = 0;
+  for (auto mip = first_mip; mip < source->numLevels; ++mip) {
+    ktx_size_t source_offset = 0;
+    ktxTexture_GetImageOffset(base, mip, 0, 0, &source_offset);
+    const auto size = ktxTexture_GetImageSize(base, mip);
+    std::memcpy(prepared.data.data() + offset,
+                ktxTexture_GetData(base) + source_offset,
+                size);
+
+    prepared.copies.push_back(VkBufferImageCopy{
+      .bufferOffset = offset,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - first_mip, 0, 1 },
+      .imageOffset = { 0, 0, 0 },
+      .imageExtent = mip_extent(source, mip),
+    });
+    offset += size;
+  }
+  return prepared;
+}
+
+auto
+TextureStreamer::add(ktxTexture2* source,
+                     const Format format,
+                     const std::string_view debug_name) -> TextureHandle
+{
+  const auto index = textures.size();
+  textures.push_back(StreamedTexture{
+    .source = source,
+    .format = format,
+    .debug_name = std::string{ debug_name },
+    .mip_count = source->numLevels,
+    .resident_mip = source->numLevels,
+  });
+
+  const auto tail = first_tail_mip(source, settings.resident_tail_extent);
+  make_resident(prepare(index, source, tail));
+
+  auto& added = textures.back();
+  added.wanted_mip = added.resident_mip;
+  texture_slots.emplace(added.texture.index(), index);
+  return *added.texture;
+}
+
+auto
+TextureStreamer::add_listener(TexturesMovedCallback callback) -> std::uint32_t
+{
+  const auto id = next_listener_id++;
+  listeners.emplace_back(id, std::move(callback));
+  return id;
+}
+
+auto
+TextureStreamer::remove_listener(const std::uint32_t id) -> void
+{
+  std::erase_if(listeners,
+                [id](const auto& listener) { return listener.first == id; });
+}
+
+auto
+TextureStreamer::request(const TextureHandle handle,
+                         const float projected_pixels) -> void
+{
+  const auto it = texture_slots.find(handle.index());
+  if (it == texture_slots.end() || *textures[it->second].texture != handle) {
+    return;
+  }
+
+  auto& texture = textures[it->second];
+  const auto extent = mip_extent(texture.source, 0);
+  const auto texels =
+    static_cast<float>(std::max(extent.width, extent.height));
+  // One mip per halving of the texels that land on each pixel.
+  const auto wanted =
+    projected_pixels >= texels
+      ? 0U
+      : static_cast<std::uint32_t>(
+          std::log2(texels / std::max(projected_pixels, 1.0F)));
+
+  texture.wanted_mip =
+    std::min({ texture.wanted_mip, wanted, texture.mip_count - 1 });
+  texture.priority = std::max(texture.priority, projected_pixels);
+}
+
+auto
+TextureStreamer::update() -> void
+{
+  for (auto it = in_flight.begin(); it != in_flight.end();) {
+    if (it->wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready) {
+      ready.push_back(it->get());
+      it = in_flight.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  if (!ready.empty()) {
+    UploadBatch batch{ context };
+    std::uint64_t uploaded = 0;
+    std::vector<TextureMove> moves;
+    std::vector<Holder<TextureHandle>> replaced;
+    while (!ready.empty()) {
+      const auto size = ready.front().data.size();
+      if (uploaded > 0 && uploaded + size > settings.bytes_per_frame) {
+        break;
+      }
+      uploaded += size;
+      const auto index = ready.front().texture;
+      auto old = make_resident(std::move(ready.front()));
+      ready.pop_front();
+      if (!old.empty()) {
+        moves.push_back(TextureMove{
+          .from = *old,
+          .to = *textures[index].texture,
+        });
+        replaced.push_back(std::move(old));
+      }
+    }
+
+    if (!moves.empty()) {
+      for (const auto& [id, callback] : listeners) {
+        callback(moves);
+      }
+    }
+    // Queued only after the listeners' rewrites, so every frame that can
+    // still sample an old image has already been submitted, and the slot
+    // goes once the last of them retires.
+    for (auto& old : replaced) {
+      context.pre_frame_task(
+        [handle = old.release()](IContext& ctx) { ctx.destroy(handle); });
+    }
+  }
+
+  std::vector<std::size_t> wanted;
+  for (std::size_t i = 0; i < textures.size(); ++i) {
+    if (!textures[i].loading &&
+        textures[i].wanted_mip < textures[i].resident_mip) {
+      wanted.push_back(i);
+    }
+  }
+  std::ranges::sort(wanted, [this](const auto lhs, const auto rhs) {
+    return textures[lhs].priority > textures[rhs].priority;
+  });
+
+  for (const auto index : wanted) {
+    if (pending_count() >= settings.max_in_flight) {
+      break;
+    }
+    auto& texture = textures[index];
+    texture.loading = true;
+    in_flight.push_back(
+      loader.submit([index, source = texture.source, mip = texture.wanted_mip] {
+        return prepare(index, source, mip);
+      }));
+  }
+
+  for (auto& texture : textures) {
+    texture.wanted_mip = texture.resident_mip;
+    texture.priority = 0.0F;
+  }
+}
+
+auto
+TextureStreamer::resident_mip(const TextureHandle handle) const
+  -> std::uint32_t
+{
+  const auto it = texture_slots.find(handle.index());
+  if (it == texture_slots.end() || *textures[it->second].texture != handle) {
+    return 0;
+  }
+  return textures[it->second].resident_mip;
+}
+
+auto
+TextureStreamer::make_resident(PreparedMips&& prepared)
+  -> Holder<TextureHandle>
+{
+  auto& texture = textures[prepared.texture];
+  texture.loading = false;
+  if (prepared.first_mip >= texture.resident_mip) {
+    return {};
+  }
+
+  const auto extent = mip_extent(texture.source, prepared.first_mip);
+  auto replacement = VkTexture::create(
+    context,
+    VkTextureDescription{
+      .format = texture.format,
+      .extent = extent,
+      .usage_flags =
+        TextureUsageFlags::Sampled | TextureUsageFlags::TransferDestination,
+      .mip_levels = texture.mip_count - prepared.first_mip,
+      .debug_name = texture.debug_name,
+    });
+
+  auto* image = *context.get_texture_pool().get(*replacement);
+  dynamic_cast<Context&>(context).staging_allocator->upload(
+    *image, prepared.data.data(), prepared.data.size(), prepared.copies);
+
+  texture.resident_mip = prepared.first_mip;
+  if (!texture.texture.empty()) {
+    texture_slots.erase(texture.texture.index());
+    texture_slots.emplace(replacement.index(), prepared.texture);
+  }
+  return std::exchange(texture.texture, std::move(replacement));
+}
+
+} // namespace VkBindless
@@ -0,0 +1,77 @@
+#include "vk-bindless/thread_pool.hpp"
+
+#include <algorithm>
+
+namespace VkBindless {
+
+ThreadPool::ThreadPool(const std::uint32_t thread_count)
+{
+  workers.reserve(std::max(thread_count, 1U));
+  for (auto i = 0U; i < std::max(thread_count, 1U); ++i) {
+    workers.emplace_back([this](const std::stop_token& stop) { run(stop); });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  for (auto& worker : workers) {
+    worker.request_stop();
+  }
+  work_available.notify_all();
+  workers.clear();
+}
+
+auto
+ThreadPool::default_thread_count() -> std::uint32_t
+{
+  const auto hardware = std::thread::hardware_concurrency();
+  return hardware > 1 ? hardware - 1 : 1;
+}
+
+auto
+ThreadPool::wait_idle() -> void
+{
+  std::unique_lock lock{ mutex };
+  idle.wait(lock, [this] { return jobs.empty() && running == 0; });
+}
+
+auto
+ThreadPool::enqueue(std::function<void()>&& job) -> void
+{
+  {
+    std::scoped_lock lock{ mutex };
+    jobs.push_back(std::move(job));
+  }
+  work_available.notify_one();
+}
+
+auto
+ThreadPool::run(const std::stop_token& stop) -> void
+{
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock lock{ mutex };
+      work_available.wait(lock, stop, [this] { return !jobs.empty(); });
+      if (jobs.empty()) {
+        // Only reachable once a stop was requested and the queue drained.
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+      ++running;
+    }
+
+    job();
+
+    {
+      std::scoped_lock lock{ mutex };
+      --running;
+      if (jobs.empty() && running == 0) {
+        idle.notify_all();
+      }
+    }
+  }
+}
+
+} // namespace VkBindless
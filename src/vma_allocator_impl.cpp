@@ -49,7 +49,11 @@ public:
     vma_alloc_info.usage = to_vma_usage(alloc_info.usage);
     if (alloc_info.map_memory) {
       vma_alloc_info.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT |
-                              VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+                              to_vma_host_access(alloc_info.host_access);
+      if (alloc_info.allow_transfer_instead) {
+        vma_alloc_info.flags |=
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT;
+      }
     }
     vma_alloc_info.requiredFlags = alloc_info.required_memory_bits;
     vma_alloc_info.preferredFlags = alloc_info.preferred_memory_bits;
@@ -85,6 +89,8 @@ public:
     info.offset = allocation_info.offset;
     info.size = allocation_info.size;
     info.mapped_data = allocation_info.pMappedData;
+    vmaGetAllocationMemoryProperties(
+      allocator, allocation, &info.memory_properties);
 
     return std::make_pair(buffer, info);
   }
@@ -327,6 +333,17 @@ private:
     }
     return VMA_MEMORY_USAGE_AUTO;
   }
+
+  static auto to_vma_host_access(HostAccess access) -> VmaAllocationCreateFlags
+  {
+    switch (access) {
+      case HostAccess::Random:
+        return VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+      case HostAccess::SequentialWrite:
+        return VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    }
+    return VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  }
 };
 
 // Factory function to create the allocator
@@ -4,20 +4,24 @@
 #include "vk-bindless/command_buffer.hpp"
 #include "vk-bindless/file_watcher.hpp"
 #include "vk-bindless/handle.hpp"
+#include "vk-bindless/pipeline_cache.hpp"
 #include "vk-bindless/scope_exit.hpp"
 #include "vk-bindless/shader_compilation.hpp"
 #include "vk-bindless/swapchain.hpp"
 #include "vk-bindless/texture.hpp"
 #include "vk-bindless/transitions.hpp"
 
+#include <chrono>
 #include <cstring>
 #include <ostream>
 #include <thread>
+#include <utility>
 #include <vk_mem_alloc.h>
 
 #include <VkBootstrap.h>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <vulkan/vulkan_core.h>
 
 #define TODO(message)                                                          \
@@ -116,6 +120,12 @@ format_to_vk_format(const Format format) -> VkFormat
       return VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK;
     case Format::BC7_RGBA:
       return VK_FORMAT_BC7_UNORM_BLOCK;
+    case Format::BC7_SRGB:
+      return VK_FORMAT_BC7_SRGB_BLOCK;
+    case Format::BC4_R:
+      return VK_FORMAT_BC4_UNORM_BLOCK;
+    case Format::BC5_RG:
+      return VK_FORMAT_BC5_UNORM_BLOCK;
 
     case Format::Z_UN16:
       return VK_FORMAT_D16_UNORM;
@@ -200,6 +210,12 @@ vk_format_to_format(const VkFormat format) -> Format
       return Format::ETC2_SRGB8;
     case VK_FORMAT_BC7_UNORM_BLOCK:
       return Format::BC7_RGBA;
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return Format::BC7_SRGB;
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+      return Format::BC4_R;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+      return Format::BC5_RG;
 
     case VK_FORMAT_D16_UNORM:
       return Format::Z_UN16;
@@ -394,7 +410,8 @@ compare_op_to_vk_compare_op(CompareOp compare_op) -> VkCompareOp
 
 auto
 create_timeline_semaphore(const VkDevice device,
-                          const std::uint64_t initial_value) -> VkSemaphore
+                          const std::uint64_t initial_value,
+                          const std::string_view name) -> VkSemaphore
 {
   const VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
     .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
@@ -409,8 +426,7 @@ create_timeline_semaphore(const VkDevice device,
   };
   VkSemaphore semaphore = VK_NULL_HANDLE;
   VK_VERIFY(vkCreateSemaphore(device, &ci, nullptr, &semaphore));
-  set_name_for_object(
-    device, VK_OBJECT_TYPE_SEMAPHORE, semaphore, "Timeline Semaphore");
+  set_name_for_object(device, VK_OBJECT_TYPE_SEMAPHORE, semaphore, name);
   return semaphore;
 }
 
@@ -429,6 +445,32 @@ Context::~Context()
 {
   vkDeviceWaitIdle(vkb_device.device);
 
+  // Lets every queued build finish, so none of them outlives the device.
+  pipeline_workers.reset();
+  graphics_pipeline_pool.for_each_valid(
+    [this](VkGraphicsPipeline& p) { abandon_build(p); });
+  compute_pipeline_pool.for_each_valid(
+    [this](VkComputePipeline& p) { abandon_build(p); });
+  reap_abandoned_pipeline_builds();
+  reap_retired_shader_modules();
+
+  if (pipelines_built > 0) {
+    std::cout << std::format(
+      "Pipeline cache: built {} pipelines in {:.2f} ms (warm start from {} "
+      "bytes)\n",
+      pipelines_built,
+      pipeline_build_ms,
+      pipeline_cache.get_loaded_bytes());
+  }
+  if (auto saved = pipeline_cache.save(); !saved.has_value()) {
+    std::cerr << "Failed to save pipeline cache: " << saved.error().message
+              << std::endl;
+  }
+
+  // Deferred frees may still name pool slots, so they run before the
+  // pools are cleared.
+  flush_callbacks();
+
   swapchain.reset();
   staging_allocator.reset();
 
@@ -443,8 +485,9 @@ Context::~Context()
   texture_pool.clear();
   sampler_pool.clear();
 
-  process_callbacks();
+  flush_callbacks();
 
+  transfer_commands.reset();
   immediate_commands.reset();
 
   vkDestroyDescriptorSetLayout(
@@ -454,6 +497,7 @@ Context::~Context()
 
   ShaderParser::destroy_context();
 
+  pipeline_cache = {};
   vkb::destroy_device(vkb_device);
   vkb::destroy_surface(vkb_instance, surface);
   vkb::destroy_instance(vkb_instance);
@@ -638,6 +682,7 @@ Context::create(std::function<VkSurfaceKHR(VkInstance)>&& surface_fn)
   base.geometryShader = VK_TRUE;
   base.fillModeNonSolid = VK_TRUE;
   base.multiDrawIndirect = VK_TRUE;
+  base.drawIndirectFirstInstance = VK_TRUE;
 
   vkb::PhysicalDeviceSelector selector{ vkb_instance, surf };
   auto phys_ret =
@@ -665,7 +710,29 @@ Context::create(std::function<VkSurfaceKHR(VkInstance)>&& surface_fn)
       ContextError{ "Failed to select Vulkan physical device" });
   }
 
-  const vkb::PhysicalDevice& vkb_physical = phys_ret.value();
+  vkb::PhysicalDevice vkb_physical = phys_ret.value();
+
+  // Mesh shading is optional; without it meshes use the vertex pipeline.
+  VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features{};
+  mesh_shader_features.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+  bool has_mesh_shaders = false;
+  if (vkb_physical.is_extension_present(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &mesh_shader_features;
+    vkGetPhysicalDeviceFeatures2(vkb_physical.physical_device, &features);
+    has_mesh_shaders = mesh_shader_features.taskShader == VK_TRUE &&
+                       mesh_shader_features.meshShader == VK_TRUE &&
+                       vkb_physical.enable_extension_if_present(
+                         VK_EXT_MESH_SHADER_EXTENSION_NAME);
+  }
+  // Only the stages; queries and multiview stay off.
+  mesh_shader_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+    .taskShader = VK_TRUE,
+    .meshShader = VK_TRUE,
+  };
 
   VkPhysicalDeviceVulkan11Features vk11_features{};
   vk11_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
@@ -673,15 +740,22 @@ Context::create(std::function<VkSurfaceKHR(VkInstance)>&& surface_fn)
   vk11_features.storageBuffer16BitAccess = VK_TRUE;
   vk11_features.uniformAndStorageBuffer16BitAccess = VK_TRUE;
   vk11_features.storagePushConstant16 = VK_TRUE;
+  // vk-bootstrap only keeps the chain of the last struct added, so the
+  // optional features hang off the end of it.
+  if (has_mesh_shaders) {
+    vk11_features.pNext = &mesh_shader_features;
+  }
 
   VkPhysicalDeviceVulkan12Features vk12_features{};
   vk12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
   vk12_features.pNext = &vk11_features;
+  vk12_features.drawIndirectCount = VK_TRUE;
   vk12_features.descriptorIndexing = VK_TRUE;
   vk12_features.timelineSemaphore = VK_TRUE;
   vk12_features.runtimeDescriptorArray = VK_TRUE;
   vk12_features.shaderFloat16 = VK_TRUE;
   vk12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  vk12_features.shaderStorageImageArrayNonUniformIndexing = VK_TRUE;
   vk12_features.descriptorBindingPartiallyBound = VK_TRUE;
   vk12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
   vk12_features.descriptorBindingVariableDescriptorCount = VK_TRUE;
@@ -721,6 +795,11 @@ Context::create(std::function<VkSurfaceKHR(VkInstance)>&& surface_fn)
   context->vkb_device = vkb_device;
   context->surface = surf;
   context->is_headless = is_headless;
+  context->has_mesh_shaders = has_mesh_shaders;
+  if (has_mesh_shaders) {
+    context->cmd_draw_mesh_tasks = reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(
+      vkGetDeviceProcAddr(vkb_device.device, "vkCmdDrawMeshTasksEXT"));
+  }
 
   std::vector<VkSurfaceFormatKHR> device_formats;
   std::vector<VkFormat> device_depth_formats;
@@ -780,9 +859,17 @@ Context::create(std::function<VkSurfaceKHR(VkInstance)>&& surface_fn)
 
   query_vulkan_properties(vkb_physical.physical_device,
                           context->vulkan_properties);
+
+  if (auto cache = PipelineCache::create(
+        vkb_device.device,
+        PipelineCacheIdentity::from(context->vulkan_properties.base,
+                                    context->vulkan_properties.eleven));
+      cache.has_value()) {
+    context->pipeline_cache = std::move(cache.value());
+  } else {
+    std::cerr << cache.error().message << std::endl;
+  }
   context->has_swapchain_maintenance_1 = false;
-  context->immediate_commands = std::make_unique<ImmediateCommands>(
-    vkb_device.device, context->graphics_queue_family, "Immediate Commands");
 
   {
     auto q = vkb_device.get_queue(vkb::QueueType::graphics);
@@ -816,13 +903,22 @@ Context::create(std::function<VkSurfaceKHR(VkInstance)>&& surface_fn)
     }
   }
 
+  context->immediate_commands = std::make_unique<ImmediateCommands>(
+    vkb_device.device, context->graphics_queue_family, "Immediate Commands");
+  if (context->transfer_queue_family != context->graphics_queue_family) {
+    context->transfer_commands = std::make_unique<ImmediateCommands>(
+      vkb_device.device, context->transfer_queue_family, "Transfer Commands");
+  }
+
   context->swapchain =
     !is_headless ? Unique<Swapchain>{ new Swapchain{ *context, 1920U, 1080U } }
                  : VK_NULL_HANDLE;
   context->timeline_semaphore =
     context->swapchain
-      ? create_timeline_semaphore(
-          vkb_device.device, context->swapchain->swapchain_image_count() - 1)
+      ? create_timeline_semaphore(vkb_device.device,
+                                  context->swapchain->swapchain_image_count() -
+                                    1,
+                                  "Timeline Semaphore")
       : VK_NULL_HANDLE;
   context->staging_allocator =
     Unique<StagingAllocator>{ new StagingAllocator{ *context } };
@@ -926,21 +1022,22 @@ Context::update_resource_bindings()
   }
 
   constexpr auto grow_factor = 2.F;
-  auto current_textures = 1U;
-  auto current_samplers = 1U;
 
+  // Descriptor arrays are indexed by pool slot, so size them by slot count
+  // and never shrink, otherwise live slots would fall off the end.
   constexpr auto grow_pool = [](const auto& pool, auto out_max) {
-    while (pool.size() > out_max) {
+    while (pool.slot_count() > out_max) {
       out_max =
         static_cast<std::uint32_t>(static_cast<float>(out_max) * grow_factor);
     }
     return out_max;
   };
 
-  current_textures = grow_pool(texture_pool, current_textures);
-  current_samplers = grow_pool(sampler_pool, current_samplers);
+  const auto current_textures = grow_pool(texture_pool, current_max_textures);
+  const auto current_samplers = grow_pool(sampler_pool, current_max_samplers);
 
-  if (current_textures != current_max_textures ||
+  if (descriptor_set == VK_NULL_HANDLE ||
+      current_textures != current_max_textures ||
       current_samplers != current_max_samplers) {
     if (auto err = grow_descriptor_pool(current_textures, current_samplers);
         !err.has_value()) {
@@ -948,105 +1045,132 @@ Context::update_resource_bindings()
                 << std::endl;
       std::terminate();
     }
-  }
 
-  std::vector<VkDescriptorImageInfo> sampled_images;
-  std::vector<VkDescriptorImageInfo> storage_images;
+    // Fresh descriptor set, every slot has to be written once.
+    texture_pool.mark_all_dirty();
+    sampler_pool.mark_all_dirty();
+  }
 
-  sampled_images.reserve(texture_pool.size());
-  storage_images.reserve(texture_pool.size());
+  if (!texture_pool.has_dirty_slots() && !sampler_pool.has_dirty_slots()) {
+    needs_update() = false;
+    return;
+  }
 
   // Need a white texture for VkImageView dummy-ing
-  const auto* realised_image = texture_pool.get(dummy_texture).value();
-  const auto& dummy_image_view = realised_image->get_image_view();
-
-  texture_pool.for_each_valid([v = dummy_image_view,
-                               &imgs = sampled_images,
-                               &storgs = storage_images](const auto& object) {
-    const auto& view = object.get_image_view();
-    const auto& storage_view = object.get_storage_image_view()
-                                 ? object.get_storage_image_view()
-                                 : object.get_image_view();
-
-    const auto is_available =
-      VK_SAMPLE_COUNT_1_BIT ==
-      (object.get_sample_count() & VK_SAMPLE_COUNT_1_BIT);
-    const auto is_sampled = object.is_sampled() && is_available;
-    const auto is_storage = object.is_storage() && is_available;
-
-    imgs.emplace_back(VK_NULL_HANDLE,
-                      is_sampled ? view : v,
-                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    storgs.emplace_back(
-      VK_NULL_HANDLE, is_storage ? storage_view : v, VK_IMAGE_LAYOUT_GENERAL);
-  });
+  const auto dummy_image_view =
+    texture_pool.get(dummy_texture).value()->get_image_view();
+  const auto dummy_vk_sampler = *sampler_pool.get(dummy_sampler).value();
 
-  std::vector<VkDescriptorImageInfo> sampler_infos;
-  sampler_infos.reserve(sampler_pool.size());
+  struct DirtyRange
+  {
+    std::uint32_t first_slot{ 0 };
+    std::uint32_t info_offset{ 0 };
+    std::uint32_t count{ 0 };
+  };
 
-  auto realised_sampler = *sampler_pool.get(dummy_sampler).value();
+  // Coalesces ascending slot indices into contiguous ranges, so a burst of
+  // creations still becomes a handful of writes.
+  constexpr auto push_slot = [](std::vector<DirtyRange>& ranges,
+                                const std::uint32_t slot,
+                                const std::uint32_t info_offset) {
+    if (!ranges.empty() &&
+        ranges.back().first_slot + ranges.back().count == slot) {
+      ++ranges.back().count;
+      return;
+    }
+    ranges.push_back(DirtyRange{
+      .first_slot = slot,
+      .info_offset = info_offset,
+      .count = 1,
+    });
+  };
+
+  std::vector<VkDescriptorImageInfo> sampled_images;
+  std::vector<VkDescriptorImageInfo> storage_images;
+  std::vector<DirtyRange> texture_ranges;
+
+  texture_pool.consume_dirty_slots(
+    [&](const std::uint32_t slot, const VkTexture* object) {
+      auto view = dummy_image_view;
+      auto storage_view = dummy_image_view;
+
+      if (object != nullptr) {
+        const auto is_available =
+          VK_SAMPLE_COUNT_1_BIT ==
+          (object->get_sample_count() & VK_SAMPLE_COUNT_1_BIT);
+        if (object->is_sampled() && is_available) {
+          view = object->get_image_view();
+        }
+        if (object->is_storage() && is_available) {
+          storage_view = object->get_storage_image_view()
+                           ? object->get_storage_image_view()
+                           : object->get_image_view();
+        }
+      }
 
-  sampler_pool.for_each_valid(
-    [&sampler_infos, &realised_sampler](const auto& object) {
-      sampler_infos.emplace_back(object ? object : realised_sampler,
-                                 VK_NULL_HANDLE,
-                                 VK_IMAGE_LAYOUT_UNDEFINED);
+      push_slot(texture_ranges,
+                slot,
+                static_cast<std::uint32_t>(sampled_images.size()));
+      sampled_images.emplace_back(
+        VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+      storage_images.emplace_back(
+        VK_NULL_HANDLE, storage_view, VK_IMAGE_LAYOUT_GENERAL);
     });
 
-  std::array<VkWriteDescriptorSet, 3> writes{};
-  auto write_count = 0U;
-  if (!sampled_images.empty()) {
-    writes[0] = VkWriteDescriptorSet{
-      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .pNext = nullptr,
-      .dstSet = descriptor_set,
-      .dstBinding = 0,
-      .dstArrayElement = 0,
-      .descriptorCount = static_cast<std::uint32_t>(sampled_images.size()),
-      .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-      .pImageInfo = sampled_images.data(),
-      .pBufferInfo = nullptr,
-      .pTexelBufferView = nullptr,
-    };
-    write_count++;
-  }
-  if (!sampler_infos.empty()) {
-    writes[1] = VkWriteDescriptorSet{
-      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .pNext = nullptr,
-      .dstSet = descriptor_set,
-      .dstBinding = 1,
-      .dstArrayElement = 0,
-      .descriptorCount = static_cast<std::uint32_t>(sampler_infos.size()),
-      .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
-      .pImageInfo = sampler_infos.data(),
-      .pBufferInfo = nullptr,
-      .pTexelBufferView = nullptr,
-    };
-    write_count++;
-  }
-  if (!storage_images.empty()) {
-    writes[2] = VkWriteDescriptorSet{
-      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .pNext = nullptr,
-      .dstSet = descriptor_set,
-      .dstBinding = 2,
-      .dstArrayElement = 0,
-      .descriptorCount = static_cast<std::uint32_t>(storage_images.size()),
-      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-      .pImageInfo = storage_images.data(),
-      .pBufferInfo = nullptr,
-      .pTexelBufferView = nullptr,
-    };
-    write_count++;
-  }
+  std::vector<VkDescriptorImageInfo> sampler_infos;
+  std::vector<DirtyRange> sampler_ranges;
+
+  sampler_pool.consume_dirty_slots(
+    [&](const std::uint32_t slot, const VkSampler* object) {
+      push_slot(sampler_ranges,
+                slot,
+                static_cast<std::uint32_t>(sampler_infos.size()));
+      sampler_infos.emplace_back(
+        (object != nullptr && *object != VK_NULL_HANDLE) ? *object
+                                                         : dummy_vk_sampler,
+        VK_NULL_HANDLE,
+        VK_IMAGE_LAYOUT_UNDEFINED);
+    });
+
+  std::vector<VkWriteDescriptorSet> writes;
+  writes.reserve(2 * texture_ranges.size() + sampler_ranges.size());
+
+  const auto append_writes = [&writes, set = descriptor_set](
+                               const std::vector<DirtyRange>& ranges,
+                               const std::uint32_t binding,
+                               const VkDescriptorType type,
+                               const std::vector<VkDescriptorImageInfo>& infos) {
+    for (const auto& [first_slot, info_offset, count] : ranges) {
+      writes.push_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = set,
+        .dstBinding = binding,
+        .dstArrayElement = first_slot,
+        .descriptorCount = count,
+        .descriptorType = type,
+        .pImageInfo = infos.data() + info_offset,
+        .pBufferInfo = nullptr,
+        .pTexelBufferView = nullptr,
+      });
+    }
+  };
+
+  append_writes(
+    texture_ranges, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, sampled_images);
+  append_writes(sampler_ranges, 1, VK_DESCRIPTOR_TYPE_SAMPLER, sampler_infos);
+  append_writes(
+    texture_ranges, 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, storage_images);
 
-  if (write_count != 0) {
-    vkQueueWaitIdle(get_queue_unsafe(Queue::Graphics));
-    vkQueueWaitIdle(get_queue_unsafe(Queue::Compute));
-    vkUpdateDescriptorSets(
-      vkb_device.device, write_count, writes.data(), 0, nullptr);
+  // The layout is created with UPDATE_AFTER_BIND and
+  // UPDATE_UNUSED_WHILE_PENDING, so the set may be written while frames that
+  // do not touch these elements are still in flight. No queue idle needed.
+  if (!writes.empty()) {
+    vkUpdateDescriptorSets(vkb_device.device,
+                           static_cast<std::uint32_t>(writes.size()),
+                           writes.data(),
+                           0,
+                           nullptr);
   }
 
   needs_update() = false;
@@ -1055,14 +1179,18 @@ Context::update_resource_bindings()
 auto
 Context::get_dsl_binding(const std::uint32_t index,
                          const VkDescriptorType descriptor_type,
-                         const uint32_t max_count)
+                         const uint32_t max_count) const
   -> VkDescriptorSetLayoutBinding
 {
+  // The task shader of opaque_geometry_mesh reads the depth pyramid.
+  constexpr VkShaderStageFlags mesh_stages_flags =
+    VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
   const auto binding = VkDescriptorSetLayoutBinding{
     .binding = index,
     .descriptorType = descriptor_type,
     .descriptorCount = max_count,
-    .stageFlags = all_stages_flags,
+    .stageFlags = has_mesh_shaders ? all_stages_flags | mesh_stages_flags
+                                   : all_stages_flags,
     .pImmutableSamplers = nullptr,
   };
 
@@ -1276,6 +1404,18 @@ Context::acquire_command_buffer() -> ICommandBuffer&
   return command_buffer;
 }
 
+auto
+Context::begin_upload_batch() -> void
+{
+  staging_allocator->begin_batch();
+}
+
+auto
+Context::end_upload_batch() -> SubmitHandle
+{
+  return staging_allocator->end_batch();
+}
+
 auto
 Context::acquire_immediate_command_buffer() -> CommandBufferWrapper&
 {
@@ -1327,6 +1467,8 @@ Context::submit(ICommandBuffer& cmd_buffer, const TextureHandle present)
   }
 
   process_callbacks();
+  reap_abandoned_pipeline_builds();
+  reap_retired_shader_modules();
 
   auto handle = command_buffer.last_submit_handle;
 
@@ -1341,151 +1483,258 @@ Context::get_current_swapchain_texture() -> TextureHandle
   return swapchain->current_texture();
 }
 
-auto
-Context::get_pipeline(ComputePipelineHandle handle) -> VkPipeline
+struct Context::GraphicsPipelineBuild
 {
-  auto* cps = *compute_pipeline_pool.get(handle);
+  struct Stage
+  {
+    VkShaderStageFlagBits stage{};
+    VkShaderModule module{ VK_NULL_HANDLE };
+    std::string entry_name{};
+  };
 
-  if (!cps) {
-    return VK_NULL_HANDLE;
-  }
+  VkDevice device{ VK_NULL_HANDLE };
+  VkPipelineCache cache{ VK_NULL_HANDLE };
+  VkDescriptorSetLayout descriptor_set_layout{ VK_NULL_HANDLE };
+  std::uint32_t view_mask{ 0 };
+  GraphicsPipelineDescription description{};
+  // Owned copy, so the build does not depend on the pipeline object staying
+  // alive or in place while it runs.
+  std::vector<std::byte> specialisation_data{};
+  std::array<VkVertexInputBindingDescription,
+             VertexInput::input_bindings_max_count>
+    bindings{};
+  std::array<VkVertexInputAttributeDescription,
+             VertexInput::vertex_attribute_max_count>
+    attributes{};
+  std::uint32_t binding_count{ 0 };
+  std::uint32_t attribute_count{ 0 };
+  VkShaderStageFlags stage_flags{};
+  std::size_t push_constant_size{ 0 };
+  std::vector<Stage> stages{};
+  bool has_tessellation{ false };
+  VkSampleCountFlagBits samples{ VK_SAMPLE_COUNT_1_BIT };
+};
 
-  update_resource_bindings();
+struct Context::ComputePipelineBuild
+{
+  VkDevice device{ VK_NULL_HANDLE };
+  VkPipelineCache cache{ VK_NULL_HANDLE };
+  VkDescriptorSetLayout descriptor_set_layout{ VK_NULL_HANDLE };
+  SpecialisationConstantDescription specialisation_constants{};
+  std::vector<std::byte> specialisation_data{};
+  VkShaderModule module{ VK_NULL_HANDLE };
+  std::string entry_name{};
+  std::size_t push_constant_size{ 0 };
+  std::string debug_name{};
+};
 
-  if (cps->new_shader ||
-      cps->last_descriptor_set_layout != descriptor_set_layout) {
-    pre_frame_task([l = cps->get_layout()](auto& ctx) {
-      vkDestroyPipelineLayout(
-        ctx.get_device(), l, ctx.get_allocation_callbacks());
-    });
-    pre_frame_task([p = cps->get_pipeline()](auto& ctx) {
-      vkDestroyPipeline(ctx.get_device(), p, ctx.get_allocation_callbacks());
-    });
-    cps->pipeline = VK_NULL_HANDLE;
-    cps->layout = VK_NULL_HANDLE;
-    cps->last_descriptor_set_layout = descriptor_set_layout;
-    cps->new_shader = false;
+static auto
+get_vk_sample_count(const std::uint32_t sample_count,
+                    const VkSampleCountFlags max_samples_mask)
+  -> VkSampleCountFlagBits
+{
+  if (sample_count <= 1 || VK_SAMPLE_COUNT_2_BIT > max_samples_mask) {
+    return VK_SAMPLE_COUNT_1_BIT;
+  }
+  if (sample_count <= 2 || VK_SAMPLE_COUNT_4_BIT > max_samples_mask) {
+    return VK_SAMPLE_COUNT_2_BIT;
+  }
+  if (sample_count <= 4 || VK_SAMPLE_COUNT_8_BIT > max_samples_mask) {
+    return VK_SAMPLE_COUNT_4_BIT;
   }
+  if (sample_count <= 8 || VK_SAMPLE_COUNT_16_BIT > max_samples_mask) {
+    return VK_SAMPLE_COUNT_8_BIT;
+  }
+  if (sample_count <= 16 || VK_SAMPLE_COUNT_32_BIT > max_samples_mask) {
+    return VK_SAMPLE_COUNT_16_BIT;
+  }
+  if (sample_count <= 32 || VK_SAMPLE_COUNT_64_BIT > max_samples_mask) {
+    return VK_SAMPLE_COUNT_32_BIT;
+  }
+  return VK_SAMPLE_COUNT_64_BIT;
+}
 
-  if (cps->pipeline == VK_NULL_HANDLE) {
-    const auto* sm = *shader_module_pool.get(cps->description.shader);
+static auto
+elapsed_milliseconds(const std::chrono::steady_clock::time_point start)
+  -> double
+{
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::milli>(elapsed).count();
+}
 
-    std::array<VkSpecializationMapEntry,
-               SpecialisationConstantDescription::max_specialization_constants>
-      entries = {};
+static auto
+copy_specialisation_data(const SpecialisationConstantDescription& constants)
+  -> std::vector<std::byte>
+{
+  return { constants.data.begin(), constants.data.end() };
+}
 
-    const VkSpecializationInfo siComp = get_pipeline_specialisation_info(
-      cps->description.specialisation_constants, entries);
+auto
+Context::prepare_build(const VkComputePipeline& cps, std::uint32_t) const
+  -> ComputePipelineBuild
+{
+  const auto* sm = *shader_module_pool.get(cps.description.shader);
+  assert(sm->get_push_constant_info().first <=
+         vulkan_properties.base.limits.maxPushConstantsSize);
 
-    // create pipeline layout
-    {
-      // duplicate for MoltenVK
-      const std::array dsls = { descriptor_set_layout,
-                                descriptor_set_layout,
-                                descriptor_set_layout,
-                                descriptor_set_layout };
-      assert(sm->get_push_constant_info().first <=
-             vulkan_properties.base.limits.maxPushConstantsSize);
-      const VkPushConstantRange range = {
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .offset = 0,
-        .size = static_cast<uint32_t>(
-          get_aligned_size(sm->get_push_constant_info().first, 4)),
-      };
-      const VkPipelineLayoutCreateInfo ci = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
-        .setLayoutCount = static_cast<uint32_t>(dsls.size()),
-        .pSetLayouts = dsls.data(),
-        .pushConstantRangeCount = 1,
-        .pPushConstantRanges = &range,
-      };
-      vkCreatePipelineLayout(get_device(), &ci, nullptr, &cps->layout);
-      set_name_for_object(
-        get_device(),
-        VK_OBJECT_TYPE_PIPELINE_LAYOUT,
-        cps->get_layout(),
-        std::format("Compute Pipeline Layout {}", cps->description.debug_name));
-    }
+  auto maybe_module = std::ranges::find_if(
+    sm->get_modules(), [&entry = cps.description.entry_point](const auto& m) {
+      return m.entry_name == entry;
+    });
+  assert(maybe_module != sm->get_modules().end());
+
+  ComputePipelineBuild build{
+    .device = get_device(),
+    .cache = pipeline_cache.get(),
+    .descriptor_set_layout = descriptor_set_layout,
+    .specialisation_constants = cps.description.specialisation_constants,
+    .specialisation_data =
+      copy_specialisation_data(cps.description.specialisation_constants),
+    .module = maybe_module->module,
+    .entry_name = maybe_module->entry_name,
+    .push_constant_size = sm->get_push_constant_info().first,
+    .debug_name = cps.description.debug_name,
+  };
+  build.specialisation_constants.data = {};
+  return build;
+}
 
-    auto maybe_module = std::ranges::find_if(
-      sm->get_modules(), [entry = cps->description.entry_point](auto m) {
-        return m.entry_name == entry;
-      });
-    assert(maybe_module != sm->get_modules().end());
-    auto module = *maybe_module;
+auto
+Context::prepare_build(const VkGraphicsPipeline& rps,
+                       const std::uint32_t view_mask) const
+  -> GraphicsPipelineBuild
+{
+  const auto& desc = rps.description;
+  const auto* shader = *shader_module_pool.get(desc.shader);
+  assert(shader);
+  assert(!desc.debug_name.empty());
+
+  const auto push_constant_size = shader->get_push_constant_info().first;
+  assert(push_constant_size <=
+         vulkan_properties.base.limits.maxPushConstantsSize);
+
+  GraphicsPipelineBuild build{
+    .device = get_device(),
+    .cache = pipeline_cache.get(),
+    .descriptor_set_layout = descriptor_set_layout,
+    .view_mask = view_mask,
+    .description = desc,
+    .specialisation_data =
+      copy_specialisation_data(desc.specialisation_constants),
+    .bindings = rps.bindings,
+    .attributes = rps.attributes,
+    .binding_count = rps.binding_count,
+    .attribute_count = rps.attribute_count,
+    .stage_flags = rps.stage_flags,
+    .push_constant_size = push_constant_size,
+    .stages = {},
+    .has_tessellation =
+      shader->has_stage(ShaderStage::tessellation_control) &&
+      shader->has_stage(ShaderStage::tessellation_evaluation) &&
+      desc.patch_control_points > 0,
+    .samples = get_vk_sample_count(
+      desc.sample_count,
+      vulkan_properties.base.limits.framebufferColorSampleCounts &
+        vulkan_properties.base.limits.framebufferDepthSampleCounts),
+  };
+  build.description.specialisation_constants.data = {};
+  for (const auto& [stage, entry_name, module] : shader->get_modules()) {
+    build.stages.push_back({
+      .stage = to_vk_stage(stage),
+      .module = module,
+      .entry_name = entry_name,
+    });
+  }
+  return build;
+}
 
-    VkPipelineShaderStageCreateInfo psci{
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .pNext = nullptr,
-      .flags = 0,
-      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-      .module = module.module,
-      .pName = module.entry_name.c_str(),
-      .pSpecializationInfo = &siComp,
+auto
+Context::build_pipeline(const ComputePipelineBuild& build,
+                        PipelineBuildResult& result) -> void
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  std::array<VkSpecializationMapEntry,
+             SpecialisationConstantDescription::max_specialization_constants>
+    entries = {};
+  auto constants = build.specialisation_constants;
+  constants.data = build.specialisation_data;
+  const VkSpecializationInfo siComp =
+    get_pipeline_specialisation_info(constants, entries);
+
+  // create pipeline layout
+  {
+    // duplicate for MoltenVK
+    const std::array dsls = { build.descriptor_set_layout,
+                              build.descriptor_set_layout,
+                              build.descriptor_set_layout,
+                              build.descriptor_set_layout };
+    const VkPushConstantRange range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size =
+        static_cast<uint32_t>(get_aligned_size(build.push_constant_size, 4)),
     };
-    const VkComputePipelineCreateInfo ci = {
-      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    const VkPipelineLayoutCreateInfo ci = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
       .pNext = nullptr,
       .flags = 0,
-      .stage = psci,
-      .layout = cps->layout,
-      .basePipelineHandle = VK_NULL_HANDLE,
-      .basePipelineIndex = -1,
+      .setLayoutCount = static_cast<uint32_t>(dsls.size()),
+      .pSetLayouts = dsls.data(),
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &range,
     };
-    vkCreateComputePipelines(
-      get_device(), nullptr, 1, &ci, nullptr, &cps->pipeline);
+    vkCreatePipelineLayout(build.device, &ci, nullptr, &result.layout);
     set_name_for_object(
-      get_device(),
-      VK_OBJECT_TYPE_PIPELINE,
-      cps->get_pipeline(),
-      std::format("Compute Pipeline {}", cps->description.debug_name));
+      build.device,
+      VK_OBJECT_TYPE_PIPELINE_LAYOUT,
+      result.layout,
+      std::format("Compute Pipeline Layout {}", build.debug_name));
   }
 
-  return cps->pipeline;
+  VkPipelineShaderStageCreateInfo psci{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+    .pNext = nullptr,
+    .flags = 0,
+    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+    .module = build.module,
+    .pName = build.entry_name.c_str(),
+    .pSpecializationInfo = &siComp,
+  };
+  const VkComputePipelineCreateInfo ci = {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .pNext = nullptr,
+    .flags = 0,
+    .stage = psci,
+    .layout = result.layout,
+    .basePipelineHandle = VK_NULL_HANDLE,
+    .basePipelineIndex = -1,
+  };
+  const auto res = vkCreateComputePipelines(
+    build.device, build.cache, 1, &ci, nullptr, &result.pipeline);
+  if (res != VK_SUCCESS) {
+    vkDestroyPipelineLayout(build.device, result.layout, nullptr);
+    result.layout = VK_NULL_HANDLE;
+    result.pipeline = VK_NULL_HANDLE;
+  } else {
+    set_name_for_object(build.device,
+                        VK_OBJECT_TYPE_PIPELINE,
+                        result.pipeline,
+                        std::format("Compute Pipeline {}", build.debug_name));
+  }
+
+  result.milliseconds = elapsed_milliseconds(start);
 }
 
 auto
-Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
-  -> VkPipeline
+Context::build_pipeline(const GraphicsPipelineBuild& build,
+                        PipelineBuildResult& result) -> void
 {
-  auto* rps = *get_graphics_pipeline_pool().get(handle);
-
-  if (!rps) {
-    return VK_NULL_HANDLE;
-  }
-
-  if (rps->new_shader ||
-      rps->last_descriptor_set_layout != descriptor_set_layout ||
-      rps->view_mask != viewMask) {
-    pre_frame_task([l = rps->get_layout()](auto& ctx) {
-      vkDestroyPipelineLayout(
-        ctx.get_device(), l, ctx.get_allocation_callbacks());
-    });
-    pre_frame_task([p = rps->get_pipeline()](auto& ctx) {
-      vkDestroyPipeline(ctx.get_device(), p, ctx.get_allocation_callbacks());
-    });
-
-    rps->pipeline = VK_NULL_HANDLE;
-    rps->last_descriptor_set_layout = descriptor_set_layout;
-    rps->view_mask = viewMask;
-    rps->new_shader = false;
-  }
-
-  if (rps->pipeline != VK_NULL_HANDLE) {
-    return rps->pipeline;
-  }
+  const auto start = std::chrono::steady_clock::now();
 
-  // build a new Vulkan pipeline
+  const auto& desc = build.description;
 
-  VkPipelineLayout layout = VK_NULL_HANDLE;
-  VkPipeline pipeline = VK_NULL_HANDLE;
-
-  const auto& desc = rps->description;
-
-  const auto colour_attachments_count =
-    rps->description.get_colour_attachments_count();
+  const auto colour_attachments_count = desc.get_colour_attachments_count();
 
   // Not all attachments are valid. We need to create color blend attachments
   // only for active attachments
@@ -1535,10 +1784,6 @@ Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
     }
   }
 
-  const auto* shader = *get_shader_module_pool().get(desc.shader);
-
-  assert(shader);
-
   /*  if (tescModule || teseModule || desc.patchControlPoints) {
       LVK_ASSERT_MSG(tescModule && teseModule, "Both tessellation control and
     evaluation shaders should be provided"); LVK_ASSERT(desc.patchControlPoints
@@ -1550,33 +1795,33 @@ Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
     .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
     .pNext = nullptr,
     .flags = 0,
-    .vertexBindingDescriptionCount = rps->binding_count,
+    .vertexBindingDescriptionCount = build.binding_count,
     .pVertexBindingDescriptions =
-      rps->binding_count > 0 ? rps->bindings.data() : nullptr,
-    .vertexAttributeDescriptionCount = rps->attribute_count,
+      build.binding_count > 0 ? build.bindings.data() : nullptr,
+    .vertexAttributeDescriptionCount = build.attribute_count,
     .pVertexAttributeDescriptions =
-      rps->attribute_count > 0 ? rps->attributes.data() : nullptr,
+      build.attribute_count > 0 ? build.attributes.data() : nullptr,
   };
 
   std::array<VkSpecializationMapEntry,
              SpecialisationConstantDescription::max_specialization_constants>
     entries{};
-
+  auto constants = desc.specialisation_constants;
+  constants.data = build.specialisation_data;
   const VkSpecializationInfo si =
-    get_pipeline_specialisation_info(desc.specialisation_constants, entries);
+    get_pipeline_specialisation_info(constants, entries);
 
   // create pipeline layout
   {
-    auto&& [size, flags] = shader->get_push_constant_info();
+    const auto size = build.push_constant_size;
 
     // duplicate for MoltenVK
-    const VkDescriptorSetLayout dsls[] = { descriptor_set_layout,
-                                           descriptor_set_layout,
-                                           descriptor_set_layout,
-                                           descriptor_set_layout };
-    assert(size <= vulkan_properties.base.limits.maxPushConstantsSize);
+    const VkDescriptorSetLayout dsls[] = { build.descriptor_set_layout,
+                                           build.descriptor_set_layout,
+                                           build.descriptor_set_layout,
+                                           build.descriptor_set_layout };
     const VkPushConstantRange range = {
-      .stageFlags = rps->stage_flags,
+      .stageFlags = build.stage_flags,
       .offset = 0,
       .size = static_cast<uint32_t>(get_aligned_size(size, 4)),
     };
@@ -1589,11 +1834,10 @@ Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
       .pushConstantRangeCount = size ? 1u : 0u,
       .pPushConstantRanges = size ? &range : nullptr,
     };
-    assert(!desc.debug_name.empty());
-    vkCreatePipelineLayout(get_device(), &ci, nullptr, &layout);
-    set_name_for_object(get_device(),
+    vkCreatePipelineLayout(build.device, &ci, nullptr, &result.layout);
+    set_name_for_object(build.device,
                         VK_OBJECT_TYPE_PIPELINE_LAYOUT,
-                        layout,
+                        result.layout,
                         std::format("Pipeline_Layout_{}", desc.debug_name));
   }
 
@@ -1621,37 +1865,9 @@ Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
   ci_rs.depthBiasEnable = VK_FALSE;
   ci_rs.lineWidth = 1.0f;
 
-  auto getVulkanSampleCountFlags = [](const uint32_t sample_count,
-                                      VkSampleCountFlags max_samples_mask) {
-    if (sample_count <= 1 || VK_SAMPLE_COUNT_2_BIT > max_samples_mask) {
-      return VK_SAMPLE_COUNT_1_BIT;
-    }
-    if (sample_count <= 2 || VK_SAMPLE_COUNT_4_BIT > max_samples_mask) {
-      return VK_SAMPLE_COUNT_2_BIT;
-    }
-    if (sample_count <= 4 || VK_SAMPLE_COUNT_8_BIT > max_samples_mask) {
-      return VK_SAMPLE_COUNT_4_BIT;
-    }
-    if (sample_count <= 8 || VK_SAMPLE_COUNT_16_BIT > max_samples_mask) {
-      return VK_SAMPLE_COUNT_8_BIT;
-    }
-    if (sample_count <= 16 || VK_SAMPLE_COUNT_32_BIT > max_samples_mask) {
-      return VK_SAMPLE_COUNT_16_BIT;
-    }
-    if (sample_count <= 32 || VK_SAMPLE_COUNT_64_BIT > max_samples_mask) {
-      return VK_SAMPLE_COUNT_32_BIT;
-    }
-    return VK_SAMPLE_COUNT_64_BIT;
-  };
-
-  auto limits = vulkan_properties.base.limits.framebufferColorSampleCounts &
-                vulkan_properties.base.limits.framebufferDepthSampleCounts;
-
-  VkSampleCountFlagBits samples =
-    getVulkanSampleCountFlags(desc.sample_count, limits);
   VkPipelineMultisampleStateCreateInfo ci_ms{};
   ci_ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-  ci_ms.rasterizationSamples = samples;
+  ci_ms.rasterizationSamples = build.samples;
   ci_ms.sampleShadingEnable =
     desc.min_sample_shading > 0.0f ? VK_TRUE : VK_FALSE;
   ci_ms.minSampleShading = desc.min_sample_shading;
@@ -1706,20 +1922,28 @@ Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
   ci_cb.pAttachments = color_blend_attachment_states.data();
 
   VkPipelineTessellationStateCreateInfo ci_ts{};
-  bool has_tess = (shader->has_stage(ShaderStage::tessellation_control) &&
-                   shader->has_stage(ShaderStage::tessellation_evaluation)) &&
-                  desc.patch_control_points > 0;
-  if (has_tess) {
+  if (build.has_tessellation) {
     ci_ts.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
     ci_ts.patchControlPoints = desc.patch_control_points;
   }
 
   std::vector<VkPipelineShaderStageCreateInfo> stages;
-  shader->populate_stages(stages, si);
+  stages.reserve(build.stages.size());
+  for (const auto& [stage, module, entry_name] : build.stages) {
+    stages.push_back(VkPipelineShaderStageCreateInfo{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .stage = stage,
+      .module = module,
+      .pName = entry_name.c_str(),
+      .pSpecializationInfo = &si,
+    });
+  }
 
   VkPipelineRenderingCreateInfo ci_rendering{};
   ci_rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
-  ci_rendering.viewMask = viewMask;
+  ci_rendering.viewMask = build.view_mask;
   ci_rendering.colorAttachmentCount = colour_attachments_count;
   ci_rendering.pColorAttachmentFormats = color_attachment_formats.data();
   ci_rendering.depthAttachmentFormat = format_to_vk_format(desc.depth_format);
@@ -1739,19 +1963,332 @@ Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
   ci_gp.pDepthStencilState = &ci_ds;
   ci_gp.pColorBlendState = &ci_cb;
   ci_gp.pDynamicState = &ci_dynamic;
-  ci_gp.pTessellationState = has_tess ? &ci_ts : nullptr;
-  ci_gp.layout = layout;
+  ci_gp.pTessellationState = build.has_tessellation ? &ci_ts : nullptr;
+  ci_gp.layout = result.layout;
+
+  const auto res = vkCreateGraphicsPipelines(
+    build.device, build.cache, 1, &ci_gp, nullptr, &result.pipeline);
+  if (res != VK_SUCCESS) {
+    vkDestroyPipelineLayout(build.device, result.layout, nullptr);
+    result.layout = VK_NULL_HANDLE;
+    result.pipeline = VK_NULL_HANDLE;
+  }
+
+  result.milliseconds = elapsed_milliseconds(start);
+}
+
+template<typename PipelineType>
+auto
+Context::retire_pipeline(PipelineType& p) -> void
+{
+  if (p.pipeline == VK_NULL_HANDLE && p.layout == VK_NULL_HANDLE) {
+    return;
+  }
+  pre_frame_task([pipeline = std::exchange(p.pipeline, VK_NULL_HANDLE),
+                  layout = std::exchange(p.layout, VK_NULL_HANDLE)](auto& ctx) {
+    vkDestroyPipeline(
+      ctx.get_device(), pipeline, ctx.get_allocation_callbacks());
+    vkDestroyPipelineLayout(
+      ctx.get_device(), layout, ctx.get_allocation_callbacks());
+  });
+}
+
+template<typename PipelineType>
+auto
+Context::abandon_build(PipelineType& p) -> void
+{
+  if (p.pending_build) {
+    abandoned_pipeline_builds.push_back(std::move(p.pending_build));
+    p.pending_build = nullptr;
+  }
+}
+
+auto
+Context::destroy_build_result(const PipelineBuildResult& result) const -> void
+{
+  // Never recorded into a command buffer, so no need to defer this.
+  vkDestroyPipeline(get_device(), result.pipeline, get_allocation_callbacks());
+  vkDestroyPipelineLayout(
+    get_device(), result.layout, get_allocation_callbacks());
+}
+
+auto
+Context::reap_abandoned_pipeline_builds() -> void
+{
+  std::erase_if(abandoned_pipeline_builds, [this](const auto& build) {
+    if (!build->ready.load(std::memory_order_acquire)) {
+      return false;
+    }
+    destroy_build_result(*build);
+    return true;
+  });
+}
+
+auto
+Context::reap_retired_shader_modules() -> void
+{
+  const auto is_ready = [](const auto& build) {
+    return build->ready.load(std::memory_order_acquire);
+  };
+  std::erase_if(running_pipeline_builds, is_ready);
+  std::erase_if(retired_shader_modules, [&](const RetiredShaderModule& m) {
+    if (!immediate_commands->is_ready(m.handle) ||
+        !std::ranges::all_of(m.builds, is_ready)) {
+      return false;
+    }
+    vkDestroyShaderModule(get_device(), m.module, get_allocation_callbacks());
+    return true;
+  });
+}
+
+auto
+Context::get_pipeline_workers() -> ThreadPool&
+{
+  if (!pipeline_workers) {
+    pipeline_workers = std::make_unique<ThreadPool>();
+  }
+  return *pipeline_workers;
+}
+
+template<typename PipelineType>
+auto
+Context::start_build(PipelineType& p, const std::uint32_t view_mask) -> void
+{
+  auto result = std::make_shared<PipelineBuildResult>();
+  result->descriptor_set_layout = descriptor_set_layout;
+  result->view_mask = view_mask;
+  p.pending_build = result;
+  running_pipeline_builds.push_back(result);
+
+  get_pipeline_workers().submit(
+    [build = prepare_build(p, view_mask), result = std::move(result)] {
+      build_pipeline(build, *result);
+      result->ready.store(true, std::memory_order_release);
+    });
+}
+
+template<typename PipelineType>
+auto
+Context::install_pipeline(PipelineType& p, const PipelineBuildResult& result)
+  -> void
+{
+  // A failed build leaves whatever was there before in place.
+  if (result.pipeline == VK_NULL_HANDLE) {
+    std::cerr << std::format("Failed to build pipeline '{}', keeping the "
+                             "previous one\n",
+                             p.description.debug_name);
+    destroy_build_result(result);
+    return;
+  }
+  retire_pipeline(p);
+  p.pipeline = result.pipeline;
+  p.layout = result.layout;
+  p.last_descriptor_set_layout = result.descriptor_set_layout;
+  if constexpr (std::is_same_v<PipelineType, VkGraphicsPipeline>) {
+    p.view_mask = result.view_mask;
+  }
+  record_pipeline_build(result.milliseconds);
+}
+
+template<typename PipelineType>
+auto
+Context::resolve_pipeline(PipelineType& p, const std::uint32_t view_mask)
+  -> VkPipeline
+{
+  const auto matches_current = [this, view_mask](VkDescriptorSetLayout dsl,
+                                                 std::uint32_t mask) {
+    return dsl == descriptor_set_layout && mask == view_mask;
+  };
+
+  // Publish a finished background build, unless the descriptor set layout
+  // or view mask moved on while it was compiling.
+  if (p.pending_build &&
+      p.pending_build->ready.load(std::memory_order_acquire)) {
+    const auto finished = std::exchange(p.pending_build, nullptr);
+    if (matches_current(finished->descriptor_set_layout, finished->view_mask)) {
+      install_pipeline(p, *finished);
+    } else {
+      destroy_build_result(*finished);
+    }
+  }
+  if (p.pending_build &&
+      !matches_current(p.pending_build->descriptor_set_layout,
+                       p.pending_build->view_mask)) {
+    abandon_build(p);
+  }
+
+  std::uint32_t current_view_mask = 0;
+  if constexpr (std::is_same_v<PipelineType, VkGraphicsPipeline>) {
+    current_view_mask = p.view_mask;
+  }
+  if (p.pipeline != VK_NULL_HANDLE &&
+      !matches_current(p.last_descriptor_set_layout, current_view_mask)) {
+    retire_pipeline(p);
+  }
+
+  if (p.new_shader) {
+    p.new_shader = false;
+    abandon_build(p);
+    if (async_pipeline_compilation && p.pipeline != VK_NULL_HANDLE) {
+      // Keep drawing with the previous shader until the new one is built.
+      start_build(p, view_mask);
+    } else {
+      retire_pipeline(p);
+    }
+  }
+
+  if (p.pipeline != VK_NULL_HANDLE) {
+    return p.pipeline;
+  }
 
-  if (const auto res = vkCreateGraphicsPipelines(
-        get_device(), nullptr, 1, &ci_gp, nullptr, &pipeline);
-      res != VK_SUCCESS) {
+  // A pipeline that has never been built has nothing to fall back to, so in
+  // async mode its draws are skipped until the build lands. One that went
+  // stale is still rebuilt here, since skipping it would make everything it
+  // draws vanish for a few frames whenever the descriptor pool grows.
+  if (async_pipeline_compilation &&
+      p.last_descriptor_set_layout == VK_NULL_HANDLE) {
+    if (!p.pending_build) {
+      start_build(p, view_mask);
+    }
     return VK_NULL_HANDLE;
   }
 
-  rps->pipeline = pipeline;
-  rps->layout = layout;
+  abandon_build(p);
+  PipelineBuildResult result{};
+  result.descriptor_set_layout = descriptor_set_layout;
+  result.view_mask = view_mask;
+  build_pipeline(prepare_build(p, view_mask), result);
+  install_pipeline(p, result);
+
+  return p.pipeline;
+}
+
+auto
+Context::get_pipeline(ComputePipelineHandle handle) -> VkPipeline
+{
+  auto* cps = *compute_pipeline_pool.get(handle);
+
+  if (!cps) {
+    return VK_NULL_HANDLE;
+  }
+
+  update_resource_bindings();
+
+  return resolve_pipeline(*cps, 0);
+}
+
+auto
+Context::get_pipeline(GraphicsPipelineHandle handle, std::uint32_t viewMask)
+  -> VkPipeline
+{
+  auto* rps = *get_graphics_pipeline_pool().get(handle);
+
+  if (!rps) {
+    return VK_NULL_HANDLE;
+  }
+
+  return resolve_pipeline(*rps, viewMask);
+}
+
+auto
+Context::set_async_pipeline_compilation(const bool enabled) -> void
+{
+  async_pipeline_compilation = enabled;
+}
+
+template<typename PipelineType>
+auto
+Context::prewarm_pipelines(std::span<PipelineType*> pipelines,
+                           std::span<const std::uint32_t> view_masks)
+  -> std::vector<PipelineCompileTime>
+{
+  assert(view_masks.empty() || view_masks.size() == pipelines.size());
+
+  // Builds need the final descriptor set layout, or they would all be
+  // thrown away again on first use.
+  update_resource_bindings();
+
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  std::vector<std::shared_ptr<PipelineBuildResult>> results(pipelines.size());
+  std::vector<std::future<void>> builds{};
+  builds.reserve(pipelines.size());
+  for (auto i = 0U; i < pipelines.size(); ++i) {
+    auto* p = pipelines[i];
+    const auto view_mask = view_masks.empty() ? 0U : view_masks[i];
+    abandon_build(*p);
+    p->new_shader = false;
+
+    auto result = std::make_shared<PipelineBuildResult>();
+    result->descriptor_set_layout = descriptor_set_layout;
+    result->view_mask = view_mask;
+    results[i] = result;
+    builds.push_back(get_pipeline_workers().submit(
+      [build = prepare_build(*p, view_mask), result = std::move(result)] {
+        build_pipeline(build, *result);
+        result->ready.store(true, std::memory_order_release);
+      }));
+  }
+  for (auto& build : builds) {
+    build.get();
+  }
+
+  std::vector<PipelineCompileTime> timings{};
+  timings.reserve(pipelines.size());
+  double total_ms = 0.0;
+  for (auto i = 0U; i < pipelines.size(); ++i) {
+    install_pipeline(*pipelines[i], *results[i]);
+    timings.push_back({
+      .debug_name = pipelines[i]->description.debug_name,
+      .milliseconds = results[i]->milliseconds,
+    });
+    total_ms += results[i]->milliseconds;
+    std::cout << std::format("Prewarmed pipeline '{}' in {:.2f} ms\n",
+                             timings.back().debug_name,
+                             timings.back().milliseconds);
+  }
+  if (!timings.empty()) {
+    std::cout << std::format(
+      "Prewarmed {} pipelines on {} threads: {:.2f} ms of compilation in "
+      "{:.2f} ms\n",
+      timings.size(),
+      get_pipeline_workers().thread_count(),
+      total_ms,
+      elapsed_milliseconds(wall_start));
+  }
+
+  return timings;
+}
+
+auto
+Context::prewarm(std::span<const GraphicsPipelineHandle> handles,
+                 std::span<const std::uint32_t> view_masks)
+  -> std::vector<PipelineCompileTime>
+{
+  assert(view_masks.empty() || view_masks.size() == handles.size());
+
+  std::vector<VkGraphicsPipeline*> pipelines{};
+  std::vector<std::uint32_t> masks{};
+  for (auto i = 0U; i < handles.size(); ++i) {
+    if (auto maybe = graphics_pipeline_pool.get(handles[i]); maybe) {
+      pipelines.push_back(*maybe);
+      masks.push_back(view_masks.empty() ? 0U : view_masks[i]);
+    }
+  }
+  return prewarm_pipelines(std::span{ pipelines }, masks);
+}
 
-  return pipeline;
+auto
+Context::prewarm(std::span<const ComputePipelineHandle> handles)
+  -> std::vector<PipelineCompileTime>
+{
+  std::vector<VkComputePipeline*> pipelines{};
+  for (const auto handle : handles) {
+    if (auto maybe = compute_pipeline_pool.get(handle); maybe) {
+      pipelines.push_back(*maybe);
+    }
+  }
+  return prewarm_pipelines(std::span{ pipelines }, {});
 }
 
 auto
@@ -2018,6 +2555,7 @@ Context::destroy(const ComputePipelineHandle handle) -> void
     return;
   }
 
+  abandon_build(*pipeline);
   pre_frame_task([ptr = pipeline->get_pipeline(),
                   layout = pipeline->get_layout()](auto& ctx) {
     auto device = ctx.get_device();
@@ -2044,6 +2582,7 @@ Context::destroy(const GraphicsPipelineHandle handle) -> void
     return;
   }
 
+  abandon_build(*pipeline);
   pre_frame_task([ptr = pipeline->get_pipeline(),
                   layout = pipeline->get_layout()](auto& ctx) {
     auto device = ctx.get_device();
@@ -2093,8 +2632,21 @@ Context::destroy(const ShaderModuleHandle handle) -> void
     return;
   }
 
+  // Background builds only hold the raw modules, so any still running keep
+  // them alive until they finish.
+  std::erase_if(running_pipeline_builds, [](const auto& build) {
+    return build->ready.load(std::memory_order_acquire);
+  });
   for (const auto shader = *maybe_shader.value();
        const auto& module : shader.get_modules()) {
+    if (!running_pipeline_builds.empty()) {
+      retired_shader_modules.push_back({
+        .module = module.module,
+        .handle = last_referencing_submit(),
+        .builds = running_pipeline_builds,
+      });
+      continue;
+    }
     pre_frame_task([m = module.module](auto& ctx) {
       vkDestroyShaderModule(
         ctx.get_device(), m, ctx.get_allocation_callbacks());
@@ -2121,6 +2673,22 @@ StagingAllocator::StagingAllocator(IContext& ctx)
     std::min(max_memory_allocation_size, max_staging_buffer_size));
   min_buffer_size =
     static_cast<std::uint32_t>(std::min(min_buffer_size, max_buffer_size));
+
+  timelines[std::to_underlying(UploadQueue::Graphics)].semaphore =
+    create_timeline_semaphore(
+      context.get_device(), 0, "Graphics Upload Timeline");
+  if (context.transfer_commands != nullptr) {
+    timelines[std::to_underlying(UploadQueue::Transfer)].semaphore =
+      create_timeline_semaphore(
+        context.get_device(), 0, "Transfer Upload Timeline");
+  }
+}
+
+StagingAllocator::~StagingAllocator()
+{
+  for (const auto& timeline : timelines) {
+    vkDestroySemaphore(context.get_device(), timeline.semaphore, nullptr);
+  }
 }
 
 void
@@ -2129,21 +2697,30 @@ StagingAllocator::upload(VkDataBuffer& buffer,
                          std::size_t size,
                          const void* data)
 {
-  if (buffer.is_mapped()) {
+  // Host-visible destinations, ReBAR included, are written in place until
+  // frames may be reading them; re-uploads of live buffers are copied
+  // through the staging buffer, ordered on the graphics queue.
+  if (buffer.is_writable_in_place()) {
     buffer.upload(std::span(static_cast<const std::byte*>(data), size),
                   dstOffset);
+    if (!(buffer.get_memory_flags() & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+      context.get_allocator_implementation().flush_allocation(
+        buffer.get_buffer(), dstOffset, size);
+    }
+    buffer.set_initialised();
     return;
   }
 
-  auto* stagingBuffer = *context.get_buffer_pool().get(staging_buffer);
-
-  assert(nullptr != stagingBuffer);
-
+  const auto queue = upload_queue(buffer);
+  buffer.set_initialised();
   while (size) {
     // get next staging buffer free offset
-    auto desc = get_next_free_offset(static_cast<uint32_t>(size));
+    auto desc = allocate(size, queue);
     const auto chunkSize = std::min(static_cast<uint64_t>(size), desc.size);
 
+    auto* stagingBuffer = *context.get_buffer_pool().get(staging_buffer);
+    assert(nullptr != stagingBuffer);
+
     // copy data into staging buffer
     stagingBuffer->upload(
       std::span(static_cast<const std::byte*>(data), chunkSize), desc.offset);
@@ -2155,54 +2732,45 @@ StagingAllocator::upload(VkDataBuffer& buffer,
       .size = chunkSize,
     };
 
-    const auto& wrapper = context.immediate_commands->acquire();
+    const auto& wrapper = begin_upload(queue);
     vkCmdCopyBuffer(wrapper.command_buffer,
                     stagingBuffer->get_buffer(),
                     buffer.get_buffer(),
                     1,
                     &copy);
-    VkBufferMemoryBarrier barrier = {
-      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    VkBufferMemoryBarrier2 barrier = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
       .pNext = nullptr,
-
-      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-      .dstAccessMask = 0,
+      .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+      .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+      .dstAccessMask = VK_ACCESS_2_NONE,
       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
       .buffer = buffer.get_buffer(),
       .offset = dstOffset,
       .size = chunkSize,
     };
-    VkPipelineStageFlags dstMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
     if (buffer.get_usage_flags() & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) {
-      dstMask |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
-      barrier.dstAccessMask |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+      barrier.dstStageMask |= VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+      barrier.dstAccessMask |= VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
     }
     if (buffer.get_usage_flags() & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
-      dstMask |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
-      barrier.dstAccessMask |= VK_ACCESS_INDEX_READ_BIT;
+      barrier.dstStageMask |= VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+      barrier.dstAccessMask |= VK_ACCESS_2_INDEX_READ_BIT;
     }
     if (buffer.get_usage_flags() & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
-      dstMask |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
-      barrier.dstAccessMask |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+      barrier.dstStageMask |= VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+      barrier.dstAccessMask |= VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT;
     }
     if (buffer.get_usage_flags() &
         VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR) {
-      dstMask |= VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
-      barrier.dstAccessMask |= VK_ACCESS_MEMORY_READ_BIT;
+      barrier.dstStageMask |=
+        VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+      barrier.dstAccessMask |= VK_ACCESS_2_MEMORY_READ_BIT;
     }
-    vkCmdPipelineBarrier(wrapper.command_buffer,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         dstMask,
-                         VkDependencyFlags{},
-                         0,
-                         nullptr,
-                         1,
-                         &barrier,
-                         0,
-                         nullptr);
-    desc.handle = context.immediate_commands->submit(wrapper);
-    regions.push_back(desc);
+    make_visible(barrier, queue);
+    finish_upload(queue);
 
     size -= chunkSize;
     data = std::bit_cast<std::uint8_t*>(data) + chunkSize;
@@ -2216,16 +2784,16 @@ struct StageAccess
   VkAccessFlags2 access;
 };
 
-void
-imageMemoryBarrier2(VkCommandBuffer buffer,
-                    VkImage image,
-                    StageAccess src,
-                    StageAccess dst,
-                    VkImageLayout oldImageLayout,
-                    VkImageLayout newImageLayout,
-                    VkImageSubresourceRange subresourceRange)
+auto
+make_image_barrier(VkImage image,
+                   StageAccess src,
+                   StageAccess dst,
+                   VkImageLayout oldImageLayout,
+                   VkImageLayout newImageLayout,
+                   VkImageSubresourceRange subresourceRange)
+  -> VkImageMemoryBarrier2
 {
-  const VkImageMemoryBarrier2 barrier = {
+  return {
     .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
     .pNext = nullptr,
     .srcStageMask = src.stage,
@@ -2239,6 +2807,19 @@ imageMemoryBarrier2(VkCommandBuffer buffer,
     .image = image,
     .subresourceRange = subresourceRange,
   };
+}
+
+void
+imageMemoryBarrier2(VkCommandBuffer buffer,
+                    VkImage image,
+                    StageAccess src,
+                    StageAccess dst,
+                    VkImageLayout oldImageLayout,
+                    VkImageLayout newImageLayout,
+                    VkImageSubresourceRange subresourceRange)
+{
+  const auto barrier = make_image_barrier(
+    image, src, dst, oldImageLayout, newImageLayout, subresourceRange);
 
   const VkDependencyInfo dependency_info = {
     .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
@@ -2255,6 +2836,31 @@ imageMemoryBarrier2(VkCommandBuffer buffer,
   vkCmdPipelineBarrier2(buffer, &dependency_info);
 }
 
+auto
+record_barriers(VkCommandBuffer buffer,
+                std::span<const VkBufferMemoryBarrier2> buffer_barriers,
+                std::span<const VkImageMemoryBarrier2> image_barriers) -> void
+{
+  if (buffer_barriers.empty() && image_barriers.empty()) {
+    return;
+  }
+
+  const VkDependencyInfo dependency_info = {
+    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .pNext = nullptr,
+    .dependencyFlags = 0,
+    .memoryBarrierCount = 0,
+    .pMemoryBarriers = nullptr,
+    .bufferMemoryBarrierCount =
+      static_cast<std::uint32_t>(buffer_barriers.size()),
+    .pBufferMemoryBarriers = buffer_barriers.data(),
+    .imageMemoryBarrierCount =
+      static_cast<std::uint32_t>(image_barriers.size()),
+    .pImageMemoryBarriers = image_barriers.data(),
+  };
+  vkCmdPipelineBarrier2(buffer, &dependency_info);
+}
+
 struct TextureFormatProperties
 {
   Format format{ Format::Invalid };
@@ -2308,6 +2914,21 @@ constexpr auto properties = std::to_array<TextureFormatProperties>({
     .block_width = 4,
     .block_height = 4,
     .compressed = true },
+  { .format = Format::BC7_SRGB,
+    .bytes_per_block = 16,
+    .block_width = 4,
+    .block_height = 4,
+    .compressed = true },
+  { .format = Format::BC4_R,
+    .bytes_per_block = 8,
+    .block_width = 4,
+    .block_height = 4,
+    .compressed = true },
+  { .format = Format::BC5_RG,
+    .bytes_per_block = 16,
+    .block_width = 4,
+    .block_height = 4,
+    .compressed = true },
   { .format = Format::Z_UN16, .bytes_per_block = 2, .depth = true },
   { .format = Format::Z_UN24, .bytes_per_block = 3, .depth = true },
   { .format = Format::Z_F32, .bytes_per_block = 4, .depth = true },
@@ -2427,6 +3048,9 @@ StagingAllocator::generate_mipmaps(VkTexture& texture,
                                    uint32_t mip_levels,
                                    uint32_t layers)
 {
+  // Blits read the base level, so its upload must be submitted first.
+  flush();
+
   const auto& wrapper = context.immediate_commands->acquire();
   VkImage image = texture.get_image();
 
@@ -2606,12 +3230,9 @@ StagingAllocator::upload_blob_with_regions(
   const void* blob,
   uint32_t blob_size) -> void
 {
-  ensure_size(blob_size);
-  auto desc = get_next_free_offset(blob_size);
-  if (desc.size < blob_size) {
-    wait_and_reset();
-    desc = get_next_free_offset(blob_size);
-  }
+  const auto queue = upload_queue(image.get_layout());
+  const auto desc = allocate(blob_size, queue);
+  assert(desc.size >= blob_size);
 
   auto* staging = *context.get_buffer_pool().get(staging_buffer);
   staging->upload(std::span(static_cast<const std::byte*>(blob), blob_size),
@@ -2625,7 +3246,7 @@ StagingAllocator::upload_blob_with_regions(
     copy_regions.push_back(rr);
   }
 
-  const auto& w = context.immediate_commands->acquire();
+  const auto& w = begin_upload(queue);
 
   VkImageSubresourceRange range{};
   range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -2651,20 +3272,20 @@ StagingAllocator::upload_blob_with_regions(
                          static_cast<uint32_t>(copy_regions.size()),
                          copy_regions.data());
 
-  imageMemoryBarrier2(
-    w.command_buffer,
-    image.get_image(),
-    { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT },
-    { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-      VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT },
-    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-    range);
+  make_visible(
+    make_image_barrier(
+      image.get_image(),
+      { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT },
+      { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT },
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      range),
+    queue);
 
   image.set_layout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-  desc.handle = context.immediate_commands->submit(w);
-  this->regions.push_back(desc);
+  finish_upload(queue);
 }
 
 void
@@ -2711,21 +3332,16 @@ StagingAllocator::upload(VkTexture& image,
 
   const std::uint32_t storage_size = layerStorageSize * num_layers;
 
-  ensure_size(storage_size);
-
-  assert(storage_size <= staging_buffer_size);
+  const auto old_layout =
+    coversFullImage ? VK_IMAGE_LAYOUT_UNDEFINED : image.get_layout();
+  const auto queue = upload_queue(old_layout);
 
-  auto desc = get_next_free_offset(storage_size);
-  // No support for copying image in multiple smaller chunk sizes. If we get
-  // smaller buffer size than storage_size, we will wait for GPU idle and get
-  // bigger chunk.
-  if (desc.size < storage_size) {
-    wait_and_reset();
-    desc = get_next_free_offset(storage_size);
-  }
+  // No support for copying image in multiple smaller chunk sizes: the
+  // allocation holds every level and layer being uploaded.
+  const auto desc = allocate(storage_size, queue);
   assert(desc.size >= storage_size);
 
-  const auto& wrapper = context.immediate_commands->acquire();
+  const auto& wrapper = begin_upload(queue);
 
   auto* stagingBuffer = *context.get_buffer_pool().get(staging_buffer);
 
@@ -2771,7 +3387,7 @@ StagingAllocator::upload(VkTexture& image,
                      .access = VK_ACCESS_2_NONE },
         StageAccess{ .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
                      .access = VK_ACCESS_2_TRANSFER_WRITE_BIT },
-        coversFullImage ? VK_IMAGE_LAYOUT_UNDEFINED : image.get_layout(),
+        old_layout,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         VkImageSubresourceRange{
           imageAspect,
@@ -2828,23 +3444,24 @@ StagingAllocator::upload(VkTexture& image,
       }
 
       // 3. Transition TRANSFER_DST_OPTIMAL into SHADER_READ_ONLY_OPTIMAL
-      imageMemoryBarrier2(
-        wrapper.command_buffer,
-        image.get_image(),
-        StageAccess{ .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
-                     .access = VK_ACCESS_2_TRANSFER_WRITE_BIT },
-        StageAccess{ .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-                     .access = VK_ACCESS_2_MEMORY_READ_BIT |
-                               VK_ACCESS_2_MEMORY_WRITE_BIT },
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VkImageSubresourceRange{
-          imageAspect,
-          currentMipLevel,
-          1,
-          l + layer,
-          1,
-        });
+      make_visible(
+        make_image_barrier(
+          image.get_image(),
+          StageAccess{ .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                       .access = VK_ACCESS_2_TRANSFER_WRITE_BIT },
+          StageAccess{ .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                       .access = VK_ACCESS_2_MEMORY_READ_BIT |
+                                 VK_ACCESS_2_MEMORY_WRITE_BIT },
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+          VkImageSubresourceRange{
+            imageAspect,
+            currentMipLevel,
+            1,
+            l + layer,
+            1,
+          }),
+        queue);
 
       offset += get_texture_bytes_per_layer(imageRegion.extent.width,
                                             imageRegion.extent.height,
@@ -2855,8 +3472,7 @@ StagingAllocator::upload(VkTexture& image,
 
   image.set_layout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-  desc.handle = context.immediate_commands->submit(wrapper);
-  regions.push_back(desc);
+  finish_upload(queue);
 }
 
 void
@@ -2865,19 +3481,15 @@ StagingAllocator::upload(VkTexture& image,
                          std::size_t data_bytes,
                          std::span<const VkBufferImageCopy> copies)
 {
-  ensure_size(static_cast<std::uint32_t>(data_bytes));
-
-  auto desc = get_next_free_offset(static_cast<std::uint32_t>(data_bytes));
-  if (desc.size < data_bytes) {
-    wait_and_reset();
-    desc = get_next_free_offset(static_cast<std::uint32_t>(data_bytes));
-  }
+  const auto queue = upload_queue(image.get_layout());
+  const auto desc = allocate(data_bytes, queue);
+  assert(desc.size >= data_bytes);
 
   auto* real_buffer = *context.get_buffer_pool().get(*this->staging_buffer);
   real_buffer->upload(
     std::span(static_cast<const std::byte*>(data), data_bytes), desc.offset);
 
-  const auto& wrapper = context.immediate_commands->acquire();
+  const auto& wrapper = begin_upload(queue);
 
   VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
 
@@ -2907,21 +3519,21 @@ StagingAllocator::upload(VkTexture& image,
                          static_cast<uint32_t>(patched.size()),
                          patched.data());
 
-  imageMemoryBarrier2(
-    wrapper.command_buffer,
-    image.get_image(),
-    { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT },
-    { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-      VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT },
-    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-    VkImageSubresourceRange{
-      aspect, 0, image.get_mip_levels(), 0, image.get_array_layers() });
+  make_visible(
+    make_image_barrier(
+      image.get_image(),
+      { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT },
+      { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT },
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VkImageSubresourceRange{
+        aspect, 0, image.get_mip_levels(), 0, image.get_array_layers() }),
+    queue);
 
   image.set_layout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-  desc.handle = context.immediate_commands->submit(wrapper);
-  regions.push_back(desc);
+  finish_upload(queue);
 }
 
 void
@@ -2944,19 +3556,13 @@ StagingAllocator::ensure_size(std::uint32_t size_needed)
     }
   }
 
-  wait_and_reset();
+  // Recorded copies still read the old buffer. Deferred destruction keeps it
+  // alive until they finish, so they only need submitting, not waiting on.
+  flush();
 
   // deallocate the previous staging buffer
   staging_buffer = nullptr;
 
-  // if the combined size of the new staging buffer and the existing one is
-  // larger than the limit imposed by some architectures on buffers that are
-  // device and host visible, we need to wait for the current buffer to be
-  // destroyed before we can allocate a new one
-  if ((size_needed + staging_buffer_size) > max_staging_buffer_size) {
-    context.process_callbacks();
-  }
-
   staging_buffer_size = size_needed;
 
   auto name = std::format("Staging Buffer {}", staging_buffer_count++);
@@ -2965,112 +3571,252 @@ StagingAllocator::ensure_size(std::uint32_t size_needed)
     context,
     {
       .size = staging_buffer_size,
-      .storage = StorageType::DeviceLocal,
-      .usage = BufferUsageFlags::TransferDst | BufferUsageFlags::TransferSrc,
+      .storage = StorageType::Staging,
+      .usage = BufferUsageFlags::TransferSrc,
       .debug_name = name,
     });
 
   assert(!staging_buffer.empty());
 
-  regions.clear();
-  regions.push_back({ 0, staging_buffer_size, SubmitHandle() });
+  head = 0;
+  tail = 0;
+  in_flight.clear();
 }
 
 auto
-StagingAllocator::get_next_free_offset(uint32_t size)
-  -> StagingAllocator::MemoryRegionDescription
-{
-  const auto requestedAlignedSize =
-    get_aligned_size(size, staging_buffer_alignment);
+StagingAllocator::allocate(const std::uint64_t size, const UploadQueue queue)
+  -> MemoryRegionDescription
+{
+  ensure_size(static_cast<std::uint32_t>(
+    std::min<std::uint64_t>(size, max_staging_buffer_size)));
+  const auto aligned_size = std::min<std::uint64_t>(
+    get_aligned_size(size, staging_buffer_alignment), staging_buffer_size);
+
+  while (true) {
+    retire();
+
+    // Free space is [head, end) plus [0, tail) when the ring has not
+    // wrapped, and [head, tail) when it has. head only meets tail when the
+    // ring is empty.
+    std::optional<std::uint64_t> offset;
+    if (head >= tail) {
+      if (staging_buffer_size - head >= aligned_size) {
+        offset = head;
+      } else if (tail > aligned_size) {
+        offset = 0;
+      }
+    } else if (tail - head > aligned_size) {
+      offset = head;
+    }
+
+    if (offset) {
+      head = *offset + aligned_size;
+      in_flight.push_back({
+        .offset = *offset,
+        .queue = queue,
+        .value = timelines[std::to_underlying(queue)].submitted + 1,
+      });
+      return { .offset = *offset, .size = aligned_size };
+    }
+
+    wait_for_oldest();
+  }
+}
 
-  ensure_size(static_cast<std::uint32_t>(requestedAlignedSize));
+auto
+StagingAllocator::retire() -> void
+{
+  while (!in_flight.empty()) {
+    const auto& oldest = in_flight.front();
+    auto& timeline = timelines[std::to_underlying(oldest.queue)];
+    if (oldest.value > timeline.completed &&
+        oldest.value <= timeline.submitted) {
+      VK_VERIFY(vkGetSemaphoreCounterValue(
+        context.get_device(), timeline.semaphore, &timeline.completed));
+    }
+    if (oldest.value > timeline.completed) {
+      break;
+    }
+    in_flight.pop_front();
+  }
 
-  assert(!regions.empty());
+  if (in_flight.empty()) {
+    head = 0;
+    tail = 0;
+  } else {
+    tail = in_flight.front().offset;
+  }
+}
 
-  // if we can't find an available region that is big enough to store
-  // requestedAlignedSize, return whatever we could find, which will be stored
-  // in bestNextIt
-  auto bestNextIt = regions.begin();
+auto
+StagingAllocator::wait_for_oldest() -> void
+{
+  assert(!in_flight.empty());
 
-  for (auto it = regions.begin(); it != regions.end(); ++it) {
-    if (context.immediate_commands->is_ready(it->handle)) {
-      // This region is free, but is it big enough?
-      if (it->size >= requestedAlignedSize) {
-        // It is big enough!
-        const auto unusedSize = it->size - requestedAlignedSize;
-        const auto unusedOffset = it->offset + requestedAlignedSize;
+  const auto oldest = in_flight.front();
+  auto& timeline = timelines[std::to_underlying(oldest.queue)];
+  if (oldest.value > timeline.submitted) {
+    flush(oldest.queue);
+  }
 
-        // Return this region and add the remaining unused size to the regions
-        // deque
-        SCOPE_EXIT
-        {
-          regions.erase(it);
-          if (unusedSize > 0) {
-            regions.insert(regions.begin(),
-                           { unusedOffset, unusedSize, SubmitHandle() });
-          }
-        };
+  const VkSemaphoreWaitInfo wait_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+    .pNext = nullptr,
+    .flags = 0,
+    .semaphoreCount = 1,
+    .pSemaphores = &timeline.semaphore,
+    .pValues = &oldest.value,
+  };
+  VK_VERIFY(vkWaitSemaphores(context.get_device(), &wait_info, UINT64_MAX));
+  timeline.completed = std::max(timeline.completed, oldest.value);
+}
 
-        return { it->offset, requestedAlignedSize, SubmitHandle() };
-      }
-      // cache the largest available region that isn't as big as the one we're
-      // looking for
-      if (it->size > bestNextIt->size) {
-        bestNextIt = it;
-      }
-    }
+auto
+StagingAllocator::upload_queue(const VkImageLayout old_layout) const
+  -> UploadQueue
+{
+  // Moving an initialised image to the transfer queue would need a release
+  // from graphics first; not worth it for partial updates.
+  if (context.transfer_commands == nullptr ||
+      old_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+    return UploadQueue::Graphics;
   }
+  return UploadQueue::Transfer;
+}
 
-  // we found a region that is available that is smaller than the requested
-  // size. It's the best we can do
-  if (bestNextIt != regions.end() &&
-      context.immediate_commands->is_ready(bestNextIt->handle)) {
-    SCOPE_EXIT
-    {
-      regions.erase(bestNextIt);
-    };
+auto
+StagingAllocator::upload_queue(const VkDataBuffer& buffer) const
+  -> UploadQueue
+{
+  return buffer.is_initialised() ? UploadQueue::Graphics : upload_queue();
+}
 
-    return { bestNextIt->offset, bestNextIt->size, SubmitHandle() };
+auto
+StagingAllocator::commands_for(const UploadQueue queue) const
+  -> ImmediateCommands&
+{
+  return queue == UploadQueue::Transfer ? *context.transfer_commands
+                                        : *context.immediate_commands;
+}
+
+auto
+StagingAllocator::begin_batch() -> void
+{
+  ++batch_depth;
+}
+
+auto
+StagingAllocator::end_batch() -> SubmitHandle
+{
+  assert(batch_depth > 0);
+  if (--batch_depth > 0) {
+    return {};
   }
+  return flush();
+}
 
-  // nothing was available. Let's wait for the entire staging buffer to become
-  // free
-  wait_and_reset();
+auto
+StagingAllocator::begin_upload(const UploadQueue queue)
+  -> const CommandBufferWrapper&
+{
+  auto& batch = pending[std::to_underlying(queue)];
+  if (batch.wrapper == nullptr) {
+    batch.wrapper = &commands_for(queue).acquire();
+  }
+  return *batch.wrapper;
+}
 
-  // waitAndReset() adds a region that spans the entire buffer. Since we'll be
-  // using part of it, we need to replace it with a used block and an unused
-  // portion
-  regions.clear();
+auto
+StagingAllocator::make_visible(VkBufferMemoryBarrier2 barrier,
+                               const UploadQueue queue) -> void
+{
+  auto& batch = pending[std::to_underlying(queue)];
+  if (queue == UploadQueue::Transfer) {
+    barrier.srcQueueFamilyIndex = context.transfer_queue_family;
+    barrier.dstQueueFamilyIndex = context.graphics_queue_family;
 
-  // store the unused size in the deque first...
-  const uint64_t unusedSize = staging_buffer_size > requestedAlignedSize
-                                ? staging_buffer_size - requestedAlignedSize
-                                : 0;
+    auto acquire = barrier;
+    acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+    acquire.srcAccessMask = VK_ACCESS_2_NONE;
+    batch.buffer_acquires.push_back(acquire);
 
-  if (unusedSize) {
-    const uint64_t unusedOffset = staging_buffer_size - unusedSize;
-    regions.insert(regions.begin(),
-                   { unusedOffset, unusedSize, SubmitHandle() });
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    barrier.dstAccessMask = VK_ACCESS_2_NONE;
   }
+  batch.buffer_barriers.push_back(barrier);
+}
 
-  // ...and then return the smallest free region that can hold the requested
-  // size
-  return {
-    .offset = 0,
-    .size = staging_buffer_size - unusedSize,
-    .handle = SubmitHandle(),
-  };
+auto
+StagingAllocator::make_visible(VkImageMemoryBarrier2 barrier,
+                               const UploadQueue queue) -> void
+{
+  auto& batch = pending[std::to_underlying(queue)];
+  if (queue == UploadQueue::Transfer) {
+    barrier.srcQueueFamilyIndex = context.transfer_queue_family;
+    barrier.dstQueueFamilyIndex = context.graphics_queue_family;
+
+    // Both halves carry the same layout transition, which runs once.
+    auto acquire = barrier;
+    acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+    acquire.srcAccessMask = VK_ACCESS_2_NONE;
+    batch.image_acquires.push_back(acquire);
+
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    barrier.dstAccessMask = VK_ACCESS_2_NONE;
+  }
+  batch.image_barriers.push_back(barrier);
 }
 
-void
-StagingAllocator::wait_and_reset()
+auto
+StagingAllocator::finish_upload(const UploadQueue queue) -> void
 {
-  for (const auto& r : regions) {
-    context.immediate_commands->wait(r.handle);
-  };
+  if (batch_depth == 0) {
+    flush(queue);
+  }
+}
 
-  regions.clear();
-  regions.push_back({ 0, staging_buffer_size, SubmitHandle() });
+auto
+StagingAllocator::flush() -> SubmitHandle
+{
+  // Transfer first: it queues the graphics-side acquire, which any graphics
+  // uploads below are then chained behind.
+  const auto acquired = flush(UploadQueue::Transfer);
+  const auto submitted = flush(UploadQueue::Graphics);
+  return submitted.empty() ? acquired : submitted;
+}
+
+auto
+StagingAllocator::flush(const UploadQueue queue) -> SubmitHandle
+{
+  auto& batch = pending[std::to_underlying(queue)];
+  if (batch.wrapper == nullptr) {
+    return {};
+  }
+
+  record_barriers(batch.wrapper->command_buffer,
+                  batch.buffer_barriers,
+                  batch.image_barriers);
+
+  auto& commands = commands_for(queue);
+  auto& timeline = timelines[std::to_underlying(queue)];
+  const auto value = ++timeline.submitted;
+  commands.signal_semaphore(timeline.semaphore, value);
+  const auto handle = commands.submit(*batch.wrapper);
+  if (queue == UploadQueue::Graphics) {
+    batch = PendingUploads{};
+    return handle;
+  }
+
+  // The acquire waits on the GPU for the copies, not on the CPU. Immediate
+  // submissions are chained, so only graphics work submitted after this
+  // point is ordered behind the upload; frames already queued keep running.
+  auto& graphics = *context.immediate_commands;
+  const auto& acquire = graphics.acquire();
+  record_barriers(
+    acquire.command_buffer, batch.buffer_acquires, batch.image_acquires);
+  graphics.wait_timeline_semaphore(timeline.semaphore, value);
+  batch = PendingUploads{};
+  return graphics.submit(acquire);
 }
 
 #pragma endregion StagingAllocator
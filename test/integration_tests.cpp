@@ -3,11 +3,18 @@
 #include "vk-bindless/graphics_context.hpp"
 #include "vk-bindless/holder.hpp"
 #include "vk-bindless/object_pool.hpp"
+#include "vk-bindless/texture_streamer.hpp"
 #include "vk-bindless/vulkan_context.hpp"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <ktx.h>
+#include <thread>
+#include <vector>
+
 TEST_CASE("Integration test with real VkSurfaceKHR")
 {
   // Get a surface
@@ -85,4 +92,84 @@ TEST_CASE("Create a white texture and make sure it's valid")
   auto texture = maybe_texture.value();
   REQUIRE(texture->is_sampled());
   REQUIRE(texture->is_storage());
-}
\ No newline at end of file
+}
+
+TEST_CASE("Streamed mips move the texture to a new slot")
+{
+  glfwInit();
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  GLFWwindow* window =
+    glfwCreateWindow(800, 600, "Test Window", nullptr, nullptr);
+  auto vulkan_context =
+    VkBindless::Context::create([win = window](VkInstance instance) {
+      VkSurfaceKHR surface;
+      if (glfwCreateWindowSurface(instance, win, nullptr, &surface) !=
+          VK_SUCCESS) {
+        glfwDestroyWindow(win);
+        glfwTerminate();
+      }
+      return surface;
+    });
+
+  REQUIRE(vulkan_context.has_value());
+  auto& context = vulkan_context.value();
+
+  ktxTextureCreateInfo info{};
+  info.vkFormat = VK_FORMAT_R8G8B8A8_UNORM;
+  info.baseWidth = 16;
+  info.baseHeight = 16;
+  info.baseDepth = 1;
+  info.numDimensions = 2;
+  info.numLevels = 5;
+  info.numLayers = 1;
+  info.numFaces = 1;
+  ktxTexture2* source = nullptr;
+  REQUIRE(ktxTexture2_Create(
+            &info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &source) == KTX_SUCCESS);
+
+  {
+    VkBindless::TextureStreamer streamer{ *context,
+                                          { .resident_tail_extent = 4 } };
+    const auto original = streamer.add(
+      source, VkBindless::Format::RGBA_UN8, "Streamed Test Texture");
+    REQUIRE(streamer.resident_mip(original) > 0);
+
+    auto handle = original;
+    std::vector<VkBindless::TextureStreamer::TextureMove> moves;
+    streamer.add_listener([&](const auto moved) {
+      for (const auto& move : moved) {
+        moves.push_back(move);
+        if (move.from == handle) {
+          handle = move.to;
+        }
+      }
+    });
+
+    auto& pool = context->get_texture_pool();
+    pool.consume_dirty_slots([](std::uint32_t, const auto*) {});
+
+    for (auto i = 0; i < 1000 && streamer.resident_mip(handle) > 0; ++i) {
+      streamer.request(handle, 16.0F);
+      streamer.update();
+      std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+    REQUIRE(streamer.resident_mip(handle) == 0);
+    REQUIRE(!moves.empty());
+    CHECK(moves.front().from == original);
+    CHECK(handle.index() != original.index());
+
+    // No frame was submitted, so the release of the original slot is still
+    // deferred: it stays alive, with its descriptor untouched.
+    CHECK(pool.get(original).has_value());
+    std::vector<std::uint32_t> dirty;
+    pool.consume_dirty_slots(
+      [&](std::uint32_t slot, const auto*) { dirty.push_back(slot); });
+    CHECK(std::ranges::find(dirty, handle.index()) != dirty.end());
+    CHECK(std::ranges::find(dirty, original.index()) == dirty.end());
+  }
+
+  ktxTexture2_Destroy(source);
+  glfwTerminate();
+}
@@ -3,9 +3,28 @@
 
 #include "vk-bindless/graphics_context.hpp"
 #include "vk-bindless/holder.hpp"
+#include "vk-bindless/mapped_file.hpp"
+#include "vk-bindless/mesh.hpp"
+#include "vk-bindless/mip_generator.hpp"
 #include "vk-bindless/object_pool.hpp"
+#include "vk-bindless/pipeline_cache.hpp"
+#include "vk-bindless/shader_cache.hpp"
+#include "vk-bindless/thread_pool.hpp"
 #include "vk-bindless/vulkan_context.hpp"
 
+#include <algorithm>
+#include <assimp/mesh.h>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
 using namespace VkBindless;
 
 TEST_CASE("Vulkan Context Creation") {
@@ -119,3 +138,461 @@ TEST_CASE("Pool find_object returns correct handle") {
   REQUIRE(found.valid());
   CHECK(found.index() == h.index());
 }
+
+TEST_CASE("Pool reports dirty slots once, in ascending order") {
+  Pool<DummyTag, DummyImpl> pool;
+  auto h0 = pool.create(DummyImpl{0});
+  auto h1 = pool.create(DummyImpl{1});
+  auto h2 = pool.create(DummyImpl{2});
+  (void)h0;
+  (void)h2;
+
+  CHECK(pool.destroy(h1).has_value());
+
+  std::vector<std::uint32_t> seen;
+  std::uint32_t freed = 0;
+  pool.consume_dirty_slots([&](std::uint32_t slot, const DummyImpl *object) {
+    seen.push_back(slot);
+    if (object == nullptr)
+      ++freed;
+  });
+  CHECK(seen == std::vector<std::uint32_t>{0, 1, 2});
+  CHECK(freed == 1);
+  CHECK(!pool.has_dirty_slots());
+
+  auto h3 = pool.create(DummyImpl{3});
+  CHECK(h3.index() == h1.index());
+  seen.clear();
+  pool.consume_dirty_slots(
+      [&](std::uint32_t slot, const DummyImpl *) { seen.push_back(slot); });
+  CHECK(seen == std::vector<std::uint32_t>{h1.index()});
+
+  pool.mark_all_dirty();
+  seen.clear();
+  pool.consume_dirty_slots(
+      [&](std::uint32_t slot, const DummyImpl *) { seen.push_back(slot); });
+  CHECK(seen.size() == pool.slot_count());
+}
+
+TEST_CASE("Pool for_each_valid skips freed slots across words") {
+  Pool<DummyTag, DummyImpl> pool;
+  std::vector<Handle<DummyTag>> handles;
+  for (int i = 0; i < 200; ++i)
+    handles.push_back(pool.create(DummyImpl{i}));
+
+  for (int i = 0; i < 200; i += 3)
+    CHECK(pool.destroy(handles[i]).has_value());
+
+  std::vector<int> visited;
+  pool.for_each_valid(
+      [&](const DummyImpl &object) { visited.push_back(object.value); });
+
+  CHECK(visited.size() == pool.size());
+  CHECK(std::ranges::is_sorted(visited));
+  CHECK(std::ranges::none_of(visited, [](int v) { return v % 3 == 0; }));
+}
+
+TEST_CASE("Pipeline cache blob round-trips and rejects other devices") {
+  PipelineCacheIdentity identity{
+      .vendor_id = 0x10de, .device_id = 0x2684, .driver_version = 42};
+  identity.pipeline_cache_uuid.fill(7);
+  identity.driver_uuid.fill(9);
+
+  VkPipelineCacheHeaderVersionOne vk_header{};
+  vk_header.headerSize = sizeof(vk_header);
+  vk_header.headerVersion = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+  vk_header.vendorID = identity.vendor_id;
+  vk_header.deviceID = identity.device_id;
+  std::ranges::fill(vk_header.pipelineCacheUUID, std::uint8_t{7});
+
+  std::vector<std::uint8_t> payload(sizeof(vk_header) + 16, 0xab);
+  std::memcpy(payload.data(), &vk_header, sizeof(vk_header));
+
+  auto blob = serialise_pipeline_cache_blob(payload, identity);
+  auto valid = validate_pipeline_cache_blob(blob, identity);
+  REQUIRE(valid.has_value());
+  CHECK(std::ranges::equal(*valid, payload));
+
+  auto other_driver = identity;
+  other_driver.driver_version = 43;
+  CHECK(!validate_pipeline_cache_blob(blob, other_driver).has_value());
+
+  blob.back() ^= 0xff;
+  CHECK(!validate_pipeline_cache_blob(blob, identity).has_value());
+
+  CHECK(!validate_pipeline_cache_blob(std::span(blob).first(8), identity)
+             .has_value());
+}
+
+TEST_CASE("ThreadPool runs every job, including those queued at shutdown") {
+  std::atomic<int> counter{0};
+  {
+    ThreadPool pool{4};
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 64; ++i)
+      results.push_back(pool.submit([&counter, i] {
+        ++counter;
+        return i * i;
+      }));
+    for (int i = 0; i < 64; ++i)
+      CHECK(results[i].get() == i * i);
+
+    for (int i = 0; i < 64; ++i)
+      pool.submit([&counter] { ++counter; });
+    pool.wait_idle();
+    CHECK(counter.load() == 128);
+
+    for (int i = 0; i < 64; ++i)
+      pool.submit([&counter] { ++counter; });
+  }
+  CHECK(counter.load() == 192);
+}
+
+TEST_CASE("Shader cache keys cover includes and entries round-trip") {
+  const std::vector<ResolvedInclude> includes{{"common.glsl", "float x;"}};
+  const auto key = shader_cache_key(ShaderStage::fragment, "main",
+                                    "void main() {}", includes, 1);
+
+  CHECK(key == shader_cache_key(ShaderStage::fragment, "main",
+                                "void main() {}", includes, 1));
+  CHECK(key != shader_cache_key(ShaderStage::vertex, "main", "void main() {}",
+                                includes, 1));
+  CHECK(key != shader_cache_key(ShaderStage::fragment, "main",
+                                "void main() {}", includes, 2));
+  const std::vector<ResolvedInclude> edited{{"common.glsl", "float y;"}};
+  CHECK(key != shader_cache_key(ShaderStage::fragment, "main",
+                                "void main() {}", edited, 1));
+
+  const CachedShaderStage stage{
+      .spirv = {0x03, 0x02, 0x23, 0x07, 1, 2, 3, 4},
+      .push_constant_size = 64,
+      .has_push_constants = true,
+  };
+  auto bytes = serialise_shader_cache_entry(key, stage);
+  auto parsed = parse_shader_cache_entry(bytes, key);
+  REQUIRE(parsed.has_value());
+  CHECK(*parsed == stage);
+
+  CHECK(!parse_shader_cache_entry(bytes, key + 1).has_value());
+  bytes.back() ^= 0xff;
+  CHECK(!parse_shader_cache_entry(bytes, key).has_value());
+}
+
+TEST_CASE("MappedFile maps whole files and survives moves") {
+  const auto path =
+      std::filesystem::temp_directory_path() / "vk_bindless_mapped_file.bin";
+  std::vector<std::uint8_t> contents(10000);
+  for (std::size_t i = 0; i < contents.size(); ++i)
+    contents[i] = static_cast<std::uint8_t>(i * 31);
+  {
+    std::ofstream file{path, std::ios::binary};
+    file.write(reinterpret_cast<const char *>(contents.data()),
+               static_cast<std::streamsize>(contents.size()));
+  }
+
+  auto mapped = MappedFile::open(path);
+  REQUIRE(mapped.has_value());
+  const auto bytes = mapped->bytes();
+  CHECK(std::ranges::equal(std::as_bytes(std::span{contents}), bytes));
+
+  MappedFile moved = std::move(*mapped);
+  CHECK(moved.bytes().data() == bytes.data());
+  CHECK(mapped->bytes().empty());
+
+  moved = {};
+  CHECK(moved.bytes().empty());
+  std::filesystem::remove(path);
+
+  CHECK(!MappedFile::open(path).has_value());
+}
+
+TEST_CASE("Mesh caches go stale with their source or version") {
+  const auto directory = std::filesystem::temp_directory_path();
+  const auto source = directory / "vk_bindless_mesh_source.glb";
+  const auto cache = directory / "vk_bindless_mesh_cache.glb";
+  const auto write = [](const auto &path, const void *data, std::size_t size) {
+    std::ofstream file{path, std::ios::binary};
+    file.write(static_cast<const char *>(data),
+               static_cast<std::streamsize>(size));
+  };
+  const std::string contents = "not really a glb";
+  write(source, contents.data(), contents.size());
+
+  const auto hash = MeshFile::compute_source_hash(source);
+  REQUIRE(hash.has_value());
+  MeshFileHeader header{};
+  header.source_hash = *hash;
+  write(cache, &header, sizeof(header));
+  CHECK(MeshFile::is_cache_current(source, cache));
+  const auto other_preset =
+    default_texture_encode_preset == TextureEncodePreset::Fast
+      ? TextureEncodePreset::Archival
+      : TextureEncodePreset::Fast;
+  CHECK(!MeshFile::is_cache_current(source, cache, other_preset));
+
+  header.version = MeshFileHeader::current_version - 1;
+  write(cache, &header, sizeof(header));
+  CHECK(!MeshFile::is_cache_current(source, cache));
+
+  header.version = MeshFileHeader::current_version;
+  write(cache, &header, sizeof(header));
+  const std::string edited = "not really a glb!";
+  write(source, edited.data(), edited.size());
+  CHECK(!MeshFile::is_cache_current(source, cache));
+
+  // Buffers referenced by URI are part of the source too.
+  const auto buffer = directory / "vk_bindless_mesh_buffer.bin";
+  const std::string referencing =
+      R"({"buffers": [{"uri": "vk_bindless_mesh_buffer.bin"}]})";
+  write(source, referencing.data(), referencing.size());
+  write(buffer, contents.data(), contents.size());
+  header.source_hash = *MeshFile::compute_source_hash(source);
+  write(cache, &header, sizeof(header));
+  CHECK(MeshFile::is_cache_current(source, cache));
+  write(buffer, edited.data(), edited.size());
+  CHECK(!MeshFile::is_cache_current(source, cache));
+
+  std::filesystem::remove(buffer);
+  std::filesystem::remove(source);
+  std::filesystem::remove(cache);
+}
+
+TEST_CASE("Imported textures are deduplicated with stable indices") {
+  const auto directory =
+      std::filesystem::temp_directory_path() / "vk_bindless_texture_import";
+  const auto cache_directory = directory / "cache";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+
+  // Binary PPMs, which stb_image reads; two of them hold the same pixels.
+  const auto write_ppm = [&](const char *name, std::uint8_t red,
+                             std::uint8_t blue) {
+    std::ofstream file{directory / name, std::ios::binary};
+    file << "P6\n8 8\n255\n";
+    for (int i = 0; i < 8 * 8; ++i) {
+      const char texel[] = {static_cast<char>(red),
+                            static_cast<char>(i * 4),
+                            static_cast<char>(blue)};
+      file.write(texel, sizeof(texel));
+    }
+  };
+  write_ppm("red.ppm", 255, 0);
+  write_ppm("blue.ppm", 0, 255);
+  write_ppm("red_copy.ppm", 255, 0);
+
+  // Materials refer to red, blue and then the copy of red.
+  {
+    std::ofstream materials{directory / "scene.mtl"};
+    for (const auto *name : {"red", "blue", "red_copy"}) {
+      materials << "newmtl " << name << "\nmap_Kd "
+                << (directory / name).string() << ".ppm\n";
+    }
+    std::ofstream scene{directory / "scene.obj"};
+    scene << "mtllib scene.mtl\n";
+    int first = 1;
+    for (const auto *name : {"red", "blue", "red_copy"}) {
+      scene << "o " << name << "\nv 0 0 " << first << "\nv 1 0 " << first
+            << "\nv 0 1 " << first << "\nvt 0 0\nvt 1 0\nvt 0 1\n"
+            << "usemtl " << name << "\nf " << first << "/" << first << " "
+            << first + 1 << "/" << first + 1 << " " << first + 2 << "/"
+            << first + 2 << "\n";
+      first += 3;
+    }
+  }
+
+  // The albedo index of each textured material, and the texture count.
+  const auto import = [&] {
+    std::filesystem::remove_all(cache_directory);
+    REQUIRE(MeshFile::preload_mesh(directory / "scene.obj", cache_directory));
+    std::ifstream file{cache_directory / "scene.obj", std::ios::binary};
+    const std::vector<char> bytes(std::istreambuf_iterator<char>{file}, {});
+
+    MeshFileHeader header{};
+    REQUIRE(bytes.size() >= sizeof(header));
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    const auto &section = header.section(MeshFileSection::Materials);
+    std::vector<Material> materials(section.size / sizeof(Material));
+    std::memcpy(materials.data(), bytes.data() + section.offset,
+                materials.size() * sizeof(Material));
+    std::vector<std::int32_t> albedo;
+    for (const auto &material : materials)
+      if (material.albedo_texture_index >= 0)
+        albedo.push_back(material.albedo_texture_index);
+
+    std::size_t texture_count = 0;
+    std::memcpy(&texture_count,
+                bytes.data() + header.section(MeshFileSection::Textures).offset,
+                sizeof(texture_count));
+    return std::pair{albedo, texture_count};
+  };
+
+  const auto [albedo, texture_count] = import();
+  CHECK(albedo == std::vector<std::int32_t>{0, 1, 0});
+  CHECK(texture_count == 2);
+
+  // However the decodes were scheduled, the indices come out the same.
+  CHECK(import() == std::pair{albedo, texture_count});
+  std::filesystem::remove_all(directory);
+}
+
+// A bumpy grid of quads, big enough for several meshlets and LODs.
+auto make_grid_mesh(unsigned columns, unsigned rows)
+    -> std::unique_ptr<aiMesh> {
+  auto mesh = std::make_unique<aiMesh>();
+  mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+  mesh->mNumVertices = (columns + 1) * (rows + 1);
+  mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+  mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+  for (unsigned y = 0; y <= rows; ++y) {
+    for (unsigned x = 0; x <= columns; ++x) {
+      const auto fx = static_cast<float>(x);
+      const auto fy = static_cast<float>(y);
+      const auto i = y * (columns + 1) + x;
+      mesh->mVertices[i] =
+          aiVector3D(fx, fy, std::sin(fx * 0.7f) * std::cos(fy * 0.3f));
+      mesh->mNormals[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+    }
+  }
+
+  mesh->mNumFaces = columns * rows * 2;
+  mesh->mFaces = new aiFace[mesh->mNumFaces];
+  unsigned face = 0;
+  for (unsigned y = 0; y < rows; ++y) {
+    for (unsigned x = 0; x < columns; ++x) {
+      const auto i = y * (columns + 1) + x;
+      const auto above = i + columns + 1;
+      for (const auto &corners : {std::array{i, i + 1, above},
+                                  std::array{i + 1, above + 1, above}}) {
+        auto &triangle = mesh->mFaces[face++];
+        triangle.mNumIndices = 3;
+        triangle.mIndices = new unsigned[3]{corners[0], corners[1], corners[2]};
+      }
+    }
+  }
+  return mesh;
+}
+
+TEST_CASE("Meshes converted in parallel match a serial conversion") {
+  std::vector<std::unique_ptr<aiMesh>> scene;
+  scene.push_back(make_grid_mesh(24, 24));
+  scene.push_back(make_grid_mesh(7, 3));
+  scene.push_back(make_grid_mesh(40, 17));
+
+  MeshData serial;
+  for (const auto &mesh : scene) {
+    std::vector<ConvertedMesh> one;
+    one.push_back(convert_assimp_mesh_to_mesh(*mesh));
+    append_converted_meshes(one, serial);
+  }
+
+  MeshData parallel;
+  {
+    std::vector<ConvertedMesh> converted(scene.size());
+    ThreadPool pool{4};
+    std::vector<std::future<void>> jobs;
+    for (std::size_t i = 0; i < scene.size(); ++i)
+      jobs.push_back(pool.submit([&converted, &scene, i] {
+        converted[i] = convert_assimp_mesh_to_mesh(*scene[i]);
+      }));
+    for (auto &job : jobs)
+      job.get();
+    append_converted_meshes(converted, parallel);
+  }
+
+  const auto same_bytes = [](const auto &a, const auto &b) {
+    return std::ranges::equal(std::as_bytes(std::span{a}),
+                              std::as_bytes(std::span{b}));
+  };
+  REQUIRE(serial.meshes.size() == scene.size());
+  CHECK(serial.meshlets.size() > scene.size());
+  CHECK(same_bytes(serial.meshes, parallel.meshes));
+  CHECK(same_bytes(serial.vertex_data, parallel.vertex_data));
+  CHECK(same_bytes(serial.index_data, parallel.index_data));
+  CHECK(same_bytes(serial.meshlets, parallel.meshlets));
+  CHECK(same_bytes(serial.meshlet_vertices, parallel.meshlet_vertices));
+  CHECK(same_bytes(serial.meshlet_triangles, parallel.meshlet_triangles));
+
+  // Each mesh starts where the one before it ends.
+  for (std::size_t i = 1; i < serial.meshes.size(); ++i) {
+    const auto &previous = serial.meshes[i - 1];
+    const auto &mesh = serial.meshes[i];
+    CHECK(mesh.vertex_offset == previous.vertex_offset + previous.vertex_count);
+    CHECK(mesh.index_offset ==
+          previous.index_offset + previous.lod_offset[previous.lod_count]);
+    CHECK(mesh.lod_meshlet_offset[0] ==
+          previous.lod_meshlet_offset[previous.lod_count]);
+  }
+}
+
+TEST_CASE("Mip levels average 2x2 blocks and keep flat colours") {
+  // 5x3: the last column and row are dropped.
+  std::vector<std::uint8_t> source(5 * 3 * 4);
+  for (std::size_t i = 0; i < source.size(); ++i) {
+    source[i] = static_cast<std::uint8_t>(i * 7);
+  }
+  std::vector<std::uint8_t> level(2 * 1 * 4);
+  downsample_rgba8(source, 5, 3, level, MipContent::Linear);
+  const auto at = [&](std::size_t x, std::size_t y, std::size_t c) {
+    return source[(y * 5 + x) * 4 + c];
+  };
+  for (std::size_t x = 0; x < 2; ++x) {
+    for (std::size_t c = 0; c < 4; ++c) {
+      const auto sum = at(2 * x, 0, c) + at(2 * x + 1, 0, c) +
+                       at(2 * x, 1, c) + at(2 * x + 1, 1, c);
+      CHECK(level[x * 4 + c] == (sum + 2) / 4);
+    }
+  }
+
+  // Widths the vector loop covers fully, with a tail, and odd ones that
+  // drop a column; heights of one row average it with itself.
+  const std::array<std::array<std::uint32_t, 2>, 6> extents{
+      {{8, 2}, {9, 3}, {16, 1}, {21, 4}, {33, 5}, {64, 6}}};
+  std::uint32_t seed = 12345;
+  for (const auto [width, height] : extents) {
+    CAPTURE(width);
+    CAPTURE(height);
+    std::vector<std::uint8_t> texels(width * height * 4);
+    for (auto &texel : texels) {
+      seed = seed * 1664525 + 1013904223;
+      texel = static_cast<std::uint8_t>(seed >> 24);
+    }
+    const auto out_width = mip_extent(width);
+    const auto out_height = mip_extent(height);
+    std::vector<std::uint8_t> out(out_width * out_height * 4);
+    downsample_rgba8(texels, width, height, out, MipContent::Linear);
+
+    std::vector<std::uint8_t> expected(out.size());
+    for (std::uint32_t y = 0; y < out_height; ++y) {
+      const auto top = 2 * y;
+      const auto bottom = std::min(2 * y + 1, height - 1);
+      for (std::uint32_t x = 0; x < out_width; ++x) {
+        const auto left = 2 * x;
+        const auto right = std::min(2 * x + 1, width - 1);
+        for (std::uint32_t c = 0; c < 4; ++c) {
+          const auto texel = [&](std::uint32_t tx, std::uint32_t ty) {
+            return texels[(ty * width + tx) * 4 + c];
+          };
+          const auto sum = texel(left, top) + texel(right, top) +
+                           texel(left, bottom) + texel(right, bottom);
+          expected[(y * out_width + x) * 4 + c] =
+              static_cast<std::uint8_t>((sum + 2) / 4);
+        }
+      }
+    }
+    CHECK(out == expected);
+  }
+
+  // A flat sRGB colour survives the round trip through linear space.
+  std::vector<std::uint8_t> flat(4 * 4 * 4, 77);
+  std::vector<std::uint8_t> flat_level(2 * 2 * 4);
+  downsample_rgba8(flat, 4, 4, flat_level, MipContent::Srgb);
+  CHECK(std::ranges::all_of(flat_level, [](auto v) { return v == 77; }));
+
+  // Normals pointing away from each other average to a unit vector.
+  const std::vector<std::uint8_t> normals{255, 128, 128, 255,
+                                          128, 255, 128, 255};
+  std::vector<std::uint8_t> normal_level(4);
+  downsample_rgba8(normals, 2, 1, normal_level, MipContent::NormalMap);
+  CHECK(normal_level[0] == 218);
+  CHECK(normal_level[1] == 218);
+}